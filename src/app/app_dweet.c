@@ -66,6 +66,11 @@
 /* TX data buffer length in bytes */
 #define US_TX_DATA_BUFFER_LENGTH        ((uint16)128)
 
+/* TCP keepalive: idle time and probes interval in ms, number of unanswered probes before reconnecting */
+#define UL_KEEPALIVE_IDLE_MS            ((uint32)20000)
+#define UL_KEEPALIVE_INTERVAL_MS        ((uint32)5000)
+#define UC_KEEPALIVE_PROBES_NUM         ((uint8)3)
+
 /* RTOS callback iD used for periodic requests */
 #define PERIODIC_REQ_CALLBACK_ID        (RTOS_CB_ID_1)
 
@@ -91,6 +96,7 @@ typedef enum
     KE_OPEN_CONN_STATE,
     KE_REQ_INFO_STATE,
     KE_WAIT_INFO_STATE,
+    KE_RECONNECT_STATE,
     KE_CLOSE_STATE,
     KE_WAIT_NEXT_REQ_STATE,
     KE_IDLE_STATE,
@@ -118,8 +124,8 @@ LOCAL ke_ConnectionStatus enConnStatus;
 /* IP address */
 LOCAL uint32 ui32IPAddress = UL_NULL;
 
-/* TCP connection index number. Fixed at TCP_KE_CONN_1 */
-LOCAL TCP_ke_ConnIndex eTCPConnIndex = TCP_KE_CONN_1;
+/* TCP connection index number. Allocated at connection opening */
+LOCAL TCP_ke_ConnIndex eTCPConnIndex = TCP_KE_NULL_CONN_INDEX;
 
 /* TX data buffer pointer */
 LOCAL uint8 *pui8TXDataBufPtr = NULL_PTR;
@@ -127,9 +133,15 @@ LOCAL uint8 *pui8TXDataBufPtr = NULL_PTR;
 /* RX data buffer pointer */
 LOCAL uint8 *pui8RXDataBufPtr = NULL_PTR;
 
+/* Length of the dweet string already accepted by TCP */
+LOCAL uint16 ui16TXDataSentLength = US_NULL;
+
 /* TCP connection open success flag */
 LOCAL boolean bTCPOpenConnSuccess = B_FALSE;
 
+/* TCP connection closed or aborted while waiting for next request */
+LOCAL boolean bTCPConnLost = B_FALSE;
+
 /* Flag to store application state */
 LOCAL boolean bDweetAppConnectionReq = B_FALSE;
 
@@ -141,6 +153,7 @@ LOCAL boolean bDweetAppConnectionReq = B_FALSE;
 LOCAL void manageAppButton                  ( void );
 LOCAL void checkDweetResponse               ( uint8 * );
 LOCAL void triggerNextReqInfoCallBack       ( void );
+LOCAL void manageTCPEvent                   ( TCP_ke_ConnIndex, TCP_ke_ConnEvent );
 
 
 
@@ -182,7 +195,8 @@ EXPORTED void APP_DWEET_Init( void )
 /* Dweet app periodic task */
 EXPORTED void APP_DWEET_PeriodicTask( void )
 {
-    uint16 ui16RXDataLength;
+    TCP_st_ConnOptions stTCPOptions;
+    uint16 ui16TXDataLength;
 
     /* manage app ON/OFF button */
     manageAppButton();
@@ -214,34 +228,63 @@ EXPORTED void APP_DWEET_PeriodicTask( void )
         }
         case KE_OPEN_CONN_STATE:
         {
+            /* TCP buffers as long as app ones: the whole response is read at once and the request is short */
+            TCP_getDefaultConnOptions(&stTCPOptions);
+            stTCPOptions.ui16RXBufferLength = US_RX_DATA_BUFFER_LENGTH;
+            stTCPOptions.ui16TXBufferLength = US_TX_DATA_BUFFER_LENGTH;
+            /* detect a dead server or an expired NAT mapping while waiting for next request */
+            stTCPOptions.bKeepAlive = B_TRUE;
+            stTCPOptions.ui32KeepAliveIdleMs = UL_KEEPALIVE_IDLE_MS;
+            stTCPOptions.ui32KeepAliveIntvMs = UL_KEEPALIVE_INTERVAL_MS;
+            stTCPOptions.ui8KeepAliveProbesNum = UC_KEEPALIVE_PROBES_NUM;
+            /* send the request with the SYN once the server has given its Fast Open cookie */
+            stTCPOptions.bFastOpen = B_TRUE;
             /* open a TCP connection */
-            bTCPOpenConnSuccess = TCP_openConnection(   eTCPConnIndex,
-                                                        ui32IPAddress,
-                                                        UL_DWEET_IP_ADDRESS,
-                                                        US_LOCAL_SOURCE_PORT,
-                                                        US_DWEET_LISTENING_PORT,
-                                                        B_FALSE);
+            eTCPConnIndex = TCP_openConnectionWithOptions( ui32IPAddress,
+                                                           UL_DWEET_IP_ADDRESS,
+                                                           US_LOCAL_SOURCE_PORT,
+                                                           US_DWEET_LISTENING_PORT,
+                                                           &stTCPOptions);
             /* if TCP connection index is valid */
-            if( B_TRUE == bTCPOpenConnSuccess )
+            if( TCP_KE_NULL_CONN_INDEX != eTCPConnIndex )
             {
+                /* connection is open */
+                bTCPOpenConnSuccess = B_TRUE;
+                /* get the response as soon as it is received */
+                TCP_setEventCallback(eTCPConnIndex, &manageTCPEvent);
                 /* go into REQUEST INFO state */
                 enConnStatus = KE_REQ_INFO_STATE;
             }
             else
             {
                 /* fail to open a TCP connection: try on next run */
+                bTCPOpenConnSuccess = B_FALSE;
                 break;
             }
             /* ATTENTION: fall-through if success only */
         }
         case KE_REQ_INFO_STATE:
         {
-            /* require to send dweet string */
-            if( B_TRUE == TCP_sendData(eTCPConnIndex, pui8TXDataBufPtr, MEM_GET_LENGTH(pui8TXDataBufPtr)))
+            /* get dweet string length */
+            ui16TXDataLength = (uint16)MEM_GET_LENGTH((const char *)pui8TXDataBufPtr);
+            /* require to send the remaining part of dweet string */
+            ui16TXDataSentLength += TCP_sendData(eTCPConnIndex,
+                                                 &pui8TXDataBufPtr[ui16TXDataSentLength],
+                                                 (uint16)(ui16TXDataLength - ui16TXDataSentLength));
+            /* if the whole string has been accepted */
+            if( ui16TXDataSentLength >= ui16TXDataLength)
             {
+                /* string is ready for next request */
+                ui16TXDataSentLength = US_NULL;
                 /* go into WAIT INFO state */
                 enConnStatus = KE_WAIT_INFO_STATE;
             }
+            /* else if connection has been aborted */
+            else if( TCP_KE_ERR_NONE != TCP_getConnError(eTCPConnIndex))
+            {
+                /* go into RECONNECT state */
+                enConnStatus = KE_RECONNECT_STATE;
+            }
             else
             {
                 /* fail to open a TCP connection: try on next run */
@@ -250,18 +293,11 @@ EXPORTED void APP_DWEET_PeriodicTask( void )
         }
         case KE_WAIT_INFO_STATE:
         {
-            /* check received TCP data */
-            TCP_getReceivedData(eTCPConnIndex, pui8RXDataBufPtr, &ui16RXDataLength);
-            if( ui16RXDataLength != US_NULL )
+            /* response is managed by TCP events callback. If connection has been aborted */
+            if( TCP_KE_ERR_NONE != TCP_getConnError(eTCPConnIndex))
             {
-                /* check TCP received data */
-                checkDweetResponse(pui8RXDataBufPtr);
-
-                /* trigger next request later */
-                RTOS_SetCallback(PERIODIC_REQ_CALLBACK_ID, RTOS_CB_TYPE_SINGLE, 1000, &triggerNextReqInfoCallBack);
-
-                /* go into KE_WAIT_NEXT_REQ_STATE state */
-                enConnStatus = KE_WAIT_NEXT_REQ_STATE;
+                /* go into RECONNECT state */
+                enConnStatus = KE_RECONNECT_STATE;
             }
             else
             {
@@ -269,12 +305,33 @@ EXPORTED void APP_DWEET_PeriodicTask( void )
             }
             break;
         }
+        case KE_RECONNECT_STATE:
+        {
+            /* release the closed or aborted connection and open it again on next run. Send the whole string again */
+            ui16TXDataSentLength = US_NULL;
+            TCP_closeConnection(eTCPConnIndex);
+            eTCPConnIndex = TCP_KE_NULL_CONN_INDEX;
+            bTCPConnLost = B_FALSE;
+            enConnStatus = KE_OPEN_CONN_STATE;
+            break;
+        }
         case KE_CLOSE_STATE:
         {
             /* stop any eventual pending data request callback */
             RTOS_StopCallback(PERIODIC_REQ_CALLBACK_ID);
-            /* close the TCP connection */
-            TCP_closeConnection(eTCPConnIndex);
+            /* close the TCP connection, if still open. Its index is no longer valid */
+            if( TCP_KE_NULL_CONN_INDEX != eTCPConnIndex )
+            {
+                TCP_closeConnection(eTCPConnIndex);
+                eTCPConnIndex = TCP_KE_NULL_CONN_INDEX;
+            }
+            else
+            {
+                /* connection has already been released */
+            }
+            bTCPConnLost = B_FALSE;
+            /* discard any partially sent string */
+            ui16TXDataSentLength = US_NULL;
             /* reset connection success flag */
             bTCPOpenConnSuccess = B_FALSE;
             /* go into IDLE state */
@@ -314,6 +371,14 @@ EXPORTED void APP_DWEET_PeriodicTask( void )
                 /* request connection closure: go into KE_CLOSE_STATE state */
                 enConnStatus = KE_CLOSE_STATE;
             }
+            /* else if connection has been closed or aborted while waiting */
+            else if( B_TRUE == bTCPConnLost )
+            {
+                /* release it now. A new one is opened when next request is due */
+                TCP_closeConnection(eTCPConnIndex);
+                eTCPConnIndex = TCP_KE_NULL_CONN_INDEX;
+                bTCPConnLost = B_FALSE;
+            }
             else
             {
                 /* app is already ON: do nothing */
@@ -333,11 +398,77 @@ EXPORTED void APP_DWEET_PeriodicTask( void )
 
 /* -------------- Local functions declaration ------------------ */
 
+/* callback for TCP connection events */
+LOCAL void manageTCPEvent( TCP_ke_ConnIndex eConnIndex, TCP_ke_ConnEvent eEvent )
+{
+    uint16 ui16RXDataLength;
+
+    /* if a response is received while awaiting for it */
+    if((TCP_KE_EVT_DATA_READY == eEvent)
+    && (KE_WAIT_INFO_STATE == enConnStatus))
+    {
+        /* get TCP received data */
+        TCP_getReceivedData(eConnIndex, pui8RXDataBufPtr, &ui16RXDataLength);
+
+        /* check TCP received data */
+        checkDweetResponse(pui8RXDataBufPtr);
+
+        /* trigger next request later */
+        RTOS_SetCallback(PERIODIC_REQ_CALLBACK_ID, RTOS_CB_TYPE_SINGLE, 1000, &triggerNextReqInfoCallBack);
+
+        /* go into KE_WAIT_NEXT_REQ_STATE state */
+        enConnStatus = KE_WAIT_NEXT_REQ_STATE;
+    }
+    /* else if connection has been closed by the peer, or closed or aborted by TCP */
+    else if((TCP_KE_EVT_PEER_CLOSED == eEvent)
+    ||      (TCP_KE_EVT_CLOSED == eEvent)
+    ||      (TCP_KE_EVT_ABORTED == eEvent))
+    {
+        /* if a request is being sent or a response is awaited */
+        if((KE_REQ_INFO_STATE == enConnStatus)
+        || (KE_WAIT_INFO_STATE == enConnStatus))
+        {
+            /* reconnect and send the request again */
+            enConnStatus = KE_RECONNECT_STATE;
+        }
+        /* else if waiting for next request */
+        else if(KE_WAIT_NEXT_REQ_STATE == enConnStatus)
+        {
+            /* release the connection but keep requests pace */
+            bTCPConnLost = B_TRUE;
+        }
+        else
+        {
+            /* connection is being opened or closed on request */
+        }
+    }
+    else
+    {
+        /* other events are managed by periodic task */
+    }
+}
+
+
 /* callback for trigging next info request */
 LOCAL void triggerNextReqInfoCallBack( void )
 {
-    /* go into KE_REQ_INFO_STATE state */
-    enConnStatus = KE_REQ_INFO_STATE;
+    /* if connection has been lost and not yet released */
+    if( B_TRUE == bTCPConnLost )
+    {
+        /* go into KE_RECONNECT_STATE state: request is sent once the new connection is open */
+        enConnStatus = KE_RECONNECT_STATE;
+    }
+    /* else if connection has been released while waiting */
+    else if( TCP_KE_NULL_CONN_INDEX == eTCPConnIndex )
+    {
+        /* go into KE_OPEN_CONN_STATE state: request is sent once the new connection is open */
+        enConnStatus = KE_OPEN_CONN_STATE;
+    }
+    else
+    {
+        /* go into KE_REQ_INFO_STATE state */
+        enConnStatus = KE_REQ_INFO_STATE;
+    }
 }
 
 
@@ -503,6 +503,7 @@ typedef unsigned char       boolean;
 #define MEM_MALLOC(x)                       (malloc((x)))
 #define MEM_FREE(x)                         (free((x)))
 #define MEM_COPY(x,y,z)                     (memcpy((x),(y),(z)))
+#define MEM_SET(x,y,z)                      (memset((x),(y),(z)))
 #define MEM_COMPARE(x,y,z)                  (strncmp((x),(y),(z)))
 #define MEM_GET_LENGTH(x)                   (strlen(x))
 
@@ -75,14 +75,14 @@ TODO LIST:
 #define ULL_SW_MAC_ADDRESS          ((uint64)0x0000218956435612)
 #endif
 
-/* this value is related to ETHMAC_st_DataDcpt struct; 2 descriptors used for each TX buffer */
-#define UC_NUM_OF_TX_DCPT                   ((uint8)(ETHMAC_UC_TX_NUM_OF_BUFFERS * UC_2))
+/* this value is related to ETHMAC_st_DataDcpt struct; 1 descriptor for the ethernet header plus 1 for each chained data buffer */
+#define UC_NUM_OF_TX_DCPT                   ((uint8)(ETHMAC_UC_TX_MAX_FRAGS_NUM + UC_1))
 
 /* num of RX descriptors */
 #define UC_NUM_OF_RX_DCPT                   (ETHMAC_UC_RX_NUM_OF_BUFFERS)
 
-/* length of each buffer in bytes */
-#define US_DATA_BUFFER_LENGTH               (IPV4_US_ACCEPTED_MIN_LENGTH)
+/* length of each buffer in bytes: a whole frame of the interface MTU. ATTENTION: RX buffers size is multiple of 16 bytes */
+#define US_DATA_BUFFER_LENGTH               ((uint16)((IPV4_US_FRAG_MAX_LENGTH + ETHMAC_UC_ETH_HDR_LENGTH + UC_15) & ~UC_15))
 
 /* Back to back inter-packet gap defined as default register value */
 #define BB_INTERPACKET_GAP_VALUE            0x15
@@ -312,6 +312,12 @@ typedef struct
 /* Ethernet datagram related set macros */
 #define SET_ETHERTYPE(x,y)          ((x) = SWAP_BYTES_ORDER_16BIT_(y))
 
+/* hardware RX checksum usage */
+#define B_RX_CHECKSUM_ENABLED       ((ETHMAC_UC_RX_CHECKSUM_ENABLE != 0) ? B_TRUE : B_FALSE)
+
+/* hardware RX checksum sums little endian 16-bit words: get it as a sum of big endian ones */
+#define GET_RX_HW_SUM(x)            ((uint32)SWAP_BYTES_ORDER_16BIT_((uint16)(x)))
+
 
 
 
@@ -326,7 +332,7 @@ EXPORTED uint64 ETHMAC_ui64MACAddress;
 /* --------------- Local variables declaration ------------ */
 
 /* TX descriptors data buffers */
-LOCAL uint8 *apui8TXDcptDataBuffers[(UC_NUM_OF_TX_DCPT / 2)];
+LOCAL uint8 *apui8TXDcptDataBuffers[ETHMAC_UC_TX_NUM_OF_BUFFERS];
 
 /* RX descriptors data buffers */
 LOCAL uint8 *apui8RXDcptDataBuffers[UC_NUM_OF_RX_DCPT];
@@ -344,6 +350,10 @@ LOCAL st_RXEthDcpt *stRXCurrEthDcpt;
 /* Pending RX descriptor to clear flag. Used by ETHMAC_getNextRXDataBuffer function */
 LOCAL boolean bPrevPending;
 
+/* Hardware sum and data length of the current RX frame. Set by ETHMAC_getNextRXDataBuffer function */
+LOCAL uint32 ui32RXFrameSum;
+LOCAL uint16 ui16RXFrameLength;
+
 
 
 
@@ -382,7 +392,7 @@ EXPORTED boolean ETHMAC_Init( void )
     }
 
     /* init all RX descriptors buffers */
-    for(ui8BuffCount = UC_NULL; ui8BuffCount < (UC_NUM_OF_TX_DCPT / 2); ui8BuffCount++)
+    for(ui8BuffCount = UC_NULL; ui8BuffCount < ETHMAC_UC_TX_NUM_OF_BUFFERS; ui8BuffCount++)
     {
         apui8TXDcptDataBuffers[ui8BuffCount] = (uint8 *)MEM_MALLOC(US_DATA_BUFFER_LENGTH);
         ALIGN_32BIT_OF_8BIT_PTR(apui8TXDcptDataBuffers[ui8BuffCount]);
@@ -478,6 +488,10 @@ EXPORTED uint8 * ETHMAC_getNextRXDataBuffer( void )
             /* get buffer pinter */
             pui8DataBufPtr = (uint8 *)PA_TO_KVA1((uint32)stRXCurrEthDcpt->pEDBuff);
 
+            /* keep hardware sum and data length: descriptor status is cleared once it is given back */
+            ui32RXFrameSum = GET_RX_HW_SUM(stRXCurrEthDcpt->stat.rxstat.PKT_Checksum);
+            ui16RXFrameLength = (uint16)stRXCurrEthDcpt->hdr.flags.bCount;
+
             bPrevPending = B_TRUE;
         }
         else
@@ -491,12 +505,67 @@ EXPORTED uint8 * ETHMAC_getNextRXDataBuffer( void )
 }
 
 
+/* Function to get the hardware ones' complement sum of the last frame given by ETHMAC_getNextRXDataBuffer().
+   The sum covers frame data from the end of the ethernet header: the summed length is returned too.
+   Return B_FALSE if hardware RX checksum is disabled or the frame is shorter than the ethernet header */
+EXPORTED boolean ETHMAC_getRXChecksum( uint32 *pui32Sum, uint16 *pui16SumLength )
+{
+    boolean bSumValid;
+
+    if((B_TRUE == B_RX_CHECKSUM_ENABLED)
+    && (ui16RXFrameLength > ETHMAC_UC_ETH_HDR_LENGTH))
+    {
+        *pui32Sum = ui32RXFrameSum;
+        *pui16SumLength = (uint16)(ui16RXFrameLength - ETHMAC_UC_ETH_HDR_LENGTH);
+        bSumValid = B_TRUE;
+    }
+    else
+    {
+        /* upper layers sum data by software */
+        bSumValid = B_FALSE;
+    }
+
+    return bSumValid;
+}
+
+
+/* Function to get the received length of the last frame given by ETHMAC_getNextRXDataBuffer() from the end of the ethernet header.
+   Return 0 if the frame is shorter than the ethernet header */
+EXPORTED uint16 ETHMAC_getRXDataLength( void )
+{
+    uint16 ui16DataLength;
+
+    if(ui16RXFrameLength > ETHMAC_UC_ETH_HDR_LENGTH)
+    {
+        ui16DataLength = (uint16)(ui16RXFrameLength - ETHMAC_UC_ETH_HDR_LENGTH);
+    }
+    else
+    {
+        /* no data */
+        ui16DataLength = US_NULL;
+    }
+
+    return ui16DataLength;
+}
+
+
 /* send packet. Data buffers have been previously saved into the shared ETHMAC_stTXDataBuffer structure */
 EXPORTED void ETHMAC_sendPacket( uint8 *pui8FramePtr, uint16 ui16DataLength, uint64 ui64HWSrcAdd, uint64 ui64HWDstAdd, uint16 ui16EthType )
+{
+    /* the rest of the packet is a single buffer */
+    ETHMAC_sendFragments(&pui8FramePtr, &ui16DataLength, UC_1, ui64HWSrcAdd, ui64HWDstAdd, ui16EthType);
+}
+
+
+/* send a packet whose data are scattered in several buffers. They are chained through TX descriptors without copying them.
+   ATTENTION: buffers can be released once this function returns */
+EXPORTED void ETHMAC_sendFragments( uint8 **ppui8BuffersPtr, uint16 *pui16BuffersLength, uint8 ui8BuffersNum, uint64 ui64HWSrcAdd, uint64 ui64HWDstAdd, uint16 ui16EthType )
 {
     uint8 aui8EthernetHeader[ETHMAC_UC_ETH_HDR_LENGTH];
-    uint8 *apui8PtrsArray[UC_2];
-    uint16 aui16LengthArray[UC_2];
+    uint8 *apui8PtrsArray[UC_NUM_OF_TX_DCPT];
+    uint16 aui16LengthArray[UC_NUM_OF_TX_DCPT];
+    uint8 ui8DcptNum;
+    uint8 ui8BufferIndex;
 
     /* set ETH addresses and type */
     setDestMACAddress(&aui8EthernetHeader[UC_0], ui64HWDstAdd);
@@ -507,13 +576,123 @@ EXPORTED void ETHMAC_sendPacket( uint8 *pui8FramePtr, uint16 ui16DataLength, uin
     /* 1 TX descriptor for the ethernet header */
     apui8PtrsArray[UC_0] = aui8EthernetHeader;
     aui16LengthArray[UC_0] = ETHMAC_UC_ETH_HDR_LENGTH;
-    
-    /* 1 TX descriptor for the rest of the packet */
-    apui8PtrsArray[UC_1] = pui8FramePtr;
-    aui16LengthArray[UC_1] = ui16DataLength;
+    ui8DcptNum = UC_1;
+
+    /* 1 TX descriptor for each data buffer */
+    for(ui8BufferIndex = UC_NULL; ui8BufferIndex < ui8BuffersNum; ui8BufferIndex++)
+    {
+        /* if buffer is not empty and there is a free descriptor */
+        if((pui16BuffersLength[ui8BufferIndex] > US_NULL)
+        && (ui8DcptNum < UC_NUM_OF_TX_DCPT))
+        {
+            apui8PtrsArray[ui8DcptNum] = ppui8BuffersPtr[ui8BufferIndex];
+            aui16LengthArray[ui8DcptNum] = pui16BuffersLength[ui8BufferIndex];
+            ui8DcptNum++;
+        }
+        else
+        {
+            /* ATTENTION: empty buffers are skipped. No more than ETHMAC_UC_TX_MAX_FRAGS_NUM buffers are sent */
+        }
+    }
 
-    /* 2 TX descriptors are used for each TX packet */
-    sendPacket(apui8PtrsArray, aui16LengthArray, US_2);
+    /* start transmission and wait until packet is sent */
+    sendPacket(apui8PtrsArray, aui16LengthArray, (uint16)ui8DcptNum);
+}
+
+
+/* send a packet buffers chain. The ethernet header is written in front of the first buffer if there is room, in a local buffer otherwise.
+   1 TX descriptor is used for each buffer of the chain. ATTENTION: buffers are not released, they can be released once this function returns.
+   Return B_FALSE, without sending anything, if the chain needs more than UC_NUM_OF_TX_DCPT descriptors */
+EXPORTED boolean ETHMAC_sendPbuf( PBUF_st_Buffer *pstPbuf, uint64 ui64HWSrcAdd, uint64 ui64HWDstAdd, uint16 ui16EthType )
+{
+    uint8 *apui8PtrsArray[UC_NUM_OF_TX_DCPT];
+    uint16 aui16LengthArray[UC_NUM_OF_TX_DCPT];
+    uint8 ui8DcptNum = UC_NULL;
+    uint8 *pui8HeaderPtr;
+    PBUF_st_Buffer *pstNextPbuf;
+    uint8 ui8BuffersNum = UC_NULL;
+    boolean bSuccess = B_TRUE;
+
+    /* count the buffers holding data after the first one, which holds the ethernet header too if there is room */
+    for(pstNextPbuf = pstPbuf->pstNext; pstNextPbuf != NULL_PTR; pstNextPbuf = pstNextPbuf->pstNext)
+    {
+        if(pstNextPbuf->ui16Length > US_NULL)
+        {
+            ui8BuffersNum++;
+        }
+        else
+        {
+            /* empty buffers are skipped */
+        }
+    }
+
+    /* if first buffer data cannot be preceded by the ethernet header: it needs a descriptor of its own */
+    if(pstPbuf->ui16Headroom < ETHMAC_UC_ETH_HDR_LENGTH)
+    {
+        ui8BuffersNum++;
+    }
+    else
+    {
+        /* ethernet header is written in place */
+    }
+
+    /* if there are not enough TX descriptors: the ethernet header takes one of them */
+    if(ui8BuffersNum > ETHMAC_UC_TX_MAX_FRAGS_NUM)
+    {
+        /* chain is too long: do not send a truncated packet */
+        bSuccess = B_FALSE;
+    }
+    /* else if ethernet header fits in front of data */
+    else if(B_TRUE == PBUF_addHeader(pstPbuf, ETHMAC_UC_ETH_HDR_LENGTH))
+    {
+        /* set ETH addresses and type in place */
+        pui8HeaderPtr = pstPbuf->pui8Payload;
+        setDestMACAddress(&pui8HeaderPtr[UC_0], ui64HWDstAdd);
+        setSrcMACAddress(&pui8HeaderPtr[ETHMAC_UC_ETH_ADD_LENGTH], ui64HWSrcAdd);
+        SET_ETHERTYPE(*((uint16 *)(&pui8HeaderPtr[(UC_2 * ETHMAC_UC_ETH_ADD_LENGTH)])), ui16EthType);
+
+        /* 1 TX descriptor for each buffer: the first one starts with the ethernet header */
+        while((pstPbuf != NULL_PTR)
+        &&    (ui8DcptNum < UC_NUM_OF_TX_DCPT))
+        {
+            if(pstPbuf->ui16Length > US_NULL)
+            {
+                apui8PtrsArray[ui8DcptNum] = pstPbuf->pui8Payload;
+                aui16LengthArray[ui8DcptNum] = pstPbuf->ui16Length;
+                ui8DcptNum++;
+            }
+            else
+            {
+                /* empty buffers are skipped */
+            }
+            pstPbuf = pstPbuf->pstNext;
+        }
+
+        /* start transmission and wait until packet is sent */
+        sendPacket(apui8PtrsArray, aui16LengthArray, (uint16)ui8DcptNum);
+    }
+    else
+    {
+        /* chain buffers after a local ethernet header */
+        while(pstPbuf != NULL_PTR)
+        {
+            if(pstPbuf->ui16Length > US_NULL)
+            {
+                apui8PtrsArray[ui8DcptNum] = pstPbuf->pui8Payload;
+                aui16LengthArray[ui8DcptNum] = pstPbuf->ui16Length;
+                ui8DcptNum++;
+            }
+            else
+            {
+                /* empty buffers are skipped */
+            }
+            pstPbuf = pstPbuf->pstNext;
+        }
+
+        ETHMAC_sendFragments(apui8PtrsArray, aui16LengthArray, ui8DcptNum, ui64HWSrcAdd, ui64HWDstAdd, ui16EthType);
+    }
+
+    return bSuccess;
 }
 
 
@@ -589,7 +768,7 @@ LOCAL void sendPacket( uint8 **pui8ArrayBuffers, uint16 *pui16ArraySizes, uint16
     /* descriptors list end as circular buffer (set the first buffer as the next one) */
     pstTailDcpt->next_ed = KVA_TO_PA(stTXArrayDcpt); /* anyway this is not used */
 
-    /* prepare descriptors array */
+    /* prepare descriptors array: only the first one starts the packet and only the last one ends it */
     stTXArrayDcpt[0].hdr.SOP = 1;   /* start of packet */
     stTXArrayDcpt[(ui16ArrayItems - US_1)].hdr.EOP = 1; /* end of packet */
 
@@ -790,6 +969,17 @@ LOCAL void initEthController( void )
     /* ATTENTION: not supported yet! */
 //    setPatternMatchRXFilter(...);
 
+    /* RX checksum starts at pattern match offset: sum frames from the end of the ethernet header.
+       ATTENTION: a pattern match filter shall keep this offset */
+    if(B_TRUE == B_RX_CHECKSUM_ENABLED)
+    {
+        ETHPMO = ETHMAC_UC_ETH_HDR_LENGTH;
+    }
+    else
+    {
+        /* checksum is not used */
+    }
+
     /* prepare RX packet */
     setRXPacket(apui8RXDcptDataBuffers, US_DATA_BUFFER_LENGTH, UC_NUM_OF_RX_DCPT);
 
@@ -47,6 +47,7 @@
 #include <stddef.h>
 
 #include "../fw_common.h"
+#include "../sal/tcpip/pbuf.h"
 
 
 
@@ -65,6 +66,14 @@
 /* Num of TX buffers */
 #define ETHMAC_UC_TX_NUM_OF_BUFFERS             (1)
 
+/* Maximum number of data buffers chained after the ethernet header in a TX frame */
+#define ETHMAC_UC_TX_MAX_FRAGS_NUM              (3)
+
+/* Use the hardware RX checksum of received frames: 1 to enable, 0 to disable. It can be overridden at build time */
+#ifndef ETHMAC_UC_RX_CHECKSUM_ENABLE
+#define ETHMAC_UC_RX_CHECKSUM_ENABLE            1
+#endif
+
 
 
 
@@ -80,7 +89,11 @@ EXTERN uint64 ETHMAC_ui64MACAddress;
 
 EXTERN boolean  ETHMAC_Init                 (void);
 EXTERN uint8 *  ETHMAC_getNextRXDataBuffer  (void);
+EXTERN boolean  ETHMAC_getRXChecksum        (uint32 *, uint16 *);
+EXTERN uint16   ETHMAC_getRXDataLength      (void);
 EXTERN void     ETHMAC_sendPacket           (uint8 *, uint16, uint64, uint64, uint16);
+EXTERN void     ETHMAC_sendFragments        (uint8 **, uint16 *, uint8, uint64, uint64, uint16);
+EXTERN boolean  ETHMAC_sendPbuf             (PBUF_st_Buffer *, uint64, uint64, uint16);
 EXTERN uint8 *  ETHMAC_getTXBufferPointer   (uint16);
 
 
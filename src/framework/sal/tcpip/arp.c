@@ -52,6 +52,7 @@ TODO LIST:
 
 #include "../../fw_common.h"
 #include "../../hal/ethmac.h"
+#include "../rtos/rtos.h"
 
 #include "arp.h"
 
@@ -69,6 +70,12 @@ TODO LIST:
 /* Max num of ETH addresses */
 #define UC_MAX_NUM_OF_ETH_ADD           ((uint8)8)
 
+/* Max num of IP addresses whose ARP requests are rate limited */
+#define UC_MAX_NUM_OF_PENDING_REQ       ((uint8)4)
+
+/* Task periods between two ARP requests for the same IP address (RFC 1122: at most one per second) */
+#define UC_REQUEST_RETRY_PERIODS        ((uint8)(1000 / RTOS_UL_TASKS_PERIOD_MS))
+
 /* Broadcast MAC address */
 #define BROADCAST_MAC_ADDRESS           ((uint64)0x0000FFFFFFFFFFFF)
 
@@ -126,6 +133,14 @@ typedef struct
 } st_IPAddToEthAddIdx;
 
 
+/* struct to store an IP address whose ARP request has been sent recently */
+typedef struct
+{
+    uint32 ui32IPAdd;           /* requested IP address value */
+    uint8 ui8RetryCounter;      /* task periods before another request can be sent. 0 if entry is free */
+} st_PendingRequest;
+
+
 /* struct to store router IP address and subnet mask */
 typedef struct
 {
@@ -150,6 +165,9 @@ LOCAL st_IPAddToEthAddIdx astIPAddToEthAddArray[UC_MAX_NUM_OF_IP_ADD] = {0, 0};
 /* Array of IP addresses of this device */
 LOCAL uint32 aui32LocalIPAddArray[UC_MAX_NUM_OF_LOCAL_IP_ADD] = {0};
 
+/* Array of IP addresses whose ARP requests are rate limited */
+LOCAL st_PendingRequest astPendingRequests[UC_MAX_NUM_OF_PENDING_REQ] = {{0, 0}};
+
 /* Structure to store router informations */
 LOCAL st_RouterInfo stRouterInfo =
 {
@@ -165,6 +183,7 @@ LOCAL st_RouterInfo stRouterInfo =
 LOCAL void      decodeARPPacket         (uint8 *);
 LOCAL void      prepareAndSendReply     (uint32, uint32, uint64);
 LOCAL void      prepareAndSendRequest   (uint32, uint32);
+LOCAL void      requestEthAdd           (uint32, uint32);
 LOCAL void      updateDstEthAddTable    (uint32, uint64);
 
 
@@ -237,12 +256,9 @@ EXPORTED boolean ARP_checkLocalIPAdd( uint32 ui32IPAdd )
 }
 
 
-/* get ETH address from IP address */
-EXPORTED uint64 ARP_getEthAddFromIPAdd( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd )
+/* get the IP address of the next hop towards a destination: the destination itself or the router */
+EXPORTED uint32 ARP_getNextHopIPAdd( uint32 ui32DstIPAdd )
 {
-    uint8 ui8Index = UC_NULL;
-    uint64 ui64DstEthAdd;
-
     /* If destination IP address is not in the local network */
     if((ui32DstIPAdd & stRouterInfo.ui32SubnetMask) != (stRouterInfo.ui32RouterIPAdd & stRouterInfo.ui32SubnetMask))
     {
@@ -254,6 +270,19 @@ EXPORTED uint64 ARP_getEthAddFromIPAdd( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd
         /* destination IP address is in the local network */
     }
 
+    return ui32DstIPAdd;
+}
+
+
+/* get ETH address from IP address */
+EXPORTED uint64 ARP_getEthAddFromIPAdd( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd )
+{
+    uint8 ui8Index = UC_NULL;
+    uint64 ui64DstEthAdd;
+
+    /* get the next hop: the destination or the router */
+    ui32DstIPAdd = ARP_getNextHopIPAdd(ui32DstIPAdd);
+
     /* If destination address is a IP broadcast address */
     if(0xFFFFFFFF == ui32DstIPAdd)
     {
@@ -279,8 +308,8 @@ EXPORTED uint64 ARP_getEthAddFromIPAdd( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd
         }
         else
         {
-            /* send a ARP request */
-            prepareAndSendRequest(ui32SrcIPAdd, ui32DstIPAdd);
+            /* send a ARP request, unless one has been sent recently */
+            requestEthAdd(ui32SrcIPAdd, ui32DstIPAdd);
 
             /* dst ETH address not available */
             ui64DstEthAdd = ULL_NULL;
@@ -305,6 +334,21 @@ EXPORTED void ARP_setEthAddToIPAdd( uint32 ui32IPAdd, uint64 ui64EthAdd )
 /* Periodic task */
 EXPORTED void ARP_PeriodicTask( void )
 {
+    uint8 ui8Index;
+
+    /* count down the time before ARP requests can be sent again */
+    for(ui8Index = UC_NULL; ui8Index < UC_MAX_NUM_OF_PENDING_REQ; ui8Index++)
+    {
+        if(astPendingRequests[ui8Index].ui8RetryCounter > UC_NULL)
+        {
+            astPendingRequests[ui8Index].ui8RetryCounter--;
+        }
+        else
+        {
+            /* free entry */
+        }
+    }
+
     /* implement IP addresses table counters management */
     //...
 }
@@ -417,106 +461,164 @@ LOCAL void decodeARPPacket( uint8 *pui8BufferPtr )
 /* prepare a REPLY packet and request transmission */
 LOCAL void prepareAndSendReply(uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint64 ui64DstEthAdd)
 {
-    uint8 *pui8BufPtr;
+    PBUF_st_Buffer *pstPbuf;
     uint32 *pui32HdrWords;
 
-    /* ATTENTION: set datagram pointer (use the first one at the moment) */
-    pui8BufPtr = (uint8 *)ETHMAC_getTXBufferPointer((uint16)ARP_MESSAGE_BYTE_LENGTH);
-    /* perform a 32-bit word alignment */
-    ALIGN_32BIT_OF_8BIT_PTR(pui8BufPtr);
-
-    /* update shared buffer pointer */
-    pui32HdrWords = (uint32 *)pui8BufPtr;
-
-    /* clear the buffer */
-    memset(pui32HdrWords, UC_NULL, ARP_MESSAGE_BYTE_LENGTH);
-
-    /* prepare fields */
-    SET_HW_TYPE(*pui32HdrWords, ARP_HW_TYPE);
-    SET_PROT_TYPE(*pui32HdrWords, ARP_PROT_TYPE);
-    pui32HdrWords++;
-    SET_HW_ADD_LENGTH(*pui32HdrWords, HW_ADD_BYTE_LENGTH);
-    SET_PROT_ADD_LENGTH(*pui32HdrWords, PROT_ADD_BYTE_LENGTH);
-    SET_OPERATION(*pui32HdrWords, ARP_OP_REPLY);
-    pui32HdrWords++;
-
-    /* sender MAC address */
-    SET_HIGH_16BIT(*pui32HdrWords, ((ETHMAC_ui64MACAddress & 0x0000FFFF00000000) >> ULL_SHIFT_32));
-    SET_LOW_16BIT(*pui32HdrWords, ((ETHMAC_ui64MACAddress & 0x00000000FFFF0000) >> ULL_SHIFT_16));
-    pui32HdrWords++;
-    SET_HIGH_16BIT(*pui32HdrWords, (ETHMAC_ui64MACAddress & 0x000000000000FFFF));
-
-    /* sender protocol address */
-    SET_LOW_16BIT(*pui32HdrWords, ((ui32SrcIPAdd & 0xFFFF0000) >> UL_SHIFT_16));
-    pui32HdrWords++;
-    SET_HIGH_16BIT(*pui32HdrWords, (ui32SrcIPAdd & 0x0000FFFF));
-
-    /* target MAC address */
-    SET_LOW_16BIT(*pui32HdrWords, ((ui64DstEthAdd & 0x0000FFFF00000000) >> ULL_SHIFT_32));
-    pui32HdrWords++;
-    SET_HIGH_16BIT(*pui32HdrWords, ((ui64DstEthAdd & 0x00000000FFFF0000) >> ULL_SHIFT_16));
-    SET_LOW_16BIT(*pui32HdrWords, (ui64DstEthAdd & 0x000000000000FFFF));
-
-    pui32HdrWords++;
-    /* target protocol address */
-    SET_HIGH_16BIT(*pui32HdrWords, ((ui32DstIPAdd & 0xFFFF0000) >> UL_SHIFT_16));
-    SET_LOW_16BIT(*pui32HdrWords, (ui32DstIPAdd & 0x0000FFFF));
-
-    /* request ETH packet transmission */
-    ETHMAC_sendPacket(pui8BufPtr, ARP_MESSAGE_BYTE_LENGTH, ETHMAC_ui64MACAddress, ui64DstEthAdd, US_ETH_TYPE_ARP);
+    /* get a small packet buffer: its data are 32-bit aligned and the ethernet header is written in front of them */
+    pstPbuf = PBUF_alloc((uint16)ARP_MESSAGE_BYTE_LENGTH);
+    if(pstPbuf != NULL_PTR)
+    {
+        /* update shared buffer pointer */
+        pui32HdrWords = (uint32 *)pstPbuf->pui8Payload;
+
+        /* clear the buffer */
+        memset(pui32HdrWords, UC_NULL, ARP_MESSAGE_BYTE_LENGTH);
+
+        /* prepare fields */
+        SET_HW_TYPE(*pui32HdrWords, ARP_HW_TYPE);
+        SET_PROT_TYPE(*pui32HdrWords, ARP_PROT_TYPE);
+        pui32HdrWords++;
+        SET_HW_ADD_LENGTH(*pui32HdrWords, HW_ADD_BYTE_LENGTH);
+        SET_PROT_ADD_LENGTH(*pui32HdrWords, PROT_ADD_BYTE_LENGTH);
+        SET_OPERATION(*pui32HdrWords, ARP_OP_REPLY);
+        pui32HdrWords++;
+
+        /* sender MAC address */
+        SET_HIGH_16BIT(*pui32HdrWords, ((ETHMAC_ui64MACAddress & 0x0000FFFF00000000) >> ULL_SHIFT_32));
+        SET_LOW_16BIT(*pui32HdrWords, ((ETHMAC_ui64MACAddress & 0x00000000FFFF0000) >> ULL_SHIFT_16));
+        pui32HdrWords++;
+        SET_HIGH_16BIT(*pui32HdrWords, (ETHMAC_ui64MACAddress & 0x000000000000FFFF));
+
+        /* sender protocol address */
+        SET_LOW_16BIT(*pui32HdrWords, ((ui32SrcIPAdd & 0xFFFF0000) >> UL_SHIFT_16));
+        pui32HdrWords++;
+        SET_HIGH_16BIT(*pui32HdrWords, (ui32SrcIPAdd & 0x0000FFFF));
+
+        /* target MAC address */
+        SET_LOW_16BIT(*pui32HdrWords, ((ui64DstEthAdd & 0x0000FFFF00000000) >> ULL_SHIFT_32));
+        pui32HdrWords++;
+        SET_HIGH_16BIT(*pui32HdrWords, ((ui64DstEthAdd & 0x00000000FFFF0000) >> ULL_SHIFT_16));
+        SET_LOW_16BIT(*pui32HdrWords, (ui64DstEthAdd & 0x000000000000FFFF));
+
+        pui32HdrWords++;
+        /* target protocol address */
+        SET_HIGH_16BIT(*pui32HdrWords, ((ui32DstIPAdd & 0xFFFF0000) >> UL_SHIFT_16));
+        SET_LOW_16BIT(*pui32HdrWords, (ui32DstIPAdd & 0x0000FFFF));
+
+        /* request ETH packet transmission: a single buffer always fits TX descriptors. Then release it */
+        ETHMAC_sendPbuf(pstPbuf, ETHMAC_ui64MACAddress, ui64DstEthAdd, US_ETH_TYPE_ARP);
+        PBUF_free(pstPbuf);
+    }
+    else
+    {
+        /* no free buffers: message is lost */
+    }
+}
+
+
+/* send an ARP request unless one has been sent recently for the same IP address */
+LOCAL void requestEthAdd( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd )
+{
+    uint8 ui8Index;
+    uint8 ui8FreeIndex = UC_MAX_NUM_OF_PENDING_REQ;
+
+    /* look for a recent request of the same IP address and for a free entry */
+    for(ui8Index = UC_NULL; ui8Index < UC_MAX_NUM_OF_PENDING_REQ; ui8Index++)
+    {
+        if(UC_NULL == astPendingRequests[ui8Index].ui8RetryCounter)
+        {
+            /* free entry */
+            ui8FreeIndex = ui8Index;
+        }
+        else if(astPendingRequests[ui8Index].ui32IPAdd == ui32DstIPAdd)
+        {
+            /* request sent recently */
+            break;
+        }
+        else
+        {
+            /* go on */
+        }
+    }
+
+    /* if no request has been sent recently */
+    if(UC_MAX_NUM_OF_PENDING_REQ == ui8Index)
+    {
+        /* if there is room to track the request */
+        if(ui8FreeIndex < UC_MAX_NUM_OF_PENDING_REQ)
+        {
+            astPendingRequests[ui8FreeIndex].ui32IPAdd = ui32DstIPAdd;
+            astPendingRequests[ui8FreeIndex].ui8RetryCounter = UC_REQUEST_RETRY_PERIODS;
+        }
+        else
+        {
+            /* ATTENTION: table is full - the request is not rate limited */
+        }
+
+        prepareAndSendRequest(ui32SrcIPAdd, ui32DstIPAdd);
+    }
+    else
+    {
+        /* wait for the reply or for the retry time */
+    }
 }
 
 
 /* prepare a REQUEST packet and request transmission */
 LOCAL void prepareAndSendRequest( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd )
 {
-    uint8 *pui8BufPtr;
+    PBUF_st_Buffer *pstPbuf;
     uint32 *pui32HdrWords;
 
-    /* ATTENTION: set datagram pointer (use the first one at the moment) */
-    pui8BufPtr = (uint8 *)ETHMAC_getTXBufferPointer((uint16)ARP_MESSAGE_BYTE_LENGTH);
-    /* perform a 32-bit word alignment */
-    ALIGN_32BIT_OF_8BIT_PTR(pui8BufPtr);
-
-    /* update shared buffer pointer */
-    pui32HdrWords = (uint32 *)pui8BufPtr;
-
-    /* clear the buffer */
-    memset(pui32HdrWords, UC_NULL, ARP_MESSAGE_BYTE_LENGTH);
-
-    /* prepare fields */
-    SET_HW_TYPE(*pui32HdrWords, ARP_HW_TYPE);
-    SET_PROT_TYPE(*pui32HdrWords, ARP_PROT_TYPE);
-    pui32HdrWords++;
-    SET_HW_ADD_LENGTH(*pui32HdrWords, HW_ADD_BYTE_LENGTH);
-    SET_PROT_ADD_LENGTH(*pui32HdrWords, PROT_ADD_BYTE_LENGTH);
-    SET_OPERATION(*pui32HdrWords, ARP_OP_REQUEST);
-    pui32HdrWords++;
-
-    /* sender MAC address */
-    SET_HIGH_16BIT(*pui32HdrWords, ((ETHMAC_ui64MACAddress & 0x0000FFFF00000000) >> ULL_SHIFT_32));
-    SET_LOW_16BIT(*pui32HdrWords, ((ETHMAC_ui64MACAddress & 0x00000000FFFF0000) >> ULL_SHIFT_16));
-    pui32HdrWords++;
-    SET_HIGH_16BIT(*pui32HdrWords, (ETHMAC_ui64MACAddress & 0x000000000000FFFF));
-
-    /* sender protocol address */
-    SET_LOW_16BIT(*pui32HdrWords, ((ui32SrcIPAdd & 0xFFFF0000) >> UL_SHIFT_16));
-    pui32HdrWords++;
-    SET_HIGH_16BIT(*pui32HdrWords, (ui32SrcIPAdd & 0x0000FFFF));
-
-    /* target MAC address */
-    SET_LOW_16BIT(*pui32HdrWords, ((NULL_MAC_ADDRESS & 0x0000FFFF00000000) >> ULL_SHIFT_32));
-    pui32HdrWords++;
-    SET_HIGH_16BIT(*pui32HdrWords, ((NULL_MAC_ADDRESS & 0x00000000FFFF0000) >> ULL_SHIFT_16));
-    SET_LOW_16BIT(*pui32HdrWords, (NULL_MAC_ADDRESS & 0x000000000000FFFF));
-
-    pui32HdrWords++;
-    /* target protocol address */
-    SET_HIGH_16BIT(*pui32HdrWords, ((ui32DstIPAdd & 0xFFFF0000) >> UL_SHIFT_16));
-    SET_LOW_16BIT(*pui32HdrWords, (ui32DstIPAdd & 0x0000FFFF));
-
-    /* request ETH packet transmission */
-    ETHMAC_sendPacket(pui8BufPtr, ARP_MESSAGE_BYTE_LENGTH, ETHMAC_ui64MACAddress, BROADCAST_MAC_ADDRESS, US_ETH_TYPE_ARP);
+    /* get a small packet buffer: its data are 32-bit aligned and the ethernet header is written in front of them */
+    pstPbuf = PBUF_alloc((uint16)ARP_MESSAGE_BYTE_LENGTH);
+    if(pstPbuf != NULL_PTR)
+    {
+        /* update shared buffer pointer */
+        pui32HdrWords = (uint32 *)pstPbuf->pui8Payload;
+
+        /* clear the buffer */
+        memset(pui32HdrWords, UC_NULL, ARP_MESSAGE_BYTE_LENGTH);
+
+        /* prepare fields */
+        SET_HW_TYPE(*pui32HdrWords, ARP_HW_TYPE);
+        SET_PROT_TYPE(*pui32HdrWords, ARP_PROT_TYPE);
+        pui32HdrWords++;
+        SET_HW_ADD_LENGTH(*pui32HdrWords, HW_ADD_BYTE_LENGTH);
+        SET_PROT_ADD_LENGTH(*pui32HdrWords, PROT_ADD_BYTE_LENGTH);
+        SET_OPERATION(*pui32HdrWords, ARP_OP_REQUEST);
+        pui32HdrWords++;
+
+        /* sender MAC address */
+        SET_HIGH_16BIT(*pui32HdrWords, ((ETHMAC_ui64MACAddress & 0x0000FFFF00000000) >> ULL_SHIFT_32));
+        SET_LOW_16BIT(*pui32HdrWords, ((ETHMAC_ui64MACAddress & 0x00000000FFFF0000) >> ULL_SHIFT_16));
+        pui32HdrWords++;
+        SET_HIGH_16BIT(*pui32HdrWords, (ETHMAC_ui64MACAddress & 0x000000000000FFFF));
+
+        /* sender protocol address */
+        SET_LOW_16BIT(*pui32HdrWords, ((ui32SrcIPAdd & 0xFFFF0000) >> UL_SHIFT_16));
+        pui32HdrWords++;
+        SET_HIGH_16BIT(*pui32HdrWords, (ui32SrcIPAdd & 0x0000FFFF));
+
+        /* target MAC address */
+        SET_LOW_16BIT(*pui32HdrWords, ((NULL_MAC_ADDRESS & 0x0000FFFF00000000) >> ULL_SHIFT_32));
+        pui32HdrWords++;
+        SET_HIGH_16BIT(*pui32HdrWords, ((NULL_MAC_ADDRESS & 0x00000000FFFF0000) >> ULL_SHIFT_16));
+        SET_LOW_16BIT(*pui32HdrWords, (NULL_MAC_ADDRESS & 0x000000000000FFFF));
+
+        pui32HdrWords++;
+        /* target protocol address */
+        SET_HIGH_16BIT(*pui32HdrWords, ((ui32DstIPAdd & 0xFFFF0000) >> UL_SHIFT_16));
+        SET_LOW_16BIT(*pui32HdrWords, (ui32DstIPAdd & 0x0000FFFF));
+
+        /* request ETH packet transmission: a single buffer always fits TX descriptors. Then release it */
+        ETHMAC_sendPbuf(pstPbuf, ETHMAC_ui64MACAddress, BROADCAST_MAC_ADDRESS, US_ETH_TYPE_ARP);
+        PBUF_free(pstPbuf);
+    }
+    else
+    {
+        /* no free buffers: message is lost */
+    }
 }
 
 
@@ -43,6 +43,7 @@
 EXTERN void     ARP_setRouterInfo       (uint32, uint32);
 EXTERN void     ARP_setLocalIPAddress   (uint32);
 EXTERN boolean  ARP_checkLocalIPAdd     (uint32);
+EXTERN uint32   ARP_getNextHopIPAdd     (uint32);
 EXTERN uint64   ARP_getEthAddFromIPAdd  (uint32, uint32);
 EXTERN void     ARP_setEthAddToIPAdd    (uint32, uint64);
 EXTERN void     ARP_PeriodicTask        (void);
@@ -404,7 +404,7 @@ EXPORTED void ICMP_PeriodicTask( void )
 }
 
 
-EXPORTED void ICMP_manageICMPMsg( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint8 *pui8BufPtr, uint16 ui16MsgLength )
+EXPORTED void ICMP_manageICMPMsg( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint8 *pui8BufPtr, uint16 ui16MsgLength, uint32 ui32DataSum )
 {
     uint8 *pui8MsgPtr;
     uint8 ui8Code;
@@ -413,8 +413,19 @@ EXPORTED void ICMP_manageICMPMsg( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint
     /* if the destination is one of our IP addresses */
     if(B_TRUE == IPV4_checkLocalIPAdd(ui32DstIPAdd))
     {
+        /* if message has not been summed by hardware */
+        if(IPV4_UL_NO_DATA_SUM == ui32DataSum)
+        {
+            /* sum it by software */
+            ui32DataSum = IPV4_copyAndSum(NULL_PTR, pui8BufPtr, ui16MsgLength, UL_NULL);
+        }
+        else
+        {
+            /* message sum is ready */
+        }
+
         /* if checksum is valid */
-        if(US_NULL == calculateChecksum(pui8BufPtr, ui16MsgLength))
+        if(US_NULL == IPV4_foldChecksum(ui32DataSum))
         {
             /* get CODE */
             GET_FIELD_CODE(pui8BufPtr, ui8Code);
@@ -503,12 +514,13 @@ LOCAL uint8 * prepareEchoReplyMsg( st_PendingEchoReply *pstPendEchoReply )
     IPv4_st_PacketDescriptor stIPv4PacketDscpt;
     uint16 ui16Checksum;
     uint8 *pui8MsgPtr = NULL_PTR;
+    PBUF_st_Buffer *pstPbuf;
 
-    /* get IPV4 buffer data pointer */
-    pui8MsgPtr = IPV4_getDataBuffPtr();
-    if(pui8MsgPtr != NULL_PTR)
+    /* get a packet buffer for the message */
+    pstPbuf = PBUF_alloc(pstPendEchoReply->ui16MsgLength);
+    if(pstPbuf != NULL_PTR)
     {
-        ALIGN_32BIT_OF_8BIT_PTR(pui8MsgPtr);
+        pui8MsgPtr = pstPbuf->pui8Payload;
         /* copy the entire REQUEST message as REPLY message (same identifier, seq num and data) */
         MEM_COPY(pui8MsgPtr,
                  (uint8 *)pstPendEchoReply->aui8ReqMsgCpy,
@@ -524,12 +536,13 @@ LOCAL uint8 * prepareEchoReplyMsg( st_PendingEchoReply *pstPendEchoReply )
         /* set IPv4 descriptor */
         stIPv4PacketDscpt.enProtocol = IPV4_PROT_ICMP;
         stIPv4PacketDscpt.bDoNotFragment = B_FALSE; /* ATTENTION: this value can change according to application request */
+        stIPv4PacketDscpt.ui8Ecn = IPV4_UC_ECN_NOT_ECT;
         stIPv4PacketDscpt.ui16DataLength = pstPendEchoReply->ui16MsgLength;
         stIPv4PacketDscpt.ui32IPDstAddress = pstPendEchoReply->ui32SrcIPAdd;
         stIPv4PacketDscpt.ui32IPSrcAddress = pstPendEchoReply->ui32DstIPAdd;
 
-        /* send ICMP packet through IP */
-        unIPOpResult = IPV4_SendPacket(stIPv4PacketDscpt);
+        /* send ICMP packet through IP. IP layer releases the buffer */
+        unIPOpResult = IPV4_SendPbuf(stIPv4PacketDscpt, pstPbuf);
 
         /* check IP operation result */
         if(unIPOpResult != IPV4_OP_OK)
@@ -553,12 +566,13 @@ LOCAL uint8 * prepareEchoRequestMsg( st_PendingEchoReq * pstPendEchoReq )
     IPv4_st_PacketDescriptor stIPv4PacketDscpt;
     uint16 ui16Checksum;
     uint8 *pui8MsgPtr = NULL_PTR;
+    PBUF_st_Buffer *pstPbuf;
 
-    /* get IPV4 buffer data pointer */
-    pui8MsgPtr = IPV4_getDataBuffPtr();
-    if(pui8MsgPtr != NULL_PTR)
+    /* get a packet buffer for the message */
+    pstPbuf = PBUF_alloc(pstPendEchoReq->ui16MsgLength);
+    if(pstPbuf != NULL_PTR)
     {
-        ALIGN_32BIT_OF_8BIT_PTR(pui8MsgPtr);
+        pui8MsgPtr = pstPbuf->pui8Payload;
 
         /* set echo type as REPLY */
         SET_FIELD_TYPE(pui8MsgPtr, UC_TYPE_ECHO_REQ);
@@ -587,12 +601,13 @@ LOCAL uint8 * prepareEchoRequestMsg( st_PendingEchoReq * pstPendEchoReq )
         /* set IPv4 descriptor */
         stIPv4PacketDscpt.enProtocol = IPV4_PROT_ICMP;
         stIPv4PacketDscpt.bDoNotFragment = B_FALSE; /* ATTENTION: this value can change according to application request */
+        stIPv4PacketDscpt.ui8Ecn = IPV4_UC_ECN_NOT_ECT;
         stIPv4PacketDscpt.ui16DataLength = pstPendEchoReq->ui16MsgLength;
         stIPv4PacketDscpt.ui32IPDstAddress = pstPendEchoReq->ui32DstIPAdd;
         stIPv4PacketDscpt.ui32IPSrcAddress = pstPendEchoReq->ui32SrcIPAdd;
 
-        /* send ICMP packet through IP */
-        unIPOpResult = IPV4_SendPacket(stIPv4PacketDscpt);
+        /* send ICMP packet through IP. IP layer releases the buffer */
+        unIPOpResult = IPV4_SendPbuf(stIPv4PacketDscpt, pstPbuf);
 
         /* check IP operation result */
         if(unIPOpResult != IPV4_OP_OK)
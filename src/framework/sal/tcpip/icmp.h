@@ -61,7 +61,7 @@ EXTERN ICMP_st_EchoResult   ICMP_getEchoReqResult   (uint32, uint32);
 EXTERN void                 ICMP_StopEchoRequest    (uint32, uint32);
 EXTERN boolean              ICMP_StartEchoRequest   (uint32, uint32);
 EXTERN void                 ICMP_PeriodicTask       (void);
-EXTERN void                 ICMP_manageICMPMsg      (uint32, uint32, uint8 *, uint16);
+EXTERN void                 ICMP_manageICMPMsg      (uint32, uint32, uint8 *, uint16, uint32);
 
 
 
@@ -38,6 +38,7 @@
 #include "ipv4.h"
 #include "../../hal/ethmac.h"
 #include "arp.h"
+#include "../rtos/rtos.h"
 #include "icmp.h"
 #include "udp.h"
 #include "tcp.h"
@@ -46,9 +47,8 @@
 /* 
 TODO LIST:
     1)  call ARP module to update ETH/IP addresses table. See manageReceivedPacket() function
-    2)  set a proper value to ui8Dscp, ui8Dscp and ui8TimeToLive. See sendPendingIPv4Packet() function and GET_TIME_TO_LIVE() macro
-    3)  ensure avoid data corruption of pui8DataBufferPtr: now it depends by IPV4_getDataBuffPtr() function
-    4)  avoid to send data or return data pointer if module has been deinitialised. Refer to IPV4_Deinit function
+    2)  set a proper value to ui8Dscp and ui8TimeToLive. See sendPendingIPv4Packet() function and GET_TIME_TO_LIVE() macro
+    3)  avoid to send data or return data pointer if module has been deinitialised. Refer to IPV4_Deinit function
 */
 
 
@@ -82,8 +82,6 @@ TODO LIST:
 /* IPv4 maximum options length in bytes */
 #define IPV4_HDR_OPT_MAX_BYTE_LENGTH    (40)
 
-/* Max allowed data length in bytes to transmit (fragmentation) */
-#define IPV4_US_MAX_TRANS_UNIT          ((uint16)IPV4_US_FRAG_MAX_LENGTH)
 
 /* Num of octects for each NFB */
 #define IPV4_UC_OCTECTS_EACH_NFB        ((uint8)8)      /* 8 octects */
@@ -98,6 +96,25 @@ TODO LIST:
 /* End of options list byte value */
 #define UC_END_OF_OPTIONS_LIST          ((uint8)0x00)
 
+/* Number of reassembly slots */
+#define UC_REASM_SLOTS_NUM              ((uint8)IPV4_UC_REASM_SLOTS_NUM)
+
+/* Reassembly buffer length of each slot */
+#define US_REASM_BUFFER_LENGTH          ((uint16)IPV4_US_REASM_MAX_LENGTH)
+
+/* Reassembly timeout in task periods */
+#define US_REASM_TIMEOUT_COUNTER        ((uint16)(IPV4_UL_REASM_TIMEOUT_MS / RTOS_UL_TASKS_PERIOD_MS))
+
+/* Hole descriptors values: end of holes list and last byte of a hole with no end */
+#define US_NO_HOLE                      ((uint16)0xFFFF)
+#define US_HOLE_INFINITY                ((uint16)0xFFFF)
+
+/* Number of TX queue entries */
+#define UC_TX_QUEUE_LENGTH              ((uint8)IPV4_UC_TX_QUEUE_LENGTH)
+
+/* Next hop resolution timeout in task periods */
+#define US_ARP_TIMEOUT_COUNTER          ((uint16)(IPV4_UL_ARP_TIMEOUT_MS / RTOS_UL_TASKS_PERIOD_MS))
+
 
 
 
@@ -184,45 +201,70 @@ typedef struct
 } st_HeaderParams;
 
 
-/* RX pending fragmentation data struct */
+/* RX pending fragmentation data struct: a reassembly slot */
 typedef struct
 {
     uint16 ui16Identif;
     uint32 ui32SrcIPAdd;
     uint32 ui32DstIPAdd;
     uint8 ui8Protocol;
+    uint8 ui8Ecn;
     uint8 aui8OptionsPtr[IPV4_HDR_OPT_MAX_BYTE_LENGTH];
     uint8 ui8OptLength;
     boolean bOptReady;
-    boolean bFragPending;
+    uint8 *pui8DataBuffPtr;         /* reassembly buffer. Hole descriptors are stored in the holes themselves (RFC 815) */
+    uint16 ui16FirstHoleOffset;     /* offset of the first hole descriptor. US_NO_HOLE when datagram is complete */
+    uint16 ui16DataLength;          /* datagram data length. Known once the last fragment is received */
+    uint16 ui16TimeoutCounter;      /* remaining task periods before discarding the datagram */
+    boolean bInUse;
 } st_PendingFrag;
 
 
+/* hole descriptor (RFC 815). ATTENTION: it is written at the first byte of the hole, holes are 8 bytes long at least */
+typedef struct
+{
+    uint16 ui16First;               /* first byte offset */
+    uint16 ui16Last;                /* last byte offset. US_HOLE_INFINITY for the hole after the last received fragment */
+    uint16 ui16Next;                /* offset of the next hole descriptor. US_NO_HOLE for the last one */
+} st_HoleDscpt;
 
 
-/* ------------------- Local variables declaration ------------------- */
+/* TX queue entry: a datagram waiting to be sent */
+typedef struct
+{
+    IPv4_st_PacketDescriptor stPacketDscpt;
+    PBUF_st_Buffer *pstPbuf;        /* datagram data chain. Its reference is owned by the entry */
+    uint32 ui32NextHopIPAdd;        /* IP address whose ETH address is needed to send the datagram */
+    uint16 ui16TimeoutCounter;      /* remaining task periods before discarding the datagram if next hop is not resolved */
+    boolean bInUse;
+} st_TXQueueEntry;
+
 
-/* TX data buffer pointer where upper layers write data */
-LOCAL uint8 *pui8TXDataBuffPtr;
 
-/* RX data buffer pointer used for fragmented packets */
-LOCAL uint8 *pui8RXDataBuffPtr;
 
-/* store pending packet to send */
-LOCAL IPv4_st_PacketDescriptor stPendingIPv4Packet;
+/* ------------------- Local variables declaration ------------------- */
+
+/* TX queue entries, each one with its own data buffer */
+LOCAL st_TXQueueEntry astTXQueue[UC_TX_QUEUE_LENGTH];
+
+/* indexes of queued entries in order of request */
+LOCAL uint8 aui8TXQueueOrder[UC_TX_QUEUE_LENGTH];
 
-/* signal a message ready to be sent */
-LOCAL boolean bPendingPacket = B_FALSE;
+/* number of queued entries */
+LOCAL uint8 ui8TXQueuedNum = UC_NULL;
 
 /* counter of identifier field. Incremented at every packet send */
 LOCAL uint16 ui16IdentifCounter = 0x0500;
 
-/* RX pending fragmentation data struct */
-LOCAL st_PendingFrag stRXPendingFrag;
+/* reassembly slots of fragmented datagrams */
+LOCAL st_PendingFrag astRXPendingFrag[UC_REASM_SLOTS_NUM];
 
 /* IP address obtained via DHCP. Init as 0.0.0.0 */
 LOCAL uint32 ui32ObtainedIPAdd = UL_NULL;
 
+/* Max allowed datagram length in bytes to transmit (fragmentation) */
+LOCAL uint16 ui16Mtu = IPV4_US_FRAG_MAX_LENGTH;
+
 
 
 
@@ -230,9 +272,17 @@ LOCAL uint32 ui32ObtainedIPAdd = UL_NULL;
 
 LOCAL void      manageReceivedPacket    (void);
 LOCAL void      manageReceivedOptions   (uint8 *, uint8);
-LOCAL void      sendPendingIPv4Packet   (IPv4_st_PacketDescriptor *);
+LOCAL st_PendingFrag * getReassemblySlot (uint32, uint32, uint16, uint8);
+LOCAL boolean   addFragment             (st_PendingFrag *, uint16, uint8 *, uint16, boolean);
+LOCAL void      manageReassemblyTimeouts(void);
+LOCAL void      sendQueuedPackets       (void);
+LOCAL void      removeTXQueueEntry      (uint8);
+LOCAL st_TXQueueEntry * getFreeTXQueueEntry (void);
+LOCAL void      sendPendingIPv4Packet   (st_TXQueueEntry *);
+LOCAL boolean   attachDataSlices        (PBUF_st_Buffer *, PBUF_st_Buffer *, uint16, uint16);
 LOCAL void      prepareIPv4Header       (uint8 *, st_HeaderParams *, st_HeaderOptions *);
-LOCAL void      decodeIPv4Packet        (uint8 *);
+LOCAL void      decodeIPv4Packet        (uint8 *, uint32, uint16, uint16);
+LOCAL uint32    getRXDataSum            (uint8 *, uint16, uint32, uint16);
 LOCAL uint16    calcHeaderChecksum      (uint8 *, uint8);
 
 
@@ -266,26 +316,67 @@ EXPORTED void IPV4_setRouterInfo( uint32 ui32RouterIPAdd, uint32 ui32SubnetMask
 }
 
 
+/* set the interface MTU. It is limited between minimum accepted datagram length and the build time MTU buffers are sized on */
+EXPORTED void IPV4_setMtu( uint16 ui16NewMtu )
+{
+    if(ui16NewMtu > IPV4_US_FRAG_MAX_LENGTH)
+    {
+        ui16Mtu = IPV4_US_FRAG_MAX_LENGTH;
+    }
+    else if(ui16NewMtu < IPV4_US_ACCEPTED_MIN_LENGTH)
+    {
+        ui16Mtu = IPV4_US_ACCEPTED_MIN_LENGTH;
+    }
+    else
+    {
+        /* value is valid */
+        ui16Mtu = ui16NewMtu;
+    }
+}
+
+
+/* get the interface MTU */
+EXPORTED uint16 IPV4_getMtu( void )
+{
+    return ui16Mtu;
+}
+
+
 /* Init IPv4 module */
 EXPORTED boolean IPV4_Init( void )
 {
     boolean bInitSuccess;
+    uint8 ui8Index;
+
+    /* init success so far */
+    bInitSuccess = B_TRUE;
 
-    /* allocate TX data buffer */
-    pui8TXDataBuffPtr = (uint8 *)MEM_MALLOC(IPV4_US_ACCEPTED_MIN_LENGTH);
-    /* allocate RX data buffer */
-    pui8RXDataBuffPtr = (uint8 *)MEM_MALLOC(IPV4_US_ACCEPTED_MIN_LENGTH);
-    /* if both pointers are valid */
-    if((pui8TXDataBuffPtr != NULL_PTR) && (pui8RXDataBuffPtr != NULL_PTR))
+    /* allocate a RX data buffer for each reassembly slot. All slots are free */
+    for(ui8Index = UC_NULL; ui8Index < UC_REASM_SLOTS_NUM; ui8Index++)
     {
-        /* init success */
-        bInitSuccess = B_TRUE;
+        astRXPendingFrag[ui8Index].pui8DataBuffPtr = (uint8 *)MEM_MALLOC(US_REASM_BUFFER_LENGTH);
+        astRXPendingFrag[ui8Index].bInUse = B_FALSE;
+        if(NULL_PTR == astRXPendingFrag[ui8Index].pui8DataBuffPtr)
+        {
+            /* init fail */
+            bInitSuccess = B_FALSE;
+        }
+        else
+        {
+            /* go on */
+        }
     }
-    else
+
+    /* all TX queue entries are free */
+    for(ui8Index = UC_NULL; ui8Index < UC_TX_QUEUE_LENGTH; ui8Index++)
     {
-        /* init fail */
-        bInitSuccess = B_FALSE;
+        astTXQueue[ui8Index].pstPbuf = NULL_PTR;
+        astTXQueue[ui8Index].bInUse = B_FALSE;
     }
+    ui8TXQueuedNum = UC_NULL;
+
+    /* all packet buffers are free */
+    PBUF_Init();
 
     return bInitSuccess;
 }
@@ -294,30 +385,29 @@ EXPORTED boolean IPV4_Init( void )
 /* De-init IPv4 module */
 EXPORTED void IPV4_Deinit( void )
 {
-    /* free TX data buffer */
-    MEM_FREE(pui8TXDataBuffPtr);
-    /* free RX data buffer */
-    MEM_FREE(pui8RXDataBuffPtr);
-}
-
+    uint8 ui8Index;
 
-/* Function to get data pointer */
-EXPORTED uint8 * IPV4_getDataBuffPtr( void )
-{
-    uint8 *pui8RetPtr;
-
-    /* If a previous packet is pending then return NULL */
-    /* The reason is to avoid data buffer corruption  */
-    if(B_TRUE == bPendingPacket)
+    /* release data of queued datagrams */
+    for(ui8Index = UC_NULL; ui8Index < UC_TX_QUEUE_LENGTH; ui8Index++)
     {
-        pui8RetPtr = NULL;
+        if(B_TRUE == astTXQueue[ui8Index].bInUse)
+        {
+            PBUF_free(astTXQueue[ui8Index].pstPbuf);
+            astTXQueue[ui8Index].pstPbuf = NULL_PTR;
+            astTXQueue[ui8Index].bInUse = B_FALSE;
+        }
+        else
+        {
+            /* entry is free */
+        }
     }
-    else
+    ui8TXQueuedNum = UC_NULL;
+    /* free RX data buffers */
+    for(ui8Index = UC_NULL; ui8Index < UC_REASM_SLOTS_NUM; ui8Index++)
     {
-        pui8RetPtr = pui8TXDataBuffPtr;
+        MEM_FREE(astRXPendingFrag[ui8Index].pui8DataBuffPtr);
+        astRXPendingFrag[ui8Index].bInUse = B_FALSE;
     }
-
-    return pui8RetPtr;
 }
 
 
@@ -331,65 +421,55 @@ EXPORTED boolean IPV4_checkLocalIPAdd( uint32 ui32IPAddress )
 /* Periodic task. Send pending TX packets and unpack received packets */
 EXPORTED void IPV4_PeriodicTask( void )
 {
-    uint64 ui64DstEthAdd;
-
     /* manage eventual received packets */
     manageReceivedPacket();
 
-    /* if a packet is ready to be sent */
-    if(B_TRUE == bPendingPacket)
-    {
-        /* update local IP addresses table */
-        ARP_setLocalIPAddress(stPendingIPv4Packet.ui32IPSrcAddress);
-        /* get ETH address from ARP module */
-        ui64DstEthAdd = ARP_getEthAddFromIPAdd(stPendingIPv4Packet.ui32IPSrcAddress, stPendingIPv4Packet.ui32IPDstAddress);
-//        ui64DstEthAdd = 0x000000262d904b96;
-
-        if(ui64DstEthAdd != ULL_NULL)
-        {
-            /* update dst ETH address */
-            stPendingIPv4Packet.ui64DstEthAdd = ui64DstEthAdd;
+    /* discard datagrams whose fragments have not been received in time */
+    manageReassemblyTimeouts();
 
-            /* prepare and send a packet */
-            sendPendingIPv4Packet(&stPendingIPv4Packet);
-
-            /* clear signal flag */
-            bPendingPacket = B_FALSE;
-        }
-        else
-        {
-            /* ETH address was unknown, an ARP request has been sent. Try at next run */
-        }
-    }
-    else
-    {
-        /* do nothing */
-    }
+    /* send queued packets whose next hop is resolved */
+    sendQueuedPackets();
 }
 
 
-/* Function to require a packet transmission from upper layers */
-EXPORTED IPV4_keOpResult IPV4_SendPacket(IPv4_st_PacketDescriptor stPacketDescriptor)
+/* Function to require a packet transmission from upper layers. Data length in descriptor is taken from the buffer chain.
+   The chain reference is given to IPv4 layer: it is released once the packet is sent or on failure.
+   ATTENTION: referenced data shall not change until the packet is sent. Packets are sent by IPV4_PeriodicTask() once their next hop is resolved */
+EXPORTED IPV4_keOpResult IPV4_SendPbuf(IPv4_st_PacketDescriptor stPacketDescriptor, PBUF_st_Buffer *pstPbuf)
 {
     IPV4_keOpResult unOpResult;
+    st_TXQueueEntry *pstEntry;
+
+    /* get a free entry */
+    pstEntry = getFreeTXQueueEntry();
 
-    /* check data length */
-    if((stPacketDescriptor.ui16DataLength <= IPV4_US_MAX_DATAGRAM_LENGTH)
+    /* check queue space and data length */
+    if((pstEntry != NULL_PTR)
+    && (pstPbuf->ui16TotLength <= IPV4_US_MAX_DATAGRAM_LENGTH)
     && (stPacketDescriptor.enProtocol < IPV4_PROT_CHECK_VALUE))
     {
         /* copy requested packet to send */
-        stPendingIPv4Packet = stPacketDescriptor;
-        /* clear destination ethernet address */
-//        stPendingIPv4Packet.ui64DstEthAdd = ULL_NULL;
-
-        /* set pending packet flag */
-        bPendingPacket = B_TRUE;
+        pstEntry->stPacketDscpt = stPacketDescriptor;
+        pstEntry->stPacketDscpt.ui16DataLength = pstPbuf->ui16TotLength;
+        /* take data chain reference */
+        pstEntry->pstPbuf = pstPbuf;
+        /* park it on its next hop */
+        pstEntry->ui32NextHopIPAdd = ARP_getNextHopIPAdd(stPacketDescriptor.ui32IPDstAddress);
+        pstEntry->ui16TimeoutCounter = US_ARP_TIMEOUT_COUNTER;
+
+        /* queue the entry */
+        pstEntry->bInUse = B_TRUE;
+        aui8TXQueueOrder[ui8TXQueuedNum] = (uint8)(pstEntry - astTXQueue);
+        ui8TXQueuedNum++;
 
         /* success */
         unOpResult = IPV4_OP_OK;
     }
     else
     {
+        /* release data chain */
+        PBUF_free(pstPbuf);
+
         /* fail */
         unOpResult = IPV4_OP_FAIL;
     }
@@ -398,6 +478,120 @@ EXPORTED IPV4_keOpResult IPV4_SendPacket(IPv4_st_PacketDescriptor stPacketDescri
 }
 
 
+/* Function to discard queued datagrams referencing data of an owner that is giving them back. Owner is identified by its hold counter */
+EXPORTED void IPV4_discardPbufs( uint8 *pui8HoldCounter )
+{
+    uint8 ui8QueuePos = UC_NULL;
+    PBUF_st_Buffer *pstPbuf;
+
+    while(ui8QueuePos < ui8TXQueuedNum)
+    {
+        /* look for a buffer of the datagram chain referencing owner data */
+        pstPbuf = astTXQueue[aui8TXQueueOrder[ui8QueuePos]].pstPbuf;
+        while((pstPbuf != NULL_PTR)
+        && (pstPbuf->pui8HoldCounter != pui8HoldCounter))
+        {
+            pstPbuf = pstPbuf->pstNext;
+        }
+
+        if(pstPbuf != NULL_PTR)
+        {
+            /* discard the datagram: the next one is now at the same position */
+            removeTXQueueEntry(ui8QueuePos);
+        }
+        else
+        {
+            /* datagram does not reference owner data */
+            ui8QueuePos++;
+        }
+    }
+}
+
+
+/* Function to get the ones' complement sum of the pseudo header of an upper layer packet */
+EXPORTED uint32 IPV4_getPseudoHdrSum( IPv4_st_PacketDescriptor *pstPacketDscpt )
+{
+    uint32 ui32Sum;
+
+    /* sum addresses as 16-bit words */
+    ui32Sum  = ((pstPacketDscpt->ui32IPSrcAddress >> UL_SHIFT_16) & 0xFFFF);
+    ui32Sum += (pstPacketDscpt->ui32IPSrcAddress & 0xFFFF);
+    ui32Sum += ((pstPacketDscpt->ui32IPDstAddress >> UL_SHIFT_16) & 0xFFFF);
+    ui32Sum += (pstPacketDscpt->ui32IPDstAddress & 0xFFFF);
+
+    /* sum protocol and upper layer packet length */
+    ui32Sum += (uint32)pstPacketDscpt->enProtocol;
+    ui32Sum += (uint32)pstPacketDscpt->ui16DataLength;
+
+    return ui32Sum;
+}
+
+
+/* Function to copy a data buffer while adding it to a ones' complement sum. If destination is NULL data are summed only.
+   ATTENTION: when summing a packet in several calls, all data lengths but the last one shall be even */
+EXPORTED uint32 IPV4_copyAndSum( uint8 *pui8DstPtr, uint8 *pui8SrcPtr, uint16 ui16Length, uint32 ui32Sum )
+{
+    /* if data shall be copied */
+    if(pui8DstPtr != NULL_PTR)
+    {
+        /* copy and sum data as big endian 16-bit words */
+        while(ui16Length > UC_1)
+        {
+            pui8DstPtr[0] = pui8SrcPtr[0];
+            pui8DstPtr[1] = pui8SrcPtr[1];
+            ui32Sum += (((uint32)pui8SrcPtr[0] << UL_SHIFT_8) | (uint32)pui8SrcPtr[1]);
+            pui8DstPtr += 2;
+            pui8SrcPtr += 2;
+            ui16Length -= 2;
+        }
+        /* copy and sum last odd byte padded with zero */
+        if(ui16Length > US_NULL)
+        {
+            pui8DstPtr[0] = pui8SrcPtr[0];
+            ui32Sum += ((uint32)pui8SrcPtr[0] << UL_SHIFT_8);
+        }
+        else
+        {
+            /* even length */
+        }
+    }
+    else
+    {
+        /* sum data as big endian 16-bit words */
+        while(ui16Length > UC_1)
+        {
+            ui32Sum += (((uint32)pui8SrcPtr[0] << UL_SHIFT_8) | (uint32)pui8SrcPtr[1]);
+            pui8SrcPtr += 2;
+            ui16Length -= 2;
+        }
+        /* sum last odd byte padded with zero */
+        if(ui16Length > US_NULL)
+        {
+            ui32Sum += ((uint32)pui8SrcPtr[0] << UL_SHIFT_8);
+        }
+        else
+        {
+            /* even length */
+        }
+    }
+
+    return ui32Sum;
+}
+
+
+/* Function to get the checksum from a ones' complement sum. A received packet is valid if this is 0 */
+EXPORTED uint16 IPV4_foldChecksum( uint32 ui32Sum )
+{
+    /* Fold 32-bit sum to 16 bits: add carrier to result */
+    while( ui32Sum >> UL_SHIFT_16 )
+    {
+        ui32Sum = (ui32Sum & 0xFFFF) + (ui32Sum >> UL_SHIFT_16);
+    }
+
+    return (uint16)(~ui32Sum);
+}
+
+
 
 
 /* ---------------- Local functions declaration ------------------- */
@@ -409,6 +603,9 @@ LOCAL void manageReceivedPacket( void )
     uint16 ui16EthType = US_NULL;
     uint32 ui32SrcIPAdd = UL_NULL;
     uint64 ui64EthAddress = ULL_NULL;
+    uint32 ui32FrameSum;
+    uint16 ui16SumLength;
+    uint16 ui16RXLength;
 
     /* get first buffer pointer */
     pui8BufPtr = ETHMAC_getNextRXDataBuffer();
@@ -440,8 +637,22 @@ LOCAL void manageReceivedPacket( void )
                 /* call ARP module to update ETH/IP addresses table */
                 ARP_setEthAddToIPAdd(ui32SrcIPAdd, ui64EthAddress);
         
+                /* get hardware sum of the frame, if any */
+                if(B_FALSE == ETHMAC_getRXChecksum(&ui32FrameSum, &ui16SumLength))
+                {
+                    /* data will be summed by software */
+                    ui32FrameSum = IPV4_UL_NO_DATA_SUM;
+                    ui16SumLength = US_NULL;
+                }
+                else
+                {
+                    /* frame has been summed by hardware */
+                }
+                /* get received length: the datagram shall fit in it */
+                ui16RXLength = ETHMAC_getRXDataLength();
+
                 /* signal to IP layer that watermark has been reached */
-                decodeIPv4Packet((uint8 *)(pui8BufPtr + UC_ETH_TYPE_LENGTH));
+                decodeIPv4Packet((uint8 *)(pui8BufPtr + UC_ETH_TYPE_LENGTH), ui32FrameSum, ui16SumLength, ui16RXLength);
 
                 break;
             }
@@ -463,11 +674,12 @@ LOCAL void manageReceivedPacket( void )
 
 
 /* decode received frame and call related upper layer */
-LOCAL void decodeIPv4Packet(uint8 *pui8FramePtr)
+LOCAL void decodeIPv4Packet(uint8 *pui8FramePtr, uint32 ui32FrameSum, uint16 ui16SumLength, uint16 ui16RXLength)
 {
     uint32 ui32HdrLength;
     uint32 ui32TotLength;
     uint8 ui8Protocol;
+    uint8 ui8Ecn;
     uint8 ui8Flags;
     uint16 ui16Identif;
     uint16 ui16FragOffset;
@@ -479,6 +691,10 @@ LOCAL void decodeIPv4Packet(uint8 *pui8FramePtr)
     uint8 *pui8DataPtr;
     uint8 *pui8OptionsPtr;
     uint8 ui8OptLength;
+    uint16 ui16DataLength;
+    uint32 ui32DataSum;
+    st_PendingFrag *pstFrag;
+    boolean bMoreFrags;
     boolean bOptReady = B_FALSE;
     boolean bSendDataUp = B_FALSE;
 
@@ -489,7 +705,7 @@ LOCAL void decodeIPv4Packet(uint8 *pui8FramePtr)
     /* ATTENTION: ui32HdrLength field is in 32-bit words */
     ui32HdrLength = GET_HDR_IHL(ui32HdrWord);
 //    GET_HDR_DSCP(ui32HdrWord);
-//    GET_HDR_ECN(ui32HdrWord);
+    ui8Ecn = GET_HDR_ECN(ui32HdrWord);
     ui32TotLength = GET_HDR_TOT_LENGTH(ui32HdrWord);
     READ_32BIT_AND_NEXT(pui32HeaderPtr, ui32HdrWord);
     ui8Flags = GET_HDR_FLAGS(ui32HdrWord);
@@ -504,46 +720,95 @@ LOCAL void decodeIPv4Packet(uint8 *pui8FramePtr)
     READ_32BIT_AND_NEXT(pui32HeaderPtr, ui32HdrWord);
     ui32DstIPAdd = GET_HDR_DST_ADD(ui32HdrWord);
 
-    /* if checksum is valid */
-    if(US_NULL == calcHeaderChecksum((uint8 *)pui8FramePtr, (ui32HdrLength * UC_4)))
+    /* if header is shorter than the minimum, total length does not cover it or datagram goes beyond the received frame */
+    if((ui32HdrLength < IPV4_HEADER_MIN_LENGTH)
+    || (ui32TotLength < (ui32HdrLength * UC_4))
+    || (ui32TotLength > (uint32)ui16RXLength))
+    {
+        /* malformed or truncated packet: discard it before any sum or copy */
+    }
+    /* else if checksum is valid */
+    else if(US_NULL == calcHeaderChecksum((uint8 *)pui8FramePtr, (ui32HdrLength * UC_4)))
     {
-        /* if there is a pending fragmented packet */
-        if(B_TRUE == stRXPendingFrag.bFragPending)
+        /* get data length */
+        ui16DataLength = (uint16)(ui32TotLength - (ui32HdrLength * UC_4));
+
+        /* if it is a fragment: more fragments follow or it is not the first one */
+        if(((ui8Flags & IPV4_MORE_FRAG_FLAGS) != 0)
+        || (ui16FragOffset != US_NULL))
         {
-            /* check if it is a fragment */
-            if((stRXPendingFrag.ui32DstIPAdd == ui32DstIPAdd)
-            && (stRXPendingFrag.ui32SrcIPAdd == ui32SrcIPAdd)
-            && (stRXPendingFrag.ui16Identif == ui16Identif)
-            && (stRXPendingFrag.ui8Protocol == ui8Protocol))
+            /* get the reassembly slot of its datagram */
+            pstFrag = getReassemblySlot(ui32SrcIPAdd, ui32DstIPAdd, ui16Identif, ui8Protocol);
+
+            /* a congestion experienced mark on any fragment applies to the whole packet (RFC 3168) */
+            if(IPV4_UC_ECN_CE == ui8Ecn)
+            {
+                pstFrag->ui8Ecn = IPV4_UC_ECN_CE;
+            }
+            else
+            {
+                /* keep first received fragment codepoint */
+            }
+
+            /* if it is the first fragment and options are present */
+            if((ui16FragOffset == US_NULL)
+            && (ui32HdrLength > IPV4_HEADER_MIN_LENGTH))
             {
-                /* copy data in RX buffer according to frag offset - discard eventual copied options */
-                MEM_COPY(((uint8 *)(pui8RXDataBuffPtr + (ui16FragOffset * IPV4_UC_OCTECTS_EACH_NFB))),
-                         ((uint32 *)(pui8FramePtr + (ui32HdrLength * UC_4))),
-                         (ui32TotLength - (ui32HdrLength * UC_4)));
+                /* update options length */
+                pstFrag->ui8OptLength = ((ui32HdrLength - IPV4_HEADER_MIN_LENGTH) * UC_4);
 
-                /* if it is the last fragment */
-                if((ui8Flags & IPV4_MORE_FRAG_FLAGS) == 0)
+                /* copy options to manage later */
+                MEM_COPY(pstFrag->aui8OptionsPtr,
+                       (uint8 *)(pui8FramePtr + IPV4_HEADER_MIN_BYTE_LENGTH),
+                       pstFrag->ui8OptLength);
+
+                /* options are valid and are pending to be managed */
+                pstFrag->bOptReady = B_TRUE;
+            }
+            else
+            {
+                /* options of the first fragment only are considered */
+            }
+
+            /* check if more fragments follow */
+            if((ui8Flags & IPV4_MORE_FRAG_FLAGS) != 0)
+            {
+                bMoreFrags = B_TRUE;
+            }
+            else
+            {
+                /* it is the last fragment */
+                bMoreFrags = B_FALSE;
+            }
+
+            /* fill holes covered by the fragment */
+            if(B_TRUE == addFragment(pstFrag,
+                                     (uint16)(ui16FragOffset * IPV4_UC_OCTECTS_EACH_NFB),
+                                     (uint8 *)(pui8FramePtr + (ui32HdrLength * UC_4)),
+                                     ui16DataLength,
+                                     bMoreFrags))
+            {
+                /* if no holes are left */
+                if(US_NO_HOLE == pstFrag->ui16FirstHoleOffset)
                 {
-                    /* update options length. it depends by bOptReady flag, do it anyway */
-                    ui8OptLength = stRXPendingFrag.ui8OptLength;
-                    /* update options pointer. it depends by bOptReady flag, do it anyway */
-                    pui8OptionsPtr = stRXPendingFrag.aui8OptionsPtr;
-                    /* update option ready flag */
-                    bOptReady = stRXPendingFrag.bOptReady;
-                    /* update protocol field */
-                    ui8Protocol = stRXPendingFrag.ui8Protocol;
-                    /* set src IP address */
-                    ui32SrcIPAdd = stRXPendingFrag.ui32SrcIPAdd;
-                    /* set dst IP address */
-                    ui32DstIPAdd = stRXPendingFrag.ui32DstIPAdd;
-                    /* set data pointer */
-                    pui8DataPtr = (uint8 *)pui8RXDataBuffPtr;
+                    /* update options fields */
+                    ui8OptLength = pstFrag->ui8OptLength;
+                    pui8OptionsPtr = pstFrag->aui8OptionsPtr;
+                    bOptReady = pstFrag->bOptReady;
+                    /* update ECN field */
+                    ui8Ecn = pstFrag->ui8Ecn;
+                    /* ui8Protocol, ui32SrcIPAdd and ui32DstIPAdd fields are the datagram ones */
+                    /* data are in place in the reassembly buffer: no further copy */
+                    pui8DataPtr = pstFrag->pui8DataBuffPtr;
+                    ui16DataLength = pstFrag->ui16DataLength;
+                    /* reassembled data have not been summed by hardware */
+                    ui32DataSum = IPV4_UL_NO_DATA_SUM;
 
                     /* packet re-assembled: manage data */
                     bSendDataUp = B_TRUE;
-					
-					/* reset flag */
-					stRXPendingFrag.bFragPending = B_FALSE;
+
+                    /* release the slot. ATTENTION: its buffer is not reused until upper layers have returned */
+                    pstFrag->bInUse = B_FALSE;
                 }
                 else
                 {
@@ -552,76 +817,39 @@ LOCAL void decodeIPv4Packet(uint8 *pui8FramePtr)
             }
             else
             {
-                /* ATTENTION: other fragments than expected ones are discarded! */
+                /* invalid fragment or datagram too long: discard the whole datagram */
+                pstFrag->bInUse = B_FALSE;
             }
         }
-        else    /* no pending fragmented packet */
+        else
         {
-            /* if there are more fragments and this is the first one */
-            if(((ui8Flags & IPV4_MORE_FRAG_FLAGS) == 1)
-            && (ui16FragOffset == US_NULL))
-            {
-                /* copy all fragmentation related fields */
-                stRXPendingFrag.ui32DstIPAdd = ui32DstIPAdd;
-                stRXPendingFrag.ui32SrcIPAdd = ui32SrcIPAdd;
-                stRXPendingFrag.ui16Identif = ui16Identif;
-                stRXPendingFrag.ui8Protocol = ui8Protocol;
-
-                /* copy data in RX buffer according to frag offset - discard eventual copied options */
-                MEM_COPY((uint8 *)pui8RXDataBuffPtr,
-                         ((uint32 *)(pui8FramePtr + (ui32HdrLength * UC_4))),
-                         (ui32TotLength - (ui32HdrLength * UC_4)));
-
-                /* if options are present */
-                if(ui32HdrLength > IPV4_HEADER_MIN_LENGTH)
-                {
-                    /* update options length */
-                    stRXPendingFrag.ui8OptLength = ((ui32HdrLength - IPV4_HEADER_MIN_LENGTH) * UC_4);
-
-                    /* copy options to manage later */
-                    MEM_COPY(stRXPendingFrag.aui8OptionsPtr,
-                           (uint8 *)(pui8FramePtr + IPV4_HEADER_MIN_BYTE_LENGTH),
-                           stRXPendingFrag.ui8OptLength);
-
-                    /* options are valid and are pending to be managed */
-                    stRXPendingFrag.bOptReady = B_TRUE;
-                }
-                else
-                {
-                    /* no options are present */
-                    stRXPendingFrag.bOptReady = B_FALSE;
-                }
+            /* no fragmentation */
 
-                /* fragmentation pending */
-                stRXPendingFrag.bFragPending = B_TRUE;
+            /* if options are present */
+            if(ui32HdrLength > IPV4_HEADER_MIN_LENGTH)
+            {
+                /* update options length */
+                ui8OptLength = ((ui32HdrLength - IPV4_HEADER_MIN_LENGTH) * UC_4);
+                /* update options pointer */
+                pui8OptionsPtr = (uint8 *)(pui8FramePtr + IPV4_HEADER_MIN_BYTE_LENGTH);
+                /* options are raady to be managed */
+                bOptReady = B_TRUE;
             }
             else
             {
-                /* no fragmentation */
+                /* no options are present */
+                bOptReady = B_FALSE;
+            }
 
-                /* if options are present */
-                if(ui32HdrLength > IPV4_HEADER_MIN_LENGTH)
-                {
-                    /* update options length */
-                    ui8OptLength = ((ui32HdrLength - IPV4_HEADER_MIN_LENGTH) * UC_4);
-                    /* update options pointer */
-                    pui8OptionsPtr = (uint8 *)(pui8FramePtr + IPV4_HEADER_MIN_BYTE_LENGTH);
-                    /* options are raady to be managed */
-                    bOptReady = B_TRUE;
-                }
-                else
-                {
-                    /* no options are present */
-                    bOptReady = B_FALSE;
-                }
+            /* ui8Protocol, ui32SrcIPAdd and ui32DstIPAdd fields are already set */
+            /* set data pointer */
+            pui8DataPtr = (uint8 *)(pui8FramePtr + (ui32HdrLength * UC_4));
 
-                /* ui8Protocol, ui32SrcIPAdd and ui32DstIPAdd fields are already set */
-                /* set data pointer */
-                pui8DataPtr = (uint8 *)(pui8FramePtr + (ui32HdrLength * UC_4));
+            /* get data sum from the frame hardware one, if any */
+            ui32DataSum = getRXDataSum(pui8FramePtr, (uint16)ui32TotLength, ui32FrameSum, ui16SumLength);
 
-                /* data ready to be managed */
-                bSendDataUp = B_TRUE;
-            }
+            /* data ready to be managed */
+            bSendDataUp = B_TRUE;
         }
 
         /* if data are ready to be manged */
@@ -644,24 +872,24 @@ LOCAL void decodeIPv4Packet(uint8 *pui8FramePtr)
                 case IPV4_PROT_UDP:
                 {
                     /* call UDP */
-                    UDP_unpackMessage(ui32SrcIPAdd, ui32DstIPAdd, (uint8 *)pui8DataPtr);
-                    /* source and destination IP addresses are passed to upper layer */
+                    UDP_unpackMessage(ui32SrcIPAdd, ui32DstIPAdd, (uint8 *)pui8DataPtr, ui16DataLength, ui32DataSum);
+                    /* source and destination IP addresses and data sum are passed to upper layer */
 
                     break;
                 }
                 case IPV4_PROT_TCP:
                 {
                     /* call TCP */
-                    TCP_unpackMessage(ui32SrcIPAdd, ui32DstIPAdd, (uint8 *)pui8DataPtr, (uint16)(ui32TotLength - (ui32HdrLength * UC_4)));
-                    /* source and destination IP addresses are passed to upper layer */
+                    TCP_unpackMessage(ui32SrcIPAdd, ui32DstIPAdd, (uint8 *)pui8DataPtr, ui16DataLength, ui8Ecn, ui32DataSum);
+                    /* source and destination IP addresses, ECN codepoint and data sum are passed to upper layer */
 
                     break;
                 }
                 case IPV4_PROT_ICMP:
                 {
                     /* call ICMP */
-                    ICMP_manageICMPMsg(ui32SrcIPAdd, ui32DstIPAdd, (uint8 *)pui8DataPtr, (uint16)(ui32TotLength - (ui32HdrLength * UC_4)));
-                    /* source and destination IP addresses are passed to upper layer */
+                    ICMP_manageICMPMsg(ui32SrcIPAdd, ui32DstIPAdd, (uint8 *)pui8DataPtr, ui16DataLength, ui32DataSum);
+                    /* source and destination IP addresses and data sum are passed to upper layer */
 
                     break;
                 }
@@ -679,6 +907,197 @@ LOCAL void decodeIPv4Packet(uint8 *pui8FramePtr)
 }
 
 
+/* get the reassembly slot of a datagram. A new one is taken if it is missing: the oldest datagram is discarded if all slots are in use */
+LOCAL st_PendingFrag * getReassemblySlot( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint16 ui16Identif, uint8 ui8Protocol )
+{
+    st_PendingFrag *pstFrag = NULL_PTR;
+    st_PendingFrag *pstFreeFrag = NULL_PTR;
+    st_HoleDscpt *pstHole;
+    uint8 ui8Index;
+
+    /* look for the datagram slot and for a free or the oldest one */
+    for(ui8Index = UC_NULL; ui8Index < UC_REASM_SLOTS_NUM; ui8Index++)
+    {
+        if(B_FALSE == astRXPendingFrag[ui8Index].bInUse)
+        {
+            /* free slot */
+            pstFreeFrag = &astRXPendingFrag[ui8Index];
+        }
+        else if((astRXPendingFrag[ui8Index].ui32SrcIPAdd == ui32SrcIPAdd)
+             && (astRXPendingFrag[ui8Index].ui32DstIPAdd == ui32DstIPAdd)
+             && (astRXPendingFrag[ui8Index].ui16Identif == ui16Identif)
+             && (astRXPendingFrag[ui8Index].ui8Protocol == ui8Protocol))
+        {
+            /* datagram slot found */
+            pstFrag = &astRXPendingFrag[ui8Index];
+            break;
+        }
+        else if((NULL_PTR == pstFreeFrag)
+             || ((B_TRUE == pstFreeFrag->bInUse) && (astRXPendingFrag[ui8Index].ui16TimeoutCounter < pstFreeFrag->ui16TimeoutCounter)))
+        {
+            /* oldest slot so far */
+            pstFreeFrag = &astRXPendingFrag[ui8Index];
+        }
+        else
+        {
+            /* go on */
+        }
+    }
+
+    /* if datagram is new */
+    if(NULL_PTR == pstFrag)
+    {
+        /* take the slot */
+        pstFrag = pstFreeFrag;
+        pstFrag->ui32SrcIPAdd = ui32SrcIPAdd;
+        pstFrag->ui32DstIPAdd = ui32DstIPAdd;
+        pstFrag->ui16Identif = ui16Identif;
+        pstFrag->ui8Protocol = ui8Protocol;
+        pstFrag->ui8Ecn = IPV4_UC_ECN_NOT_ECT;
+        pstFrag->bOptReady = B_FALSE;
+        pstFrag->ui16DataLength = US_NULL;
+        pstFrag->ui16TimeoutCounter = US_REASM_TIMEOUT_COUNTER;
+        pstFrag->bInUse = B_TRUE;
+
+        /* the whole datagram is a hole */
+        pstHole = (st_HoleDscpt *)pstFrag->pui8DataBuffPtr;
+        pstHole->ui16First = US_NULL;
+        pstHole->ui16Last = US_HOLE_INFINITY;
+        pstHole->ui16Next = US_NO_HOLE;
+        pstFrag->ui16FirstHoleOffset = US_NULL;
+    }
+    else
+    {
+        /* datagram is already pending */
+    }
+
+    return pstFrag;
+}
+
+
+/* fill the holes covered by a fragment and copy its data in place (RFC 815). Return B_FALSE if fragment is invalid or datagram does not fit the buffer */
+LOCAL boolean addFragment( st_PendingFrag *pstFrag, uint16 ui16First, uint8 *pui8DataPtr, uint16 ui16Length, boolean bMoreFrags )
+{
+    boolean bValid;
+    uint16 ui16Last = (uint16)(ui16First + ui16Length - UC_1);
+    uint16 ui16HoleOffset;
+    uint16 *pui16HoleLink;
+    st_HoleDscpt stHole;
+    st_HoleDscpt *pstNewHole;
+
+    /* fragment shall not be empty and shall fit the buffer. Fragments but the last one are multiple of 8 bytes and leave room for a following hole descriptor */
+    if((ui16Length == US_NULL)
+    || (((uint32)ui16First + ui16Length) > US_REASM_BUFFER_LENGTH)
+    || ((B_TRUE == bMoreFrags) && (((ui16Length % IPV4_UC_OCTECTS_EACH_NFB) != US_NULL)
+                               || (((uint32)ui16Last + UC_1 + IPV4_UC_OCTECTS_EACH_NFB) > US_REASM_BUFFER_LENGTH))))
+    {
+        bValid = B_FALSE;
+    }
+    else
+    {
+        bValid = B_TRUE;
+
+        /* if it is the last fragment then datagram length is known */
+        if(B_FALSE == bMoreFrags)
+        {
+            pstFrag->ui16DataLength = (uint16)(ui16Last + UC_1);
+        }
+        else
+        {
+            /* length is still unknown */
+        }
+
+        /* check all holes */
+        pui16HoleLink = &pstFrag->ui16FirstHoleOffset;
+        ui16HoleOffset = pstFrag->ui16FirstHoleOffset;
+        while(ui16HoleOffset != US_NO_HOLE)
+        {
+            /* copy the hole descriptor: fragment data and new descriptors may overwrite it */
+            stHole = *((st_HoleDscpt *)&pstFrag->pui8DataBuffPtr[ui16HoleOffset]);
+
+            /* if fragment does not cover the hole */
+            if((ui16First > stHole.ui16Last)
+            || (ui16Last < stHole.ui16First))
+            {
+                /* keep it: next hole will be linked to it */
+                pui16HoleLink = &((st_HoleDscpt *)&pstFrag->pui8DataBuffPtr[ui16HoleOffset])->ui16Next;
+            }
+            else
+            {
+                /* the hole is removed. If a part of it remains before the fragment */
+                if(ui16First > stHole.ui16First)
+                {
+                    /* new hole in place of the removed one */
+                    pstNewHole = (st_HoleDscpt *)&pstFrag->pui8DataBuffPtr[stHole.ui16First];
+                    pstNewHole->ui16First = stHole.ui16First;
+                    pstNewHole->ui16Last = (uint16)(ui16First - UC_1);
+                    *pui16HoleLink = pstNewHole->ui16First;
+                    pui16HoleLink = &pstNewHole->ui16Next;
+                }
+                else
+                {
+                    /* no hole before the fragment */
+                }
+
+                /* if a part of the hole remains after the fragment and more fragments follow */
+                if((ui16Last < stHole.ui16Last)
+                && (B_TRUE == bMoreFrags))
+                {
+                    /* new hole just after the fragment */
+                    pstNewHole = (st_HoleDscpt *)&pstFrag->pui8DataBuffPtr[ui16Last + UC_1];
+                    pstNewHole->ui16First = (uint16)(ui16Last + UC_1);
+                    pstNewHole->ui16Last = stHole.ui16Last;
+                    *pui16HoleLink = pstNewHole->ui16First;
+                    pui16HoleLink = &pstNewHole->ui16Next;
+                }
+                else
+                {
+                    /* no hole after the fragment */
+                }
+
+                /* link what follows the removed hole */
+                *pui16HoleLink = stHole.ui16Next;
+            }
+
+            /* next hole */
+            ui16HoleOffset = stHole.ui16Next;
+        }
+
+        /* copy fragment data in place */
+        MEM_COPY(&pstFrag->pui8DataBuffPtr[ui16First], pui8DataPtr, ui16Length);
+    }
+
+    return bValid;
+}
+
+
+/* discard datagrams whose fragments have not been received in time */
+LOCAL void manageReassemblyTimeouts( void )
+{
+    uint8 ui8Index;
+
+    for(ui8Index = UC_NULL; ui8Index < UC_REASM_SLOTS_NUM; ui8Index++)
+    {
+        if(B_TRUE == astRXPendingFrag[ui8Index].bInUse)
+        {
+            if(astRXPendingFrag[ui8Index].ui16TimeoutCounter > US_NULL)
+            {
+                astRXPendingFrag[ui8Index].ui16TimeoutCounter--;
+            }
+            else
+            {
+                /* timeout expired: discard the datagram */
+                astRXPendingFrag[ui8Index].bInUse = B_FALSE;
+            }
+        }
+        else
+        {
+            /* free slot */
+        }
+    }
+}
+
+
 /* manage received options */
 LOCAL void manageReceivedOptions( uint8 * pui8OptionsPtr, uint8 ui8OptLength )
 {
@@ -687,16 +1106,136 @@ LOCAL void manageReceivedOptions( uint8 * pui8OptionsPtr, uint8 ui8OptLength )
 }
 
 
-/* send IPv4 packet through ETHMAC layer. Fragment packet if necessary */
-LOCAL void sendPendingIPv4Packet( IPv4_st_PacketDescriptor *stPacketDscpt )
+/* send queued packets in order of request. Packets whose next hop is not resolved stay queued without delaying the others
+   until their timeout expires */
+LOCAL void sendQueuedPackets( void )
+{
+    uint32 aui32UnresolvedHops[UC_TX_QUEUE_LENGTH];
+    uint8 ui8UnresolvedNum = UC_NULL;
+    uint8 ui8HopIndex;
+    uint8 ui8QueuePos = UC_NULL;
+    st_TXQueueEntry *pstEntry;
+    uint64 ui64DstEthAdd;
+
+    while(ui8QueuePos < ui8TXQueuedNum)
+    {
+        pstEntry = &astTXQueue[aui8TXQueueOrder[ui8QueuePos]];
+
+        /* look for entry next hop among unresolved ones of this run */
+        for(ui8HopIndex = UC_NULL; (ui8HopIndex < ui8UnresolvedNum) && (aui32UnresolvedHops[ui8HopIndex] != pstEntry->ui32NextHopIPAdd); ui8HopIndex++)
+        {
+            /* go on */
+        }
+
+        /* if next hop is already known to be unresolved */
+        if(ui8HopIndex < ui8UnresolvedNum)
+        {
+            /* ARP request has already been sent in this run */
+            ui64DstEthAdd = ULL_NULL;
+        }
+        else
+        {
+            /* update local IP addresses table */
+            ARP_setLocalIPAddress(pstEntry->stPacketDscpt.ui32IPSrcAddress);
+            /* get ETH address from ARP module */
+            ui64DstEthAdd = ARP_getEthAddFromIPAdd(pstEntry->stPacketDscpt.ui32IPSrcAddress, pstEntry->stPacketDscpt.ui32IPDstAddress);
+
+            if(ui64DstEthAdd != ULL_NULL)
+            {
+                /* update dst ETH address */
+                pstEntry->stPacketDscpt.ui64DstEthAdd = ui64DstEthAdd;
+
+                /* prepare and send a packet */
+                sendPendingIPv4Packet(pstEntry);
+
+                /* release datagram data and free the entry */
+                removeTXQueueEntry(ui8QueuePos);
+            }
+            else
+            {
+                /* ETH address was unknown, an ARP request may have been sent. Park entries of this next hop until next run */
+                aui32UnresolvedHops[ui8UnresolvedNum] = pstEntry->ui32NextHopIPAdd;
+                ui8UnresolvedNum++;
+            }
+        }
+
+        /* if the entry is parked */
+        if(ULL_NULL == ui64DstEthAdd)
+        {
+            if(pstEntry->ui16TimeoutCounter > US_NULL)
+            {
+                /* keep the entry queued */
+                pstEntry->ui16TimeoutCounter--;
+                ui8QueuePos++;
+            }
+            else
+            {
+                /* next hop not resolved in time: discard the datagram */
+                removeTXQueueEntry(ui8QueuePos);
+            }
+        }
+        else
+        {
+            /* entry has been sent and removed: the next one is now at the same position */
+        }
+    }
+}
+
+
+/* release data of the TX queue entry at a queue position and remove it from the queue keeping the order of the others */
+LOCAL void removeTXQueueEntry( uint8 ui8QueuePos )
+{
+    st_TXQueueEntry *pstEntry = &astTXQueue[aui8TXQueueOrder[ui8QueuePos]];
+    uint8 ui8Index;
+
+    PBUF_free(pstEntry->pstPbuf);
+    pstEntry->pstPbuf = NULL_PTR;
+    pstEntry->bInUse = B_FALSE;
+    ui8TXQueuedNum--;
+    for(ui8Index = ui8QueuePos; ui8Index < ui8TXQueuedNum; ui8Index++)
+    {
+        aui8TXQueueOrder[ui8Index] = aui8TXQueueOrder[ui8Index + UC_1];
+    }
+}
+
+
+/* get the first free TX queue entry. Return NULL_PTR if queue is full */
+LOCAL st_TXQueueEntry * getFreeTXQueueEntry( void )
+{
+    st_TXQueueEntry *pstEntry = NULL_PTR;
+    uint8 ui8Index;
+
+    for(ui8Index = UC_NULL; ui8Index < UC_TX_QUEUE_LENGTH; ui8Index++)
+    {
+        if(B_FALSE == astTXQueue[ui8Index].bInUse)
+        {
+            /* free entry found */
+            pstEntry = &astTXQueue[ui8Index];
+            break;
+        }
+        else
+        {
+            /* go on */
+        }
+    }
+
+    return pstEntry;
+}
+
+
+/* send IPv4 packet of a TX queue entry through ETHMAC layer. Fragment packet if necessary */
+LOCAL void sendPendingIPv4Packet( st_TXQueueEntry *pstEntry )
 {
-    uint8 *pui8BuffPtr;
+    IPv4_st_PacketDescriptor *stPacketDscpt = &pstEntry->stPacketDscpt;
     st_HeaderParams stHeaderParams;
     st_HeaderOptions stHdrOptions;
     uint16 ui16TotalLength;
     uint16 ui16DataLength;
     uint8 ui8NumOfFragPackets = UC_NULL;
     uint8 ui8NumOfNFB = UC_NULL;
+    uint16 ui16DataOffset;
+    PBUF_st_Buffer *pstFragPbuf;
+    uint32 aui32FragHeader[PBUF_US_HEADROOM / UC_4];
 
     /* copy option structure and examine it */
     stHdrOptions = stPacketDscpt->stOptions;
@@ -740,7 +1279,7 @@ LOCAL void sendPendingIPv4Packet( IPv4_st_PacketDescriptor *stPacketDscpt )
     stHeaderParams.ui32IPDstAddress = stPacketDscpt->ui32IPDstAddress;      /* destination IP address */
     stHeaderParams.ui32IPSrcAddress = stPacketDscpt->ui32IPSrcAddress;      /* source IP address */
     stHeaderParams.ui8Dscp = 0;                                             /* TODO: fixed at 0 at the moment */
-    stHeaderParams.ui8Ecn = 0;                                              /* TODO: fixed at 0 at the moment */
+    stHeaderParams.ui8Ecn = stPacketDscpt->ui8Ecn;                          /* ECN codepoint set by the transport */
     stHeaderParams.ui8TimeToLive = GET_TIME_TO_LIVE();                      /* set time to live */
     stHeaderParams.ui16Identifier = GET_IDENTIF_NUM();                      /* set identifier number */
     stHeaderParams.ui8Flags = UC_NULL;                                      /* reset flags */
@@ -762,7 +1301,7 @@ LOCAL void sendPendingIPv4Packet( IPv4_st_PacketDescriptor *stPacketDscpt )
     ui16TotalLength = stHeaderParams.ui8HdrLength + stHdrOptions.ui8TotOptLength + stPacketDscpt->ui16DataLength;
 
     /* calculate num of NFB units once */
-    ui8NumOfNFB = (uint8)((IPV4_US_MAX_TRANS_UNIT - stHeaderParams.ui8HdrLength) / IPV4_UC_OCTECTS_EACH_NFB);
+    ui8NumOfNFB = (uint8)((ui16Mtu - stHeaderParams.ui8HdrLength) / IPV4_UC_OCTECTS_EACH_NFB);
 
     /* fragmentation loop */
     do
@@ -779,7 +1318,7 @@ LOCAL void sendPendingIPv4Packet( IPv4_st_PacketDescriptor *stPacketDscpt )
         }
 
         /* check if fragmentation is necessary and if yes then implement it */
-        if((ui16TotalLength > IPV4_US_MAX_TRANS_UNIT)
+        if((ui16TotalLength > ui16Mtu)
         && (B_FALSE == stPacketDscpt->bDoNotFragment))
         {
             /* update total length */
@@ -794,7 +1333,7 @@ LOCAL void sendPendingIPv4Packet( IPv4_st_PacketDescriptor *stPacketDscpt )
             /* decrement remaining total length */
             ui16TotalLength -= ui16DataLength;
         }
-        /* ATTENTION: if do not fragment then send the datagram anyway without considering IPV4_US_MAX_TRANS_UNIT */
+        /* ATTENTION: if do not fragment then send the datagram anyway without considering the MTU */
         else
         {
             /* update total length */
@@ -813,29 +1352,149 @@ LOCAL void sendPendingIPv4Packet( IPv4_st_PacketDescriptor *stPacketDscpt )
         /* update fragmentation offset field */
         stHeaderParams.ui16FragOffset = (ui8NumOfFragPackets * ui8NumOfNFB);
 
-        /* get next buffer pointer */
-        pui8BuffPtr = (uint8 *)ETHMAC_getTXBufferPointer(stHeaderParams.ui16TotLength);
-        /* perform a 32-bit word alignment */
-        ALIGN_32BIT_OF_8BIT_PTR(pui8BuffPtr);
+        /* get offset of fragment data */
+        ui16DataOffset = (uint16)(ui8NumOfFragPackets * (ui8NumOfNFB * IPV4_UC_OCTECTS_EACH_NFB));
 
-        /* update header */
-        prepareIPv4Header(pui8BuffPtr, &stHeaderParams, &stHdrOptions);
+        /* if the datagram is not fragmented and there is room in front of its data */
+        if((UC_NULL == ui8NumOfFragPackets)
+        && (US_NULL == ui16TotalLength)
+        && (B_TRUE == PBUF_addHeader(pstEntry->pstPbuf, stHeaderParams.ui8HdrLength)))
+        {
+            /* write the header in place and send data chain as it is */
+            prepareIPv4Header(pstEntry->pstPbuf->pui8Payload, &stHeaderParams, &stHdrOptions);
+            if(B_FALSE == ETHMAC_sendPbuf(pstEntry->pstPbuf, ETHMAC_ui64MACAddress, stPacketDscpt->ui64DstEthAdd, US_ETH_TYPE_IPV4))
+            {
+                /* ATTENTION: chain has more buffers than TX descriptors: datagram is lost */
+            }
+            else
+            {
+                /* datagram sent */
+            }
+        }
+        else
+        {
+            /* write the header in a local buffer leaving room for the ethernet header in front of it */
+            pstFragPbuf = PBUF_allocRef((uint8 *)aui32FragHeader, (uint16)(PBUF_US_HEADROOM - stHeaderParams.ui8HdrLength), stHeaderParams.ui8HdrLength, NULL_PTR);
+            if(pstFragPbuf != NULL_PTR)
+            {
+                prepareIPv4Header(pstFragPbuf->pui8Payload, &stHeaderParams, &stHdrOptions);
+
+                /* chain fragment data without copying them and send the fragment */
+                if((B_TRUE == attachDataSlices(pstFragPbuf, pstEntry->pstPbuf, ui16DataOffset, ui16DataLength))
+                && (B_TRUE == ETHMAC_sendPbuf(pstFragPbuf, ETHMAC_ui64MACAddress, stPacketDscpt->ui64DstEthAdd, US_ETH_TYPE_IPV4)))
+                {
+                    /* fragment sent */
+                }
+                else
+                {
+                    /* no free buffers or chain has more buffers than TX descriptors: fragment is lost */
+                }
 
-        /* attach data */
-        MEM_COPY((uint8 *)(pui8BuffPtr + stHeaderParams.ui8HdrLength),
-                 (pui8TXDataBuffPtr + (ui8NumOfFragPackets * (ui8NumOfNFB * IPV4_UC_OCTECTS_EACH_NFB))),
-                 ui16DataLength);
+                /* release fragment chain */
+                PBUF_free(pstFragPbuf);
+            }
+            else
+            {
+                /* no free buffers: fragment is lost */
+            }
+        }
 
         /* increment num of fragmentation packets */
         ui8NumOfFragPackets++;
 
-        /* request TX packet transmission */
-        ETHMAC_sendPacket(pui8BuffPtr, stHeaderParams.ui16TotLength, ETHMAC_ui64MACAddress, stPacketDscpt->ui64DstEthAdd, US_ETH_TYPE_IPV4);
-
     } while(ui16TotalLength > UC_NULL);
 }
 
 
+/* chain to a fragment the data slices of a datagram chain. Slices are referenced, not copied. Return B_FALSE if no buffer is free */
+LOCAL boolean attachDataSlices( PBUF_st_Buffer *pstFragPbuf, PBUF_st_Buffer *pstDataPbuf, uint16 ui16Offset, uint16 ui16Length )
+{
+    PBUF_st_Buffer *pstSlicePbuf;
+    uint16 ui16SliceLength;
+    boolean bSuccess = B_TRUE;
+
+    /* skip data buffers before the offset */
+    while((pstDataPbuf != NULL_PTR)
+    && (ui16Offset >= pstDataPbuf->ui16Length))
+    {
+        ui16Offset -= pstDataPbuf->ui16Length;
+        pstDataPbuf = pstDataPbuf->pstNext;
+    }
+
+    /* reference a slice of each data buffer holding fragment data */
+    while((pstDataPbuf != NULL_PTR)
+    && (ui16Length > US_NULL)
+    && (B_TRUE == bSuccess))
+    {
+        /* slice goes up to the end of the buffer or of the fragment */
+        ui16SliceLength = (uint16)(pstDataPbuf->ui16Length - ui16Offset);
+        if(ui16SliceLength > ui16Length)
+        {
+            ui16SliceLength = ui16Length;
+        }
+        else
+        {
+            /* fragment data go on in the next buffer */
+        }
+
+        /* ATTENTION: slice data are held by the datagram chain, which is released after the fragment */
+        pstSlicePbuf = PBUF_allocRef(pstDataPbuf->pui8Payload, ui16Offset, ui16SliceLength, NULL_PTR);
+        if(pstSlicePbuf != NULL_PTR)
+        {
+            /* chain the slice and go to the next buffer */
+            PBUF_cat(pstFragPbuf, pstSlicePbuf);
+            ui16Length -= ui16SliceLength;
+            ui16Offset = US_NULL;
+            pstDataPbuf = pstDataPbuf->pstNext;
+        }
+        else
+        {
+            /* no free buffers */
+            bSuccess = B_FALSE;
+        }
+    }
+
+    return bSuccess;
+}
+
+
+/* get the sum of datagram data from the hardware sum of the frame: a valid header sums to 0 in ones' complement.
+   Bytes summed after the datagram, as ethernet padding, are subtracted. Return IPV4_UL_NO_DATA_SUM if it is not available */
+LOCAL uint32 getRXDataSum( uint8 *pui8FramePtr, uint16 ui16TotLength, uint32 ui32FrameSum, uint16 ui16SumLength )
+{
+    uint32 ui32DataSum;
+    uint16 ui16TrailerSumCompl;
+
+    /* if frame has been summed by hardware up to the datagram end at least */
+    if((ui32FrameSum != IPV4_UL_NO_DATA_SUM)
+    && (ui16SumLength >= ui16TotLength))
+    {
+        /* get ones' complement of the sum of bytes following the datagram */
+        ui16TrailerSumCompl = IPV4_foldChecksum(IPV4_copyAndSum(NULL_PTR, &pui8FramePtr[ui16TotLength], (uint16)(ui16SumLength - ui16TotLength), UL_NULL));
+
+        /* if they start at an odd position they have been summed in the other byte of 16-bit words */
+        if((ui16TotLength & UC_1) != UC_NULL)
+        {
+            ui16TrailerSumCompl = (uint16)SWAP_BYTES_ORDER_16BIT_(ui16TrailerSumCompl);
+        }
+        else
+        {
+            /* even position */
+        }
+
+        /* subtract them adding their ones' complement */
+        ui32DataSum = ui32FrameSum + (uint32)ui16TrailerSumCompl;
+    }
+    else
+    {
+        /* upper layers sum data by software */
+        ui32DataSum = IPV4_UL_NO_DATA_SUM;
+    }
+
+    return ui32DataSum;
+}
+
+
 /* set header fields values */
 LOCAL void prepareIPv4Header(uint8 *pui8HdrPtr, st_HeaderParams *stHdrParams, st_HeaderOptions *stHdrOptions)
 {
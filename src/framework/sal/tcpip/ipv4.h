@@ -47,8 +47,61 @@
 /* Minimum length in octects of datagrams to receive */
 #define IPV4_US_ACCEPTED_MIN_LENGTH         ((uint16)576)
 
-/* Maximum data length for each fragment */
-#define IPV4_US_FRAG_MAX_LENGTH             ((uint16)576)
+/* Interface MTU in octects: buffers are sized on it. It can be overridden at build time and lowered at runtime by IPV4_setMtu() */
+#ifndef IPV4_US_MTU
+#define IPV4_US_MTU                         1500
+#endif
+
+/* MTU value check: Ethernet payload cannot exceed 1500 octects and every host shall accept 576 octects datagrams */
+#if (IPV4_US_MTU > 1500) || (IPV4_US_MTU < 576)
+#error IPV4_US_MTU shall be between 576 and 1500
+#endif
+
+/* Maximum length of each sent datagram or fragment at build time */
+#define IPV4_US_FRAG_MAX_LENGTH             ((uint16)IPV4_US_MTU)
+
+/* Number of outgoing datagrams that can be queued. It can be overridden at build time */
+#ifndef IPV4_UC_TX_QUEUE_LENGTH
+#define IPV4_UC_TX_QUEUE_LENGTH             4
+#endif
+
+/* Number of fragmented datagrams that can be reassembled at the same time. It can be overridden at build time */
+#ifndef IPV4_UC_REASM_SLOTS_NUM
+#define IPV4_UC_REASM_SLOTS_NUM             2
+#endif
+
+/* Maximum data length of a reassembled datagram: with the number of slots it caps reassembly memory. It can be overridden at build time.
+   It does not depend on the MTU: a fragmented datagram is longer than the MTU. Default fits the data of two full ethernet frames */
+#ifndef IPV4_US_REASM_MAX_LENGTH
+#define IPV4_US_REASM_MAX_LENGTH            3000
+#endif
+
+/* Reassembly length check: every host shall accept 576 octects datagrams */
+#if (IPV4_US_REASM_MAX_LENGTH > 65515) || (IPV4_US_REASM_MAX_LENGTH < 576)
+#error IPV4_US_REASM_MAX_LENGTH shall be between 576 and 65515
+#endif
+
+/* Time to receive all fragments of a datagram in ms before discarding it. It can be overridden at build time */
+#ifndef IPV4_UL_REASM_TIMEOUT_MS
+#define IPV4_UL_REASM_TIMEOUT_MS            15000
+#endif
+
+/* Time to resolve the next hop ETH address in ms before discarding a queued datagram. It can be overridden at build time */
+#ifndef IPV4_UL_ARP_TIMEOUT_MS
+#define IPV4_UL_ARP_TIMEOUT_MS              3000
+#endif
+
+/* Length in octects of IPv4 header without options */
+#define IPV4_US_HEADER_MIN_LENGTH           ((uint16)20)
+
+/* ECN field codepoints (RFC 3168) */
+#define IPV4_UC_ECN_NOT_ECT                 ((uint8)0)
+#define IPV4_UC_ECN_ECT_1                   ((uint8)1)
+#define IPV4_UC_ECN_ECT_0                   ((uint8)2)
+#define IPV4_UC_ECN_CE                      ((uint8)3)
+
+/* Received data sum passed to upper layers when hardware one is not available: they shall sum data by software */
+#define IPV4_UL_NO_DATA_SUM                 ((uint32)0xFFFFFFFF)
 
 
 
@@ -105,6 +158,7 @@ typedef struct
     uint64 ui64DstEthAdd;
     IPV4_keSuppProtocols enProtocol;
     boolean bDoNotFragment;
+    uint8 ui8Ecn;                   /* ECN field codepoint. IPV4_UC_ECN_NOT_ECT for not ECN-capable transports */
     st_HeaderOptions stOptions;
 } IPv4_st_PacketDescriptor;
 
@@ -117,11 +171,16 @@ EXTERN uint32           IPV4_getObtainedIPAdd   (void);
 EXTERN void             IPV4_setLocalIPAddress  (uint32);
 EXTERN boolean          IPV4_checkLocalIPAdd    (uint32);
 EXTERN void             IPV4_setRouterInfo      (uint32, uint32);
+EXTERN void             IPV4_setMtu             (uint16);
+EXTERN uint16           IPV4_getMtu             (void);
 EXTERN boolean          IPV4_Init               (void);
 EXTERN void             IPV4_Deinit             (void);
 EXTERN void             IPV4_PeriodicTask       (void);
-EXTERN uint8 *          IPV4_getDataBuffPtr     (void);
-EXTERN IPV4_keOpResult  IPV4_SendPacket         (IPv4_st_PacketDescriptor);
+EXTERN IPV4_keOpResult  IPV4_SendPbuf           (IPv4_st_PacketDescriptor, PBUF_st_Buffer *);
+EXTERN void             IPV4_discardPbufs       (uint8 *);
+EXTERN uint32           IPV4_getPseudoHdrSum    (IPv4_st_PacketDescriptor *);
+EXTERN uint32           IPV4_copyAndSum         (uint8 *, uint8 *, uint16, uint32);
+EXTERN uint16           IPV4_foldChecksum       (uint32);
 
 
 
@@ -0,0 +1,326 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/*
+ * This file pbuf.c represents the packet buffers of the TCP/IP stack.
+ * Buffers are taken from static pools: the ones with own memory reserve room in front of data
+ * so lower layers write their headers in place, the others reference data owned by upper layers.
+ *
+ * Author : Marco Russi
+ *
+ * Evolution of the file:
+ * 16/08/2015 - File created - Marco Russi
+ *
+*/
+
+
+
+
+/* ------------ Inclusion files --------------- */
+
+#include "../../fw_common.h"
+#include "pbuf.h"
+
+#include "ipv4.h"
+
+
+
+
+/* ------------ Local defines --------------- */
+
+/* Number of buffers with own memory */
+#define UC_RAM_PBUF_NUM                 ((uint8)PBUF_UC_RAM_NUM)
+
+/* Number of small buffers with own memory */
+#define UC_SMALL_PBUF_NUM               ((uint8)PBUF_UC_SMALL_NUM)
+
+/* Memory length of small buffers in 32-bit words: data are 32-bit aligned */
+#define US_SMALL_PBUF_WORDS_NUM         ((uint16)((PBUF_US_HEADROOM + PBUF_US_SMALL_LENGTH + UC_3) / UC_4))
+
+/* Number of buffers referencing data */
+#define UC_REF_PBUF_NUM                 ((uint8)PBUF_UC_REF_NUM)
+
+/* Maximum data length of buffers with own memory: a datagram as long as the MTU */
+#define US_RAM_PBUF_DATA_LENGTH         ((uint16)IPV4_US_FRAG_MAX_LENGTH)
+
+/* Memory length of buffers with own memory in 32-bit words: data are 32-bit aligned */
+#define US_RAM_PBUF_WORDS_NUM           ((uint16)((PBUF_US_HEADROOM + US_RAM_PBUF_DATA_LENGTH + UC_3) / UC_4))
+
+
+
+
+/* ------------ Local variables --------------- */
+
+/* buffers with own memory */
+LOCAL PBUF_st_Buffer astRamPbufs[UC_RAM_PBUF_NUM];
+
+/* memory of buffers with own memory */
+LOCAL uint32 aui32RamPbufsMemory[UC_RAM_PBUF_NUM][US_RAM_PBUF_WORDS_NUM];
+
+/* small buffers with own memory */
+LOCAL PBUF_st_Buffer astSmallPbufs[UC_SMALL_PBUF_NUM];
+
+/* memory of small buffers */
+LOCAL uint32 aui32SmallPbufsMemory[UC_SMALL_PBUF_NUM][US_SMALL_PBUF_WORDS_NUM];
+
+/* buffers referencing data */
+LOCAL PBUF_st_Buffer astRefPbufs[UC_REF_PBUF_NUM];
+
+
+
+
+/* ------------ Exported functions --------------- */
+
+/* init packet buffers: all buffers are free */
+EXPORTED void PBUF_Init( void )
+{
+    uint8 ui8Index;
+
+    for(ui8Index = UC_NULL; ui8Index < UC_RAM_PBUF_NUM; ui8Index++)
+    {
+        astRamPbufs[ui8Index].ui8RefCount = UC_NULL;
+    }
+
+    for(ui8Index = UC_NULL; ui8Index < UC_SMALL_PBUF_NUM; ui8Index++)
+    {
+        astSmallPbufs[ui8Index].ui8RefCount = UC_NULL;
+    }
+
+    for(ui8Index = UC_NULL; ui8Index < UC_REF_PBUF_NUM; ui8Index++)
+    {
+        astRefPbufs[ui8Index].ui8RefCount = UC_NULL;
+    }
+}
+
+
+/* get a buffer with own memory and PBUF_US_HEADROOM bytes of room in front of data. Data are 32-bit aligned.
+   Lengths up to PBUF_US_SMALL_LENGTH take a small buffer, if any is free. Return NULL_PTR if length is too long or no buffer is free */
+EXPORTED PBUF_st_Buffer * PBUF_alloc( uint16 ui16Length )
+{
+    PBUF_st_Buffer *pstPbuf = NULL_PTR;
+    uint8 *pui8MemoryPtr = NULL_PTR;
+    uint8 ui8Index;
+
+    /* if data fit in a small buffer */
+    if(ui16Length <= PBUF_US_SMALL_LENGTH)
+    {
+        /* look for a free small buffer */
+        for(ui8Index = UC_NULL; ui8Index < UC_SMALL_PBUF_NUM; ui8Index++)
+        {
+            if(UC_NULL == astSmallPbufs[ui8Index].ui8RefCount)
+            {
+                pstPbuf = &astSmallPbufs[ui8Index];
+                pui8MemoryPtr = (uint8 *)aui32SmallPbufsMemory[ui8Index];
+                break;
+            }
+            else
+            {
+                /* go on */
+            }
+        }
+    }
+    else
+    {
+        /* a MTU long buffer is needed */
+    }
+
+    /* if no small buffer has been taken and length is valid */
+    if((NULL_PTR == pstPbuf)
+    && (ui16Length <= US_RAM_PBUF_DATA_LENGTH))
+    {
+        /* look for a free MTU long buffer */
+        for(ui8Index = UC_NULL; ui8Index < UC_RAM_PBUF_NUM; ui8Index++)
+        {
+            if(UC_NULL == astRamPbufs[ui8Index].ui8RefCount)
+            {
+                pstPbuf = &astRamPbufs[ui8Index];
+                pui8MemoryPtr = (uint8 *)aui32RamPbufsMemory[ui8Index];
+                break;
+            }
+            else
+            {
+                /* go on */
+            }
+        }
+    }
+    else
+    {
+        /* small buffer taken or too long */
+    }
+
+    /* if a buffer has been found */
+    if(pstPbuf != NULL_PTR)
+    {
+        /* take it */
+        pstPbuf->pstNext = NULL_PTR;
+        pstPbuf->pui8Payload = pui8MemoryPtr + PBUF_US_HEADROOM;
+        pstPbuf->ui16Length = ui16Length;
+        pstPbuf->ui16TotLength = ui16Length;
+        pstPbuf->ui16Headroom = PBUF_US_HEADROOM;
+        pstPbuf->ui8RefCount = UC_1;
+        pstPbuf->pui8HoldCounter = NULL_PTR;
+    }
+    else
+    {
+        /* no free buffers */
+    }
+
+    return pstPbuf;
+}
+
+
+/* get a buffer referencing data of the given memory: data follow the given headroom. Data are not copied.
+   If a hold counter is given, it is incremented now and decremented when the buffer is freed: the data owner knows when data are no more referenced.
+   ATTENTION: data shall not change until the buffer is released. Return NULL_PTR if no buffer is free */
+EXPORTED PBUF_st_Buffer * PBUF_allocRef( uint8 *pui8MemoryPtr, uint16 ui16Headroom, uint16 ui16Length, uint8 *pui8HoldCounter )
+{
+    PBUF_st_Buffer *pstPbuf = NULL_PTR;
+    uint8 ui8Index;
+
+    /* look for a free buffer */
+    for(ui8Index = UC_NULL; ui8Index < UC_REF_PBUF_NUM; ui8Index++)
+    {
+        if(UC_NULL == astRefPbufs[ui8Index].ui8RefCount)
+        {
+            /* take it */
+            pstPbuf = &astRefPbufs[ui8Index];
+            pstPbuf->pstNext = NULL_PTR;
+            pstPbuf->pui8Payload = &pui8MemoryPtr[ui16Headroom];
+            pstPbuf->ui16Length = ui16Length;
+            pstPbuf->ui16TotLength = ui16Length;
+            pstPbuf->ui16Headroom = ui16Headroom;
+            pstPbuf->ui8RefCount = UC_1;
+            pstPbuf->pui8HoldCounter = pui8HoldCounter;
+            if(pui8HoldCounter != NULL_PTR)
+            {
+                (*pui8HoldCounter)++;
+            }
+            else
+            {
+                /* data owner does not count references */
+            }
+            break;
+        }
+        else
+        {
+            /* go on */
+        }
+    }
+
+    return pstPbuf;
+}
+
+
+/* set data length of a buffer not chained yet. ATTENTION: it shall not exceed the allocated length */
+EXPORTED void PBUF_setLength( PBUF_st_Buffer *pstPbuf, uint16 ui16Length )
+{
+    pstPbuf->ui16Length = ui16Length;
+    pstPbuf->ui16TotLength = ui16Length;
+}
+
+
+/* add a header in front of data of the first buffer of a chain. Return B_FALSE if there is no room */
+EXPORTED boolean PBUF_addHeader( PBUF_st_Buffer *pstPbuf, uint16 ui16HdrLength )
+{
+    boolean bSuccess;
+
+    if(ui16HdrLength <= pstPbuf->ui16Headroom)
+    {
+        /* move data start back */
+        pstPbuf->pui8Payload -= ui16HdrLength;
+        pstPbuf->ui16Headroom -= ui16HdrLength;
+        pstPbuf->ui16Length += ui16HdrLength;
+        pstPbuf->ui16TotLength += ui16HdrLength;
+        bSuccess = B_TRUE;
+    }
+    else
+    {
+        /* not enough room */
+        bSuccess = B_FALSE;
+    }
+
+    return bSuccess;
+}
+
+
+/* append a chain at the end of another one. ATTENTION: the reference of the appended chain is given to the first one */
+EXPORTED void PBUF_cat( PBUF_st_Buffer *pstHeadPbuf, PBUF_st_Buffer *pstTailPbuf )
+{
+    /* update total length of all head chain buffers up to the last one */
+    while(pstHeadPbuf->pstNext != NULL_PTR)
+    {
+        pstHeadPbuf->ui16TotLength += pstTailPbuf->ui16TotLength;
+        pstHeadPbuf = pstHeadPbuf->pstNext;
+    }
+    pstHeadPbuf->ui16TotLength += pstTailPbuf->ui16TotLength;
+
+    /* link the tail chain */
+    pstHeadPbuf->pstNext = pstTailPbuf;
+}
+
+
+/* add a reference to a buffer: it is released by as many PBUF_free() calls */
+EXPORTED void PBUF_ref( PBUF_st_Buffer *pstPbuf )
+{
+    pstPbuf->ui8RefCount++;
+}
+
+
+/* release a reference to a chain. Buffers with no more references are freed along the chain */
+EXPORTED void PBUF_free( PBUF_st_Buffer *pstPbuf )
+{
+    PBUF_st_Buffer *pstNextPbuf;
+
+    while(pstPbuf != NULL_PTR)
+    {
+        pstPbuf->ui8RefCount--;
+        if(UC_NULL == pstPbuf->ui8RefCount)
+        {
+            /* buffer is free: tell the data owner, if it counts references */
+            if(pstPbuf->pui8HoldCounter != NULL_PTR)
+            {
+                (*pstPbuf->pui8HoldCounter)--;
+                pstPbuf->pui8HoldCounter = NULL_PTR;
+            }
+            else
+            {
+                /* data are not counted */
+            }
+
+            /* release its reference to the next one */
+            pstNextPbuf = pstPbuf->pstNext;
+            pstPbuf->pstNext = NULL_PTR;
+            pstPbuf = pstNextPbuf;
+        }
+        else
+        {
+            /* buffer is still referenced: the rest of the chain too */
+            pstPbuf = NULL_PTR;
+        }
+    }
+}
+
+
+
+
+/* End of file */
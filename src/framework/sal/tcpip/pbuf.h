@@ -0,0 +1,107 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) [2015] [Marco Russi]
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+*/
+
+/*
+ * This file pbuf.h represents the packet buffers inclusion file of the TCP/IP stack.
+ *
+ * Author : Marco Russi
+ *
+ * Evolution of the file:
+ * 16/08/2015 - File created - Marco Russi
+ *
+*/
+
+
+/* Definition for mono-inclusion */
+#ifndef _PBUF_H
+#define _PBUF_H
+
+
+
+
+/* ------------ Inclusion files --------------- */
+
+#include "../../fw_common.h"
+
+
+
+
+/* ------------ Exported defines --------------- */
+
+/* Room reserved in front of data of allocated buffers: ethernet header plus IPv4 header with options, 32-bit aligned */
+#define PBUF_US_HEADROOM            ((uint16)76)
+
+/* Number of packet buffers with own memory, each one as long as the IPv4 MTU. It can be overridden at build time */
+#ifndef PBUF_UC_RAM_NUM
+#define PBUF_UC_RAM_NUM             6
+#endif
+
+/* Number of small packet buffers with own memory, for headers and short messages. It can be overridden at build time */
+#ifndef PBUF_UC_SMALL_NUM
+#define PBUF_UC_SMALL_NUM           8
+#endif
+
+/* Maximum data length of small packet buffers: the longest TCP header */
+#define PBUF_US_SMALL_LENGTH        ((uint16)60)
+
+/* Number of packet buffers referencing data they do not own. It can be overridden at build time */
+#ifndef PBUF_UC_REF_NUM
+#define PBUF_UC_REF_NUM             8
+#endif
+
+
+
+
+/* ------------ Exported types --------------- */
+
+/* packet buffer. Buffers are chained to describe a packet whose data are scattered: each layer adds its header in front of the first one */
+typedef struct PBUF_st_Buffer_tag
+{
+    struct PBUF_st_Buffer_tag *pstNext; /* next buffer of the chain. NULL_PTR for the last one */
+    uint8   *pui8Payload;               /* first data byte */
+    uint16  ui16Length;                 /* data length of this buffer */
+    uint16  ui16TotLength;              /* data length of this buffer and of the following ones */
+    uint16  ui16Headroom;               /* free room in front of data */
+    uint8   ui8RefCount;                /* references to this buffer. 0 if it is free */
+    uint8   *pui8HoldCounter;           /* counter of the referenced data owner, decremented when the buffer is freed. NULL_PTR if none */
+} PBUF_st_Buffer;
+
+
+
+
+/* ------------ Exported functions prototypes --------------- */
+
+EXTERN void     PBUF_Init           (void);
+EXTERN PBUF_st_Buffer * PBUF_alloc  (uint16);
+EXTERN PBUF_st_Buffer * PBUF_allocRef (uint8 *, uint16, uint16, uint8 *);
+EXTERN void     PBUF_setLength      (PBUF_st_Buffer *, uint16);
+EXTERN boolean  PBUF_addHeader      (PBUF_st_Buffer *, uint16);
+EXTERN void     PBUF_cat            (PBUF_st_Buffer *, PBUF_st_Buffer *);
+EXTERN void     PBUF_ref            (PBUF_st_Buffer *);
+EXTERN void     PBUF_free           (PBUF_st_Buffer *);
+
+
+
+#endif
+
+/* End of file */
@@ -34,13 +34,9 @@
 
 /*
 TODO LIST:
-    1) RST packet reception;
-    2) implement a re-transmission delay. Wait a bit before transmitting again;
     3) implement a proper function for updating the sequence number, see UPDATE_SEQUENCE_NUMBER macro;
-    4) verify received packet checksum in TCP_unpackMessage() function;
-    5) consider to set these flags: NS, CWR, ECE, URG in prepareAndSendMsg() function;
+    5) consider to set these flags: NS, URG in prepareAndSendMsg() function;
     6) consider to update checksum field. See UPDATE_HDR_CHECKSUM macro;
-    7) evaluate if it is better to create a common checksum function for UDP and TCP;
     8) consider to implement something with FLUSH flag;
     9) consider to clear data buffer in prepareAndSendMsg() function.
 */
@@ -53,6 +49,7 @@ TODO LIST:
 #include "tcp.h"
 
 #include "../../hal/ethmac.h"
+#include "../rtos/rtos.h"
 #include "ipv4.h"
 
 
@@ -60,17 +57,111 @@ TODO LIST:
 
 /* ------------ Local defines --------------- */
 
-/* Num of max TCP connections */
-#define UC_NUM_OF_MAX_CONN                      ((uint8)2)
+/* Num of max TCP connections: configured at build time */
+#define UC_NUM_OF_MAX_CONN                      ((uint8)TCP_UC_MAX_CONN_NUM)
 
-/* Maximum data length allowed in transmission */
-#define US_MAX_TX_DATA_LENGTH_ALLOWED           ((uint16)128)
+/* Number of connections hash table buckets. ATTENTION: it shall be a power of 2 */
+#define UC_CONN_HASH_TABLE_SIZE                 ((uint8)32)
 
-/* Maximum data length allowed in reception */
-#define US_MAX_RX_DATA_LENGTH_ALLOWED           ((uint16)512)
+/* Connections hash table index mask */
+#define UC_CONN_HASH_MASK                       ((uint8)(UC_CONN_HASH_TABLE_SIZE - UC_1))
 
-/* Maximum data length allowed in reception */
-#define TCP_DEFAULT_WINDOW_SIZE                 (US_MAX_RX_DATA_LENGTH_ALLOWED)
+/* Null connection slot index: end of hash chains and free list */
+#define UC_NULL_SLOT_INDEX                      ((uint8)TCP_KE_NULL_CONN_INDEX)
+
+/* Num of max TCP listeners: configured at build time */
+#define UC_NUM_OF_MAX_LISTENERS                 ((uint8)TCP_UC_MAX_LISTEN_NUM)
+
+/* Local maximum segment size: data length of a datagram as long as the IPv4 MTU, so it is never fragmented */
+#define US_LOCAL_MSS                            ((uint16)(IPV4_getMtu() - IPV4_US_HEADER_MIN_LENGTH - UC_TCP_HDR_MIN_LENGTH_BYTES))
+
+/* Default maximum segment size if the peer does not send the MSS option (RFC 879) */
+#define US_DEFAULT_MSS                          ((uint16)536)
+
+/* Default length of the TX circular buffer of a connection: it limits sent and not yet acknowledged data (local send window) */
+#define US_DEFAULT_TX_BUFFER_LENGTH             ((uint16)1024)
+
+/* Default length of the RX circular buffer of a connection: maximum advertised window */
+#define US_DEFAULT_RX_BUFFER_LENGTH             ((uint16)512)
+
+/* Buffers pool allocation unit length. Connection buffers blocks are made of contiguous units */
+#define US_BUFFER_UNIT_LENGTH                   ((uint16)64)
+
+/* Number of units in the buffers pool: as many as needed by TCP_UC_BUFFER_POOL_NUM connections with default buffers */
+#define US_NUM_OF_BUFFER_UNITS                  ((uint16)(((uint32)TCP_UC_BUFFER_POOL_NUM * (US_DEFAULT_RX_BUFFER_LENGTH + US_DEFAULT_TX_BUFFER_LENGTH)) / US_BUFFER_UNIT_LENGTH))
+
+/* Minimum and maximum length of RX and TX circular buffers set at connection opening. Other lengths are rejected.
+   The longest buffer takes the whole pool but the shortest other one */
+#define US_MIN_BUFFER_LENGTH                    ((uint16)64)
+#define US_MAX_BUFFER_LENGTH                    ((uint16)((US_NUM_OF_BUFFER_UNITS * US_BUFFER_UNIT_LENGTH) - US_MIN_BUFFER_LENGTH))
+
+/* Initial retransmission timeout in ms */
+#define UL_RTO_INITIAL_MS                       ((uint32)1000)
+
+/* Minimum retransmission timeout in ms */
+#define UL_RTO_MIN_MS                           ((uint32)200)
+
+/* Maximum retransmission timeout in ms */
+#define UL_RTO_MAX_MS                           ((uint32)16000)
+
+/* Retransmission timer granularity in ms: timer is managed by the periodic task */
+#define UL_RTO_CLOCK_GRANULARITY_MS             (RTOS_UL_TASKS_PERIOD_MS)
+
+/* Maximum number of out-of-order data ranges queued in the RX buffer */
+#define UC_OOO_MAX_RANGES_NUM                   ((uint8)4)
+
+/* Delayed ACK timeout in ms. ATTENTION: it shall be less than 500 ms (RFC 1122) */
+#define UL_DELAYED_ACK_TIMEOUT_MS               ((uint32)200)
+
+/* Number of received data segments after which an ACK is sent immediately */
+#define UC_ACK_EVERY_SEG_NUM                    ((uint8)2)
+
+/* Default maximum number of consecutive retransmissions before aborting the connection */
+#define UC_DEFAULT_MAX_RETX_NUM                 ((uint8)6)
+
+/* Maximum zero window probes interval in ms */
+#define UL_PERSIST_MAX_MS                       ((uint32)60000)
+
+
+/* Default keepalive idle time, probes interval in ms and number of unanswered probes (RFC 1122) */
+#define UL_KEEPALIVE_DEFAULT_IDLE_MS            ((uint32)7200000)
+#define UL_KEEPALIVE_DEFAULT_INTV_MS            ((uint32)75000)
+#define UC_KEEPALIVE_DEFAULT_PROBES_NUM         ((uint8)9)
+
+/* Number of duplicate ACKs triggering a fast retransmission */
+#define UC_DUP_ACK_THRESHOLD                    ((uint8)3)
+
+/* Upper bound in bytes of the initial congestion window when it is lower than 4 * MSS (RFC 3390) */
+#define UL_INITIAL_WINDOW_MAX_BYTES             ((uint32)4380)
+
+/* Initial slow start threshold: arbitrarily high (RFC 5681) */
+#define UL_MAX_SLOW_START_THRESH                ((uint32)0x0000FFFF)
+
+/* ECN is requested and accepted: configured at build time */
+#define B_ECN_ENABLED                           ((TCP_UC_ECN_ENABLE != 0) ? B_TRUE : B_FALSE)
+
+/* TCP options kinds */
+#define UC_OPT_KIND_END_OF_LIST                 ((uint8)0)
+#define UC_OPT_KIND_NO_OPERATION                ((uint8)1)
+#define UC_OPT_KIND_MSS                         ((uint8)2)
+
+#define UC_OPT_KIND_FAST_OPEN                   ((uint8)34)
+
+/* TCP MSS option length in bytes */
+#define UC_OPT_LENGTH_MSS                       ((uint8)4)
+
+/* TCP Fast Open option length in bytes without cookie: kind and length only (RFC 7413) */
+#define UC_OPT_LENGTH_FAST_OPEN_MIN             ((uint8)2)
+
+/* TCP Fast Open cookie minimum and maximum lengths in bytes (RFC 7413) */
+#define UC_FAST_OPEN_COOKIE_MIN_LENGTH          ((uint8)4)
+#define UC_FAST_OPEN_COOKIE_MAX_LENGTH          ((uint8)16)
+
+/* Number of servers whose Fast Open cookie is cached */
+#define UC_FAST_OPEN_CACHE_SIZE                 ((uint8)4)
+
+/* Maximum data length sent with a SYN: default MSS less MSS and longest Fast Open options, as the peer MSS is not known yet */
+#define US_FAST_OPEN_MAX_SYN_DATA_LENGTH        ((uint16)(US_DEFAULT_MSS - UC_OPT_LENGTH_MSS - UC_OPT_LENGTH_FAST_OPEN_MIN - UC_FAST_OPEN_COOKIE_MAX_LENGTH - UC_2))
 
 /* Minimum length in bytes of TCP header */
 #define UC_TCP_HDR_MIN_LENGTH_BYTES             ((uint8)20)
@@ -151,25 +242,45 @@ TODO LIST:
 /* Macro to get sequence number. TODO: implement it properly */
 #define UPDATE_SEQUENCE_NUMBER(x)   (x += 0x00000200)
 
+/* Macro to get the next sequence number to send: oldest unacknowledged one plus data in flight */
+#define GET_SND_NEXT(x)             ((uint32)((x)->ui32SeqNumber + (x)->ui16SentDataLength))
+
+/* Macro to get the free space in the RX circular buffer: it is the advertised window */
+#define GET_RX_FREE_SPACE(x)        ((uint16)((x)->ui16RXBufferLength - (x)->ui16RXDataLength))
+
+/* Macro to get the free space in the TX circular buffer */
+#define GET_TX_FREE_SPACE(x)        ((uint16)((x)->ui16TXBufferLength - (x)->ui16PendingTXDataLength - (x)->ui16TXHeldLength))
+
+/* Macro to get the minimum RX window increment to advertise with a window update: min(MSS, RX buffer / 2) (RFC 1122) */
+#define GET_WND_UPDATE_MIN_LENGTH(x)    ((US_LOCAL_MSS < ((x)->ui16RXBufferLength >> US_SHIFT_1)) ? US_LOCAL_MSS : (uint16)((x)->ui16RXBufferLength >> US_SHIFT_1))
+
+/* Macro to get the number of pool units needed by a buffers block */
+#define GET_BUFFER_UNITS_NUM(x)     ((uint16)(((x) + US_BUFFER_UNIT_LENGTH - UC_1) / US_BUFFER_UNIT_LENGTH))
+
+/* Macro to check if a connection index given by the application is valid and allocated */
+#define IS_CONN_ALLOCATED(x)        (((x) < TCP_KE_CONN_MAX_NUM) && (B_TRUE == stOpenConnInfo[(x)].bInUse))
+
+/* Macro to check if sequence number x is greater than or equal to sequence number y (modulo 2^32) */
+#define SEQ_NUM_GE(x,y)             (((uint32)((x) - (y))) < (uint32)0x80000000)
+
 
 
 
 
 /* ------------ Local structures definitions -------------- */
 
-/* connection states enum */
+/* connection states enum. Values are the exported ones, see TCP_getConnStats() */
 typedef enum
 {
-    KE_OPENING,
-    KE_WAIT_SYN_ACK,
-    KE_ESTABLISHED,
-    KE_ESTAB_WAIT_ACK,
-    KE_WAIT_FIN_ACK,
-    KE_HALF_OPEN,
-    KE_HALF_OPEN_WAIT_ACK,
-    KE_HALF_CLOSED,
-    KE_WAIT_LAST_ACK,
-    KE_CLOSED
+    KE_OPENING = TCP_KE_STATE_OPENING,
+    KE_WAIT_SYN_ACK = TCP_KE_STATE_SYN_SENT,
+    KE_SYN_RECEIVED = TCP_KE_STATE_SYN_RECEIVED,
+    KE_ESTABLISHED = TCP_KE_STATE_ESTABLISHED,
+    KE_WAIT_FIN_ACK = TCP_KE_STATE_FIN_WAIT,
+    KE_HALF_OPEN = TCP_KE_STATE_HALF_OPEN,
+    KE_HALF_CLOSED = TCP_KE_STATE_HALF_CLOSED,
+    KE_WAIT_LAST_ACK = TCP_KE_STATE_LAST_ACK,
+    KE_CLOSED = TCP_KE_STATE_CLOSED
 } keConnStates;
 
 
@@ -186,6 +297,7 @@ typedef enum
 typedef enum
 {
     KE_MSG_SYN,
+    KE_MSG_SYN_ACK,
     KE_MSG_ACK,
     KE_MSG_FIN,
     KE_MSG_RST,
@@ -193,6 +305,14 @@ typedef enum
 } ke_MsgType;
 
 
+/* out-of-order received data range. Offset is relative to the next expected sequence number */
+typedef struct
+{
+    uint16          ui16Offset;
+    uint16          ui16Length;
+} st_RXRange;
+
+
 /* local structure to store TCP connections info */
 typedef struct
 {
@@ -200,21 +320,102 @@ typedef struct
     uint32          ui32DstIPAdd;
     uint16          ui16SrcPort;
     uint16          ui16DstPort;
-    uint32          ui32SeqNumber;
+    uint32          ui32SeqNumber;              /* oldest unacknowledged sequence number */
     uint32          ui32AckNumber;
-    uint16          ui16SentDataLength;
-    uint16          ui16PendingTXDataLength;
-    uint8           *pui8TXDataPtr;
+    uint16          ui16SentDataLength;         /* sent and not yet acknowledged length (in flight) */
+    uint16          ui16PendingTXDataLength;    /* not yet acknowledged length: in flight plus unsent */
+    uint16          ui16PeerWindowSize;         /* last window size advertised by the peer */
+    uint16          ui16SendMss;                /* maximum segment size to send: lowest between local and peer ones */
+    uint8           *pui8TXBufferPtr;           /* TX circular buffer */
+    uint16          ui16TXBufferLength;         /* TX circular buffer length */
+    uint16          ui16TXReadIndex;            /* index of the oldest unacknowledged data byte */
+    uint16          ui16TXHeldLength;           /* acknowledged length in front of the read index still referenced by packet buffers */
+    uint8           ui8TXDataRefNum;            /* packet buffers referencing TX buffer data. Decremented when they are freed */
+    boolean         bNoDelay;                   /* send small segments without waiting for ACKs (Nagle disabled) */
     keConnStates    eCurrConnState;
     keConnCommands  ePendingConnCommand;
-    uint8           *pui8RXStartDataPtr;
-    uint8           *pui8RXDataPtr;
-    uint16          ui16RXDataLength;
-    boolean         bNewRXAvailData;
+    uint8           *pui8RXBufferPtr;           /* RX circular buffer */
+    uint16          ui16RXBufferLength;         /* RX circular buffer length: maximum advertised window */
+    uint16          ui16RXReadIndex;            /* index of the oldest unread byte */
+    uint16          ui16RXDataLength;           /* received and unread length */
+    st_RXRange      astOooRanges[UC_OOO_MAX_RANGES_NUM];    /* out-of-order data queued after in-order ones, sorted and not contiguous */
+    uint8           ui8OooRangesNum;            /* number of queued out-of-order data ranges */
     boolean         bKeepHalfOpen;      
+    uint32          ui32SmoothRttMs;            /* smoothed round trip time */
+    uint32          ui32RttVarMs;               /* round trip time variance */
+    uint32          ui32RtoMs;                  /* current retransmission timeout */
+    uint32          ui32RetxTimerMs;            /* remaining time before retransmission. 0 if stopped */
+    uint8           ui8RetxCount;               /* consecutive retransmissions of the oldest segment */
+    uint8           ui8MaxRetxNum;              /* consecutive retransmissions before aborting the connection */
+    boolean         bRttPending;                /* a segment is being timed */
+    uint32          ui32RttSeqNumber;           /* sequence number to be acknowledged to take the sample */
+    uint32          ui32RttStartMs;             /* timed segment send time */
+    TCP_ke_ConnError eConnError;                /* last error occurred on this connection */
+    boolean         bInUse;                     /* slot is allocated to a connection */
+    boolean         bReleaseReq;                /* release the slot once the connection is CLOSED */
+    uint8           ui8NextSlotIndex;           /* next slot in the hash chain or in the free list */
+    uint8           ui8ListenerIndex;           /* listener owning a not yet accepted connection. TCP_KE_NULL_LISTENER_INDEX otherwise */
+    uint8           ui8UnackedSegNum;           /* received data segments not yet acknowledged */
+    uint32          ui32DelAckTimerMs;          /* remaining time before sending a delayed ACK. 0 if stopped */
+    uint32          ui32CongWindow;             /* congestion window in bytes */
+    uint32          ui32SlowStartThresh;        /* slow start threshold in bytes */
+    uint32          ui32CongAvoidAckedBytes;    /* bytes acknowledged during congestion avoidance since last window increase */
+    uint8           ui8DupAckCount;             /* consecutive duplicate ACKs */
+    boolean         bFastRecovery;              /* fast recovery in progress */
+    uint32          ui32RecoverSeqNumber;       /* highest sequence number sent when the last loss was detected */
+    uint32          ui32AdvRightEdge;           /* right edge of the last advertised RX window */
+    uint32          ui32PersistTimerMs;         /* remaining time before probing a zero window. 0 if stopped */
+    uint32          ui32PersistBackoffMs;       /* current zero window probes interval */
+    boolean         bKeepAlive;                 /* probe the peer when the connection is idle */
+    uint32          ui32KeepAliveIdleMs;        /* idle time before the first probe */
+    uint32          ui32KeepAliveIntvMs;        /* interval between unanswered probes */
+    uint8           ui8KeepAliveProbesNum;      /* unanswered probes before aborting the connection */
+    uint32          ui32KeepAliveTimerMs;       /* remaining time before the next probe */
+    uint8           ui8KeepAliveProbeCount;     /* sent and unanswered probes */
+    TCP_event_cb_ptr_t pvEventCallback;         /* connection events callback. NULL_PTR if not set */
+    boolean         bFastOpen;                  /* request a Fast Open cookie and send data with the SYN if one is cached */
+    uint16          ui16SynDataLength;          /* data length sent with the SYN and not yet managed */
+    uint16          ui16SynDataSentLength;      /* data length sent with the first SYN: acknowledged even if the SYN is retransmitted without them */
+    boolean         bEcn;                       /* ECN negotiated: data segments are sent as ECN-capable */
+    boolean         bEcnEchoPending;            /* congestion experienced received: set ECE until the peer sets CWR */
+    boolean         bCwrPending;                /* window reduced on ECE: set CWR on next new data segment */
+    uint32          ui32EcnRecoverSeqNumber;    /* highest sequence number sent at the last ECE reaction: react once per window */
+    TCP_st_ConnStats stStats;                   /* statistics counters. Current values are filled on request */
 } st_OpenConnInfo;
 
 
+/* listener info struct */
+typedef struct
+{
+    uint32          ui32LocalIPAdd;             /* 0.0.0.0 to accept on any local address */
+    uint16          ui16LocalPort;
+    uint8           ui8Backlog;                 /* maximum number of not yet accepted connections */
+    uint8           ui8PendingConnNum;          /* half open and established connections not yet accepted */
+    boolean         bKeepHalfOpen;              /* applied to accepted connections */
+    boolean         bInUse;
+} st_ListenerInfo;
+
+
+/* received options struct */
+typedef struct
+{
+    uint16          ui16PeerMss;                /* peer MSS or default one if not received */
+    boolean         bFastOpen;                  /* Fast Open option received */
+    uint8           *pui8FastOpenCookiePtr;     /* received Fast Open cookie. Valid within received segment only */
+    uint8           ui8FastOpenCookieLength;    /* received Fast Open cookie length. 0 if none */
+    boolean         bEcnSetup;                  /* SYN with ECE and CWR set: peer requests ECN. Not an option but stored along with them */
+} st_RXOptions;
+
+
+/* Fast Open cookie of a server */
+typedef struct
+{
+    uint32          ui32IPAdd;                  /* server IP address */
+    uint8           ui8CookieLength;            /* 0 if entry is free */
+    uint8           aui8Cookie[UC_FAST_OPEN_COOKIE_MAX_LENGTH];
+} st_FastOpenCookie;
+
+
 
 
 /* ------------ Local variables declaration -------------- */
@@ -222,6 +423,30 @@ typedef struct
 /* local open connections info array */
 LOCAL st_OpenConnInfo stOpenConnInfo[UC_NUM_OF_MAX_CONN];
 
+/* connections hash table: first slot index of each bucket chain */
+LOCAL uint8 aui8ConnHashTable[UC_CONN_HASH_TABLE_SIZE];
+
+/* first free slot index */
+LOCAL uint8 ui8FreeSlotIndex;
+
+/* connections table init flag */
+LOCAL boolean bConnTableInit = B_FALSE;
+
+/* local listeners info array */
+LOCAL st_ListenerInfo stListenerInfo[UC_NUM_OF_MAX_LISTENERS];
+
+/* connection buffers pool: allocated once, buffers are given back on close, abort or reset */
+LOCAL uint8 aui8ConnBufferPool[US_NUM_OF_BUFFER_UNITS * US_BUFFER_UNIT_LENGTH];
+
+/* pool units allocation flags */
+LOCAL boolean abBufferUnitUsed[US_NUM_OF_BUFFER_UNITS];
+
+/* Fast Open cookies cache. ATTENTION: entries are free at startup */
+LOCAL st_FastOpenCookie stFastOpenCache[UC_FAST_OPEN_CACHE_SIZE];
+
+/* next Fast Open cache entry to replace when the cache is full */
+LOCAL uint8 ui8FastOpenCacheNextIndex = UC_NULL;
+
 /* sequence number. TODO: implement it properly */
 LOCAL uint32 ui32SequenceNumber = 0x00270b6c;
 
@@ -230,673 +455,3490 @@ LOCAL uint32 ui32SequenceNumber = 0x00270b6c;
 
 /* ------------ Local functions prototypes -------------- */
 
-LOCAL void      getReceivedData         (uint8, uint32 *, uint16);
-LOCAL boolean   prepareAndSendMsg       (st_OpenConnInfo *, ke_MsgType, uint8 *, uint16);
+LOCAL uint16    getReceivedData         (st_OpenConnInfo *, uint16, uint8 *, uint16);
+LOCAL void      receiveSegmentData      (st_OpenConnInfo *, uint32, uint8 *, uint16);
+LOCAL void      advanceRXData           (st_OpenConnInfo *, uint16);
+LOCAL void      queueOooRange           (st_OpenConnInfo *, uint16, uint16);
+LOCAL boolean   prepareAndSendMsg       (st_OpenConnInfo *, ke_MsgType, uint32, uint8 *, uint16);
+LOCAL void      sendPendingData         (st_OpenConnInfo *);
+LOCAL void      releaseAckedData        (st_OpenConnInfo *, uint16);
+LOCAL uint16    getTXDataSpan           (st_OpenConnInfo *, uint16, uint16, uint8 **);
+LOCAL void      startRetxTimer          (st_OpenConnInfo *, uint32);
+LOCAL void      updateRetxOnAck         (st_OpenConnInfo *, uint16);
+LOCAL void      manageRetxTimer         (st_OpenConnInfo *);
+LOCAL boolean   retransmitOldestSegment (st_OpenConnInfo *);
+LOCAL void      initCongestionCtrl      (st_OpenConnInfo *);
+LOCAL void      reduceSlowStartThresh   (st_OpenConnInfo *);
+LOCAL void      updateCongestionOnAck   (st_OpenConnInfo *, uint16, boolean);
+LOCAL void      manageWindowUpdate      (st_OpenConnInfo *);
+LOCAL void      managePersistTimer      (st_OpenConnInfo *);
+LOCAL void      manageKeepAlive         (st_OpenConnInfo *);
+LOCAL boolean   isSeqAcceptable         (st_OpenConnInfo *, uint32, uint16);
+LOCAL void      manageRXEcn             (st_OpenConnInfo *, uint32, uint8);
+LOCAL void      notifyEvent             (st_OpenConnInfo *, TCP_ke_ConnEvent);
+LOCAL void      abortConnection         (st_OpenConnInfo *, TCP_ke_ConnError);
+LOCAL void      resetConnection         (st_OpenConnInfo *, TCP_ke_ConnError);
+LOCAL void      delayAck                (st_OpenConnInfo *);
+LOCAL void      manageDelAckTimer       (st_OpenConnInfo *);
 LOCAL uint8     getSocketIndex          (uint32, uint32, uint16, uint16);
-LOCAL uint16    calculateChecksum       (IPv4_st_PacketDescriptor *, uint16 *);
+LOCAL uint8     getConnHash             (uint32, uint16, uint16);
+LOCAL void      initConnTable           (void);
+LOCAL uint8     allocConnSlot           (void);
+LOCAL void      releaseConnSlot         (uint8);
+LOCAL uint8 *   allocConnBuffer         (uint16);
+LOCAL void      freeConnBuffer          (uint8 *, uint16);
+LOCAL void      releaseConnBuffer       (st_OpenConnInfo *);
+LOCAL uint16    getBufferLength         (uint16);
+LOCAL uint8     createConnection        (uint32, uint32, uint16, uint16, TCP_st_ConnOptions *);
+LOCAL void      acceptIncomingConn      (uint32, uint32, uint16, uint16, uint32, uint16, st_RXOptions *);
+LOCAL void      parseOptions            (uint8 *, uint8, st_RXOptions *);
+LOCAL uint16    getSendMss              (st_RXOptions *);
+LOCAL st_FastOpenCookie * getFastOpenCookie (uint32);
+LOCAL void      storeFastOpenCookie     (uint32, uint8 *, uint8);
+LOCAL uint16    getSynDataSpan          (st_OpenConnInfo *, uint8 **);
 
 
 
 
 /* ------------ Exported functions prototypes -------------- */
 
-/* open a new connection */
-EXPORTED boolean TCP_openConnection( TCP_ke_ConnIndex eConnIndex, uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint16 ui16SrcPort, uint16 ui16DstPort, boolean bKeepHalfOpen )
+/* open a new connection with default options. Return the allocated connection index or TCP_KE_NULL_CONN_INDEX on failure */
+EXPORTED TCP_ke_ConnIndex TCP_openConnection( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint16 ui16SrcPort, uint16 ui16DstPort, boolean bKeepHalfOpen )
 {
-    uint8 *pui8BufPtr;
-    boolean bSuccess;
+    TCP_st_ConnOptions stOptions;
 
-    /* alloc pointer */
-    pui8BufPtr = (uint8 *)MEM_MALLOC(US_MAX_RX_DATA_LENGTH_ALLOWED);
-    /* check pointer validity */
-    if(pui8BufPtr != NULL_PTR)
-    {
-        if( B_TRUE == bKeepHalfOpen)
-        {
-            /* keep the connection half open if needed */
-            stOpenConnInfo[eConnIndex].bKeepHalfOpen = B_TRUE;
-        }
-        else
-        {
-            /* any other values, do not keep the connection half open if needed. Close it. */
-            stOpenConnInfo[eConnIndex].bKeepHalfOpen = B_FALSE;
-        }
-        /* reset pending TX data length */
-        stOpenConnInfo[eConnIndex].ui16PendingTXDataLength = US_NULL;
-        /* set start RX data buffer pointer */
-        stOpenConnInfo[eConnIndex].pui8RXStartDataPtr = pui8BufPtr;
-        /* set RX data buffer pointer */
-        stOpenConnInfo[eConnIndex].pui8RXDataPtr = pui8BufPtr;
-        /* reset data length */
-        stOpenConnInfo[eConnIndex].ui16RXDataLength = US_NULL;
-        /* reset sent data length */
-        stOpenConnInfo[eConnIndex].ui16SentDataLength = US_NULL;
-        /* clear data availability flag */
-        stOpenConnInfo[eConnIndex].bNewRXAvailData = B_FALSE;
-        /* clear ACK number */
-        stOpenConnInfo[eConnIndex].ui32AckNumber = UL_NULL;
-        /* init the sequence number */
-        stOpenConnInfo[eConnIndex].ui32SeqNumber = ui32SequenceNumber;
-        /* update next sequence number */
-        UPDATE_SEQUENCE_NUMBER(ui32SequenceNumber);
+    /* default options but half open behaviour */
+    TCP_getDefaultConnOptions(&stOptions);
+    stOptions.bKeepHalfOpen = bKeepHalfOpen;
 
-        /* store all connections info in the next free position */
-        stOpenConnInfo[eConnIndex].ui16SrcPort = ui16SrcPort;
-        stOpenConnInfo[eConnIndex].ui16DstPort = ui16DstPort;
-        stOpenConnInfo[eConnIndex].ui32SrcIPAdd = ui32SrcIPAdd;
-        stOpenConnInfo[eConnIndex].ui32DstIPAdd = ui32DstIPAdd;
+    return TCP_openConnectionWithOptions(ui32SrcIPAdd, ui32DstIPAdd, ui16SrcPort, ui16DstPort, &stOptions);
+}
 
-        /* reset to CLOSED state */
-        stOpenConnInfo[eConnIndex].eCurrConnState = KE_CLOSED;
+
+/* open a new connection with the given options. Buffer lengths out of allowed values make it fail. Return the allocated connection index or TCP_KE_NULL_CONN_INDEX on failure */
+EXPORTED TCP_ke_ConnIndex TCP_openConnectionWithOptions( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint16 ui16SrcPort, uint16 ui16DstPort, TCP_st_ConnOptions *pstOptions )
+{
+    TCP_ke_ConnIndex eConnIndex;
+
+    /* create a CLOSED connection */
+    eConnIndex = (TCP_ke_ConnIndex)createConnection(ui32SrcIPAdd, ui32DstIPAdd, ui16SrcPort, ui16DstPort, pstOptions);
+    if(TCP_KE_NULL_CONN_INDEX != eConnIndex)
+    {
         /* request a OPEN command */
         stOpenConnInfo[eConnIndex].ePendingConnCommand = KE_COMM_OPEN;
-        
-        /* success to open the connection */
-        bSuccess = B_TRUE;
     }
     else
     {
         /* fail to open the connection */
-        bSuccess = B_FALSE;
     }
 
-    return bSuccess;
+    return eConnIndex;
 }
 
 
-/* close a connection */
-EXPORTED void TCP_closeConnection( TCP_ke_ConnIndex eConnIndex )
+/* get default connection options: they can be changed before calling TCP_openConnectionWithOptions */
+EXPORTED void TCP_getDefaultConnOptions( TCP_st_ConnOptions *pstOptions )
 {
-    /* request a CLOSE command */
-    stOpenConnInfo[eConnIndex].ePendingConnCommand = KE_COMM_CLOSE;
+    pstOptions->ui16RXBufferLength = US_DEFAULT_RX_BUFFER_LENGTH;
+    pstOptions->ui16TXBufferLength = US_DEFAULT_TX_BUFFER_LENGTH;
+    pstOptions->bKeepHalfOpen = B_FALSE;
+    pstOptions->bNoDelay = B_FALSE;
+    pstOptions->bFastOpen = B_FALSE;
+    pstOptions->bKeepAlive = B_FALSE;
+    pstOptions->ui32KeepAliveIdleMs = UL_KEEPALIVE_DEFAULT_IDLE_MS;
+    pstOptions->ui32KeepAliveIntvMs = UL_KEEPALIVE_DEFAULT_INTV_MS;
+    pstOptions->ui8KeepAliveProbesNum = UC_KEEPALIVE_DEFAULT_PROBES_NUM;
+    pstOptions->ui8MaxRetxNum = UC_DEFAULT_MAX_RETX_NUM;
 }
 
 
-/* store info to store a new connection */
-EXPORTED boolean TCP_sendData( TCP_ke_ConnIndex eConnIndex, uint8 *pui8DataBuf, uint16 ui16DataBufLength )
+/* start listening for incoming connections on a local port. Return the listener index or TCP_KE_NULL_LISTENER_INDEX on failure */
+EXPORTED TCP_ke_ListenerIndex TCP_listen( uint32 ui32LocalIPAdd, uint16 ui16LocalPort, uint8 ui8Backlog, boolean bKeepHalfOpen )
 {
-    boolean bSuccessOp = B_FALSE;
+    uint8 ui8Index;
+    TCP_ke_ListenerIndex eListenerIndex = TCP_KE_NULL_LISTENER_INDEX;
 
-    /* if connection is NOT CLOSED */
-    if( KE_CLOSED != stOpenConnInfo[eConnIndex].eCurrConnState )
+    /* look for a free listener. ATTENTION: a port shall not be listened twice */
+    for(ui8Index = UC_NULL; ui8Index < UC_NUM_OF_MAX_LISTENERS; ui8Index++)
     {
-        /* update TX data buffer */
-        stOpenConnInfo[eConnIndex].pui8TXDataPtr = pui8DataBuf;
+        if(B_TRUE == stListenerInfo[ui8Index].bInUse)
+        {
+            if(stListenerInfo[ui8Index].ui16LocalPort == ui16LocalPort)
+            {
+                /* port already listened: fail */
+                eListenerIndex = TCP_KE_NULL_LISTENER_INDEX;
+                break;
+            }
+            else
+            {
+                /* go on */
+            }
+        }
+        else if(TCP_KE_NULL_LISTENER_INDEX == eListenerIndex)
+        {
+            /* first free listener */
+            eListenerIndex = (TCP_ke_ListenerIndex)ui8Index;
+        }
+        else
+        {
+            /* free listener already found */
+        }
+    }
 
-        /* update pending TX data length */
-        stOpenConnInfo[eConnIndex].ui16PendingTXDataLength = ui16DataBufLength;
-        
-        /* success */
-        bSuccessOp = B_TRUE;
+    /* if a listener is available and backlog is valid */
+    if((TCP_KE_NULL_LISTENER_INDEX != eListenerIndex)
+    && (ui8Backlog > UC_NULL))
+    {
+        stListenerInfo[eListenerIndex].ui32LocalIPAdd = ui32LocalIPAdd;
+        stListenerInfo[eListenerIndex].ui16LocalPort = ui16LocalPort;
+        stListenerInfo[eListenerIndex].ui8Backlog = ui8Backlog;
+        stListenerInfo[eListenerIndex].ui8PendingConnNum = UC_NULL;
+        stListenerInfo[eListenerIndex].bKeepHalfOpen = bKeepHalfOpen;
+        stListenerInfo[eListenerIndex].bInUse = B_TRUE;
     }
     else
     {
-        /* connection is CLOSED -> FAIL! */
+        /* fail */
+        eListenerIndex = TCP_KE_NULL_LISTENER_INDEX;
     }
 
-    return bSuccessOp;
+    return eListenerIndex;
 }
 
 
-/* store info to store a new connection */
-EXPORTED void TCP_getReceivedData( TCP_ke_ConnIndex eConnIndex, uint8 *pui8DataBuf, uint16 *pui16DataBufLength )
+/* get an established incoming connection of a listener. Return TCP_KE_NULL_CONN_INDEX if none is ready */
+EXPORTED TCP_ke_ConnIndex TCP_accept( TCP_ke_ListenerIndex eListenerIndex )
 {
-    /* if there are available received data */
-    if(B_TRUE == stOpenConnInfo[eConnIndex].bNewRXAvailData)
-    {
-        /* copy received data into given buffer */
-        MEM_COPY(pui8DataBuf,
-                 stOpenConnInfo[eConnIndex].pui8RXStartDataPtr,
-                 stOpenConnInfo[eConnIndex].ui16RXDataLength);
-
-        /* copy RX data length. ATTENTION: it is supposed that data length is greater than zero */
-        *pui16DataBufLength = stOpenConnInfo[eConnIndex].ui16RXDataLength;
-
-        /* reset RX data pointer to the start value */
-        stOpenConnInfo[eConnIndex].pui8RXDataPtr = stOpenConnInfo[eConnIndex].pui8RXStartDataPtr;
+    uint8 ui8SlotIndex;
+    TCP_ke_ConnIndex eConnIndex = TCP_KE_NULL_CONN_INDEX;
 
-        /* reset RX data length */
-        stOpenConnInfo[eConnIndex].ui16RXDataLength = US_NULL;
-
-        /* clear flag */
-        stOpenConnInfo[eConnIndex].bNewRXAvailData = B_FALSE;
+    /* if listener is valid and it has pending connections */
+    if((eListenerIndex < TCP_KE_LISTENER_MAX_NUM)
+    && (B_TRUE == stListenerInfo[eListenerIndex].bInUse)
+    && (stListenerInfo[eListenerIndex].ui8PendingConnNum > UC_NULL))
+    {
+        /* look for a connection of this listener which completed the handshake */
+        for(ui8SlotIndex = UC_NULL; ui8SlotIndex < UC_NUM_OF_MAX_CONN; ui8SlotIndex++)
+        {
+            if((B_TRUE == stOpenConnInfo[ui8SlotIndex].bInUse)
+            && ((uint8)eListenerIndex == stOpenConnInfo[ui8SlotIndex].ui8ListenerIndex)
+            && (KE_SYN_RECEIVED != stOpenConnInfo[ui8SlotIndex].eCurrConnState)
+            && (KE_CLOSED != stOpenConnInfo[ui8SlotIndex].eCurrConnState))
+            {
+                /* hand the connection over to the application: it shall close it */
+                stOpenConnInfo[ui8SlotIndex].ui8ListenerIndex = (uint8)TCP_KE_NULL_LISTENER_INDEX;
+                stOpenConnInfo[ui8SlotIndex].bReleaseReq = B_FALSE;
+                stListenerInfo[eListenerIndex].ui8PendingConnNum--;
+                eConnIndex = (TCP_ke_ConnIndex)ui8SlotIndex;
+                break;
+            }
+            else
+            {
+                /* go on */
+            }
+        }
     }
     else
     {
-        /* no data */
-        *pui16DataBufLength = US_NULL;
+        /* no connections */
     }
+
+    return eConnIndex;
 }
 
 
-/* manage TCP module periodically */
-EXPORTED void TCP_PeriodicTask( void )
+/* stop listening. Not yet accepted connections are aborted */
+EXPORTED void TCP_closeListener( TCP_ke_ListenerIndex eListenerIndex )
 {
-    uint8 ui8ConnCount;
+    uint8 ui8SlotIndex;
 
-    /* manage all connections */
-    for(ui8ConnCount = UC_NULL; ui8ConnCount < UC_NUM_OF_MAX_CONN; ui8ConnCount++)
+    /* if listener is valid */
+    if((eListenerIndex < TCP_KE_LISTENER_MAX_NUM)
+    && (B_TRUE == stListenerInfo[eListenerIndex].bInUse))
     {
-        if((KE_ESTABLISHED == stOpenConnInfo[ui8ConnCount].eCurrConnState)
-        || (KE_HALF_OPEN == stOpenConnInfo[ui8ConnCount].eCurrConnState))
+        /* abort all pending connections. They are released at next periodic task */
+        for(ui8SlotIndex = UC_NULL; ui8SlotIndex < UC_NUM_OF_MAX_CONN; ui8SlotIndex++)
         {
-            if( KE_COMM_CLOSE == stOpenConnInfo[ui8ConnCount].ePendingConnCommand )
+            if((B_TRUE == stOpenConnInfo[ui8SlotIndex].bInUse)
+            && ((uint8)eListenerIndex == stOpenConnInfo[ui8SlotIndex].ui8ListenerIndex))
             {
-                /* update next pending sequence number increment */
-                stOpenConnInfo[ui8ConnCount].ui16SentDataLength = UC_1;
-
-                prepareAndSendMsg(&stOpenConnInfo[ui8ConnCount], KE_MSG_FIN, NULL_PTR, US_NULL);
-
-                if(KE_ESTABLISHED == stOpenConnInfo[ui8ConnCount].eCurrConnState)
-                {
-                    stOpenConnInfo[ui8ConnCount].eCurrConnState = KE_WAIT_FIN_ACK;
-                }
-                else    /* KE_HALF_OPEN */
-                {
-                    stOpenConnInfo[ui8ConnCount].eCurrConnState = KE_WAIT_LAST_ACK;
-                }
-
-                /* clear pending command */
-                stOpenConnInfo[ui8ConnCount].ePendingConnCommand = KE_NO_COMMAND;
+                abortConnection(&stOpenConnInfo[ui8SlotIndex], TCP_KE_ERR_NONE);
+                stOpenConnInfo[ui8SlotIndex].ui8ListenerIndex = (uint8)TCP_KE_NULL_LISTENER_INDEX;
             }
             else
             {
-                /* if there are still pending data */
-                if( stOpenConnInfo[ui8ConnCount].ui16PendingTXDataLength > US_NULL )
-                {
-                    /* update sent data length */
-                    if( stOpenConnInfo[ui8ConnCount].ui16PendingTXDataLength > US_MAX_TX_DATA_LENGTH_ALLOWED )
-                    {
-                        stOpenConnInfo[ui8ConnCount].ui16SentDataLength = US_MAX_TX_DATA_LENGTH_ALLOWED;
-                    }
-                    else
-                    {
-                        stOpenConnInfo[ui8ConnCount].ui16SentDataLength = stOpenConnInfo[ui8ConnCount].ui16PendingTXDataLength;
-                    }
+                /* go on */
+            }
+        }
 
-                    /* prepare and send a data message */
-                    prepareAndSendMsg(&stOpenConnInfo[ui8ConnCount], KE_MSG_DATA, stOpenConnInfo[ui8ConnCount].pui8TXDataPtr, stOpenConnInfo[ui8ConnCount].ui16SentDataLength);
+        /* listener is free */
+        stListenerInfo[eListenerIndex].bInUse = B_FALSE;
+    }
+    else
+    {
+        /* invalid listener: do nothing */
+    }
+}
 
-                    if(KE_ESTABLISHED == stOpenConnInfo[ui8ConnCount].eCurrConnState)
-                    {
-                        stOpenConnInfo[ui8ConnCount].eCurrConnState = KE_ESTAB_WAIT_ACK;
-                    }
-                    else    /* KE_HALF_OPEN */
-                    {
-                        stOpenConnInfo[ui8ConnCount].eCurrConnState = KE_HALF_OPEN_WAIT_ACK;
-                    }
-                }
-                else
-                {
-                    /* do nothing */
-                }
-            }
+
+/* close a connection. Its index is no longer valid after this call: the slot is released once the connection is CLOSED */
+EXPORTED void TCP_closeConnection( TCP_ke_ConnIndex eConnIndex )
+{
+    /* if connection index is valid and allocated */
+    if(IS_CONN_ALLOCATED(eConnIndex))
+    {
+        /* request a CLOSE command */
+        stOpenConnInfo[eConnIndex].ePendingConnCommand = KE_COMM_CLOSE;
+        /* release the slot once closed */
+        stOpenConnInfo[eConnIndex].bReleaseReq = B_TRUE;
+    }
+    else
+    {
+        /* invalid connection: do nothing */
+    }
+}
+
+
+/* append data to the TX buffer of a connection. Return the accepted length: given buffer can be reused at return */
+EXPORTED uint16 TCP_sendData( TCP_ke_ConnIndex eConnIndex, uint8 *pui8DataBuf, uint16 ui16DataBufLength )
+{
+    st_OpenConnInfo *pstConnInfo = &stOpenConnInfo[eConnIndex];
+    uint16 ui16WriteIndex;
+    uint16 ui16SpanLength;
+
+    /* if connection is valid, it is opening or open, a FIN has not been sent and a close is not requested */
+    if(IS_CONN_ALLOCATED(eConnIndex)
+    && ((( KE_CLOSED == pstConnInfo->eCurrConnState ) && ( KE_COMM_OPEN == pstConnInfo->ePendingConnCommand ))
+     || ((( KE_WAIT_SYN_ACK == pstConnInfo->eCurrConnState )
+       || ( KE_SYN_RECEIVED == pstConnInfo->eCurrConnState )
+       || ( KE_ESTABLISHED == pstConnInfo->eCurrConnState )
+       || ( KE_HALF_OPEN == pstConnInfo->eCurrConnState ))
+      && ( KE_COMM_CLOSE != pstConnInfo->ePendingConnCommand ))))
+    {
+        /* accept data up to free space */
+        if(ui16DataBufLength > GET_TX_FREE_SPACE(pstConnInfo))
+        {
+            ui16DataBufLength = GET_TX_FREE_SPACE(pstConnInfo);
         }
-        else if(KE_CLOSED == stOpenConnInfo[ui8ConnCount].eCurrConnState)
+        else
         {
-            if( KE_COMM_OPEN == stOpenConnInfo[ui8ConnCount].ePendingConnCommand )
-            {
-                /* update next pending sequence number increment */
-                stOpenConnInfo[ui8ConnCount].ui16SentDataLength = UC_1;
-
-                prepareAndSendMsg(&stOpenConnInfo[ui8ConnCount], KE_MSG_SYN, NULL_PTR, US_NULL);
+            /* all data fit */
+        }
 
-                stOpenConnInfo[ui8ConnCount].eCurrConnState = KE_WAIT_SYN_ACK;
+        /* get write index: it follows the last pending byte */
+        ui16WriteIndex = (uint16)(pstConnInfo->ui16TXReadIndex + pstConnInfo->ui16PendingTXDataLength);
+        if(ui16WriteIndex >= pstConnInfo->ui16TXBufferLength)
+        {
+            ui16WriteIndex -= pstConnInfo->ui16TXBufferLength;
+        }
+        else
+        {
+            /* no wrap around */
+        }
 
-                /* clear pending command */
-                stOpenConnInfo[ui8ConnCount].ePendingConnCommand = KE_NO_COMMAND;
-            }
-            else
-            {
-                /* do nothing */
-            }
+        /* get length up to the end of the buffer */
+        ui16SpanLength = (uint16)(pstConnInfo->ui16TXBufferLength - ui16WriteIndex);
+        if(ui16SpanLength >= ui16DataBufLength)
+        {
+            /* all data fit before the end of the buffer */
+            MEM_COPY(&pstConnInfo->pui8TXBufferPtr[ui16WriteIndex], pui8DataBuf, ui16DataBufLength);
         }
         else
         {
-            /* do nothing */
+            /* data wrap around: copy the first part until the end of the buffer and the rest from its start */
+            MEM_COPY(&pstConnInfo->pui8TXBufferPtr[ui16WriteIndex], pui8DataBuf, ui16SpanLength);
+            MEM_COPY(pstConnInfo->pui8TXBufferPtr, &pui8DataBuf[ui16SpanLength], (ui16DataBufLength - ui16SpanLength));
         }
+
+        /* update pending TX data length. Data are sent by the periodic task */
+        pstConnInfo->ui16PendingTXDataLength += ui16DataBufLength;
+    }
+    else
+    {
+        /* connection is invalid, CLOSED or closing -> FAIL! */
+        ui16DataBufLength = US_NULL;
     }
+
+    return ui16DataBufLength;
 }
 
 
-/* unpack TCP messages */
-EXPORTED void TCP_unpackMessage( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint8 *pui8DataPtr, uint16 ui16MsgLength )
+/* enable or disable small segments coalescing (Nagle algorithm) of a connection */
+EXPORTED void TCP_setNoDelay( TCP_ke_ConnIndex eConnIndex, boolean bNoDelay )
 {
-    uint32 *pui32HdrPtr;
-    uint32 ui32HdrWord;
-    uint8 ui8SocketIndex;
-    uint16 ui16SrcPort;
-    uint16 ui16DstPort;
-    uint32 ui32SeqNumber;
-    uint32 ui32AckNumber;
-    uint8 ui8DataOffset;
-    uint32 ui32FlagsWord;
-    //uint32 ui32ChecksumValue;
+    if(!IS_CONN_ALLOCATED(eConnIndex))
+    {
+        /* invalid connection: do nothing */
+    }
+    else if(B_TRUE == bNoDelay)
+    {
+        /* send small segments immediately */
+        stOpenConnInfo[eConnIndex].bNoDelay = B_TRUE;
+    }
+    else
+    {
+        /* any other values, coalesce small segments */
+        stOpenConnInfo[eConnIndex].bNoDelay = B_FALSE;
+    }
+}
 
-    /* set 32-bit header pointer */
-    pui32HdrPtr = (uint32 *)pui8DataPtr;
 
-    /* get src and dst ports */
-    READ_32BIT_AND_NEXT(pui32HdrPtr, ui32HdrWord);
-    ui16SrcPort = GET_HDR_SRC_PORT(ui32HdrWord);
-    ui16DstPort = GET_HDR_DST_PORT(ui32HdrWord);
+/* enable TCP Fast Open on a connection before it is open: data passed to TCP_sendData before the SYN is sent go with it if a cookie of the server is cached. A cookie is requested otherwise */
+EXPORTED void TCP_setFastOpen( TCP_ke_ConnIndex eConnIndex, boolean bFastOpen )
+{
+    if(!IS_CONN_ALLOCATED(eConnIndex))
+    {
+        /* invalid connection: do nothing */
+    }
+    else if(B_TRUE == bFastOpen)
+    {
+        /* use Fast Open */
+        stOpenConnInfo[eConnIndex].bFastOpen = B_TRUE;
+    }
+    else
+    {
+        /* any other values, open with a normal handshake */
+        stOpenConnInfo[eConnIndex].bFastOpen = B_FALSE;
+    }
+}
 
-    /* ATTENTION: manage open active connections only - NO listeners */
-    /* get socket id from src and dst addresses and ports */
-    ui8SocketIndex = getSocketIndex(ui32SrcIPAdd, ui32DstIPAdd, ui16SrcPort, ui16DstPort);
-    if(ui8SocketIndex < UC_NUM_OF_MAX_CONN)
-    {
-        /* get the sequence number */
-        READ_32BIT_AND_NEXT(pui32HdrPtr, ui32HdrWord);
-        ui32SeqNumber = GET_HDR_SEQ_NUM(ui32HdrWord);
-        /* get the ACK number */
-        READ_32BIT_AND_NEXT(pui32HdrPtr, ui32HdrWord);
-        ui32AckNumber = GET_HDR_ACK_NUM(ui32HdrWord);
-        /* get data offset, flags and windows size */
-        READ_32BIT_AND_NEXT(pui32HdrPtr, ui32HdrWord);
-        ui8DataOffset = GET_HDR_DATA_OFF(ui32HdrWord);  /* get data offset */
-        ui32FlagsWord = ui32HdrWord;    /* copy word for flags check */
-        //ui32ReadValue = GET_HDR_WINDOW_SIZE(ui32HdrWord);   /* get window size */
-        /* get checksum and urgent pointer */
-        READ_32BIT_AND_NEXT(pui32HdrPtr, ui32HdrWord);
-        //ui32ChecksumValue = GET_HDR_CHECKSUM(ui32HdrWord);  /* TODO: checksum not verified at the moment */
-        //ui32ReadValue = GET_HDR_URG_PTR(ui32HdrWord);   /* get urgent pointer */
 
-        /* check ACK packet */
-        if( UC_1 == GET_HDR_ACK_BIT(ui32FlagsWord) )
-        {
-            /* check ACK number  */
-            if((stOpenConnInfo[ui8SocketIndex].ui32SeqNumber + stOpenConnInfo[ui8SocketIndex].ui16SentDataLength) == ui32AckNumber)
-            {
-                /* increment the sequence number */
-                stOpenConnInfo[ui8SocketIndex].ui32SeqNumber += stOpenConnInfo[ui8SocketIndex].ui16SentDataLength;
-                /* if FIN message */
-                if( UC_1 == GET_HDR_FIN_BIT(ui32FlagsWord) )
-                {
-                    /* if connection is in ESTABLISHED state */
-                    if(KE_ESTABLISHED == stOpenConnInfo[ui8SocketIndex].eCurrConnState)
-                    {
-                        /* connection is now HALF OPEN */
-                        stOpenConnInfo[ui8SocketIndex].eCurrConnState = KE_HALF_OPEN;
-                        /* if connection can not be left in HALF OPEN state */
-                        if( B_FALSE == stOpenConnInfo[ui8SocketIndex].bKeepHalfOpen )
-                        {
-                            /* request to close it */
-                            stOpenConnInfo[ui8SocketIndex].ePendingConnCommand = KE_COMM_CLOSE;
-                        }
-                        else
-                        {
-                            /* leave it HALF OPEN */
-                        }
-                    }
-                    /* else if connection is HALF CLOSED or it is awaiting for ACK to a FIN message */
-                    else if((KE_HALF_CLOSED == stOpenConnInfo[ui8SocketIndex].eCurrConnState)
-                         || (KE_WAIT_FIN_ACK == stOpenConnInfo[ui8SocketIndex].eCurrConnState))
-                    {
-                        /* connection is now CLOSED */
-                        stOpenConnInfo[ui8SocketIndex].eCurrConnState = KE_CLOSED;
-                    }
-                    else
-                    {
-                        /* unexpected FIN message, ignore it but send back an ACK anyway */
-                    }
-                    /* update ACK number */
-                    stOpenConnInfo[ui8SocketIndex].ui32AckNumber = ui32SeqNumber + UC_1;
-                    /* send a ACK message */
-                    prepareAndSendMsg(&stOpenConnInfo[ui8SocketIndex], KE_MSG_ACK, NULL_PTR, US_NULL);
-                }
-                /* else SYN message */
-                else if( UC_1 == GET_HDR_SYN_BIT(ui32FlagsWord) )
+/* set the callback notifying events of a connection. NULL_PTR to remove it. ATTENTION: it is called within TCP processing, keep it short */
+EXPORTED void TCP_setEventCallback( TCP_ke_ConnIndex eConnIndex, TCP_event_cb_ptr_t pvEventCallback )
+{
+    /* if connection index is valid and allocated */
+    if(IS_CONN_ALLOCATED(eConnIndex))
+    {
+        stOpenConnInfo[eConnIndex].pvEventCallback = pvEventCallback;
+    }
+    else
+    {
+        /* invalid connection: do nothing */
+    }
+}
+
+
+/* configure keepalive probes of a connection: idle time before the first probe, interval between probes and number of unanswered probes before declaring the peer dead */
+EXPORTED void TCP_setKeepAlive( TCP_ke_ConnIndex eConnIndex, boolean bEnable, uint32 ui32IdleMs, uint32 ui32IntervalMs, uint8 ui8ProbesNum )
+{
+    st_OpenConnInfo *pstConnInfo = &stOpenConnInfo[eConnIndex];
+
+    /* if connection index is valid and allocated */
+    if(IS_CONN_ALLOCATED(eConnIndex))
+    {
+        /* store configuration */
+        pstConnInfo->ui32KeepAliveIdleMs = ui32IdleMs;
+        pstConnInfo->ui32KeepAliveIntvMs = ui32IntervalMs;
+        pstConnInfo->ui8KeepAliveProbesNum = ui8ProbesNum;
+
+        /* restart idle time counting */
+        pstConnInfo->ui32KeepAliveTimerMs = ui32IdleMs;
+        pstConnInfo->ui8KeepAliveProbeCount = UC_NULL;
+
+        if(B_TRUE == bEnable)
+        {
+            /* send probes on idle connection */
+            pstConnInfo->bKeepAlive = B_TRUE;
+        }
+        else
+        {
+            /* any other values, keepalive is disabled */
+            pstConnInfo->bKeepAlive = B_FALSE;
+        }
+    }
+    else
+    {
+        /* invalid connection: do nothing */
+    }
+}
+
+
+/* get all received data copying them into the given buffer. ATTENTION: buffer shall be as long as the connection RX buffer at least */
+EXPORTED void TCP_getReceivedData( TCP_ke_ConnIndex eConnIndex, uint8 *pui8DataBuf, uint16 *pui16DataBufLength )
+{
+    uint8 *pui8SpanPtr;
+    uint16 ui16SpanLength;
+    uint16 ui16CopiedLength = US_NULL;
+
+    /* copy received data span by span: two spans at most if data wrap around the end of the buffer */
+    ui16SpanLength = TCP_peekReceivedData(eConnIndex, &pui8SpanPtr);
+    while(ui16SpanLength > US_NULL)
+    {
+        /* copy this span into given buffer */
+        MEM_COPY(&pui8DataBuf[ui16CopiedLength], pui8SpanPtr, ui16SpanLength);
+        ui16CopiedLength += ui16SpanLength;
+
+        /* release copied data and get the next span */
+        TCP_consumeReceivedData(eConnIndex, ui16SpanLength);
+        ui16SpanLength = TCP_peekReceivedData(eConnIndex, &pui8SpanPtr);
+    }
+
+    /* return copied data length */
+    *pui16DataBufLength = ui16CopiedLength;
+}
+
+
+/* get a pointer to the oldest unread received data without copying them. Return the contiguous readable length */
+EXPORTED uint16 TCP_peekReceivedData( TCP_ke_ConnIndex eConnIndex, uint8 **ppui8DataPtr )
+{
+    st_OpenConnInfo *pstConnInfo = &stOpenConnInfo[eConnIndex];
+    uint16 ui16SpanLength;
+
+    /* if connection index is not valid or not allocated */
+    if(!IS_CONN_ALLOCATED(eConnIndex))
+    {
+        /* no data */
+        ui16SpanLength = US_NULL;
+    }
+    else
+    {
+        /* contiguous data end at the end of the buffer at most */
+        ui16SpanLength = (uint16)(pstConnInfo->ui16RXBufferLength - pstConnInfo->ui16RXReadIndex);
+        if(ui16SpanLength > pstConnInfo->ui16RXDataLength)
+        {
+            /* data do not wrap around */
+            ui16SpanLength = pstConnInfo->ui16RXDataLength;
+        }
+        else
+        {
+            /* data wrap around: remaining ones are available at next peek */
+        }
+    }
+
+    /* if there are data */
+    if(ui16SpanLength > US_NULL)
+    {
+        /* return pointer to the oldest unread byte */
+        *ppui8DataPtr = &pstConnInfo->pui8RXBufferPtr[pstConnInfo->ui16RXReadIndex];
+    }
+    else
+    {
+        /* no data */
+        *ppui8DataPtr = NULL_PTR;
+    }
+
+    return ui16SpanLength;
+}
+
+
+/* release the given length of read data. The advertised window grows accordingly */
+EXPORTED void TCP_consumeReceivedData( TCP_ke_ConnIndex eConnIndex, uint16 ui16DataLength )
+{
+    st_OpenConnInfo *pstConnInfo = &stOpenConnInfo[eConnIndex];
+
+    /* if connection index is not valid or not allocated */
+    if(!IS_CONN_ALLOCATED(eConnIndex))
+    {
+        /* nothing to release */
+        ui16DataLength = US_NULL;
+    }
+    /* else limit length to the available data */
+    else if(ui16DataLength > pstConnInfo->ui16RXDataLength)
+    {
+        ui16DataLength = pstConnInfo->ui16RXDataLength;
+    }
+    else
+    {
+        /* length is valid */
+    }
+
+    /* if there are data to release */
+    if(ui16DataLength > US_NULL)
+    {
+        /* move on read index wrapping around the end of the buffer */
+        pstConnInfo->ui16RXReadIndex += ui16DataLength;
+        if(pstConnInfo->ui16RXReadIndex >= pstConnInfo->ui16RXBufferLength)
+        {
+            pstConnInfo->ui16RXReadIndex -= pstConnInfo->ui16RXBufferLength;
+        }
+        else
+        {
+            /* no wrap around */
+        }
+
+        /* decrement unread data length */
+        pstConnInfo->ui16RXDataLength -= ui16DataLength;
+    }
+    else
+    {
+        /* nothing to do */
+    }
+}
+
+
+/* get statistics of a connection: counters since its opening and current state, RTT and windows */
+EXPORTED void TCP_getConnStats( TCP_ke_ConnIndex eConnIndex, TCP_st_ConnStats *pstConnStats )
+{
+    st_OpenConnInfo *pstConnInfo = &stOpenConnInfo[eConnIndex];
+
+    /* if connection index is valid and allocated */
+    if(IS_CONN_ALLOCATED(eConnIndex))
+    {
+        /* copy counters */
+        *pstConnStats = pstConnInfo->stStats;
+
+        /* fill current values */
+        pstConnStats->eState = (TCP_ke_ConnState)pstConnInfo->eCurrConnState;
+        pstConnStats->ui32SmoothRttMs = pstConnInfo->ui32SmoothRttMs;
+        pstConnStats->ui32RttVarMs = pstConnInfo->ui32RttVarMs;
+        pstConnStats->ui32RtoMs = pstConnInfo->ui32RtoMs;
+        pstConnStats->ui32CongWindow = pstConnInfo->ui32CongWindow;
+        pstConnStats->ui16PeerWindowSize = pstConnInfo->ui16PeerWindowSize;
+        pstConnStats->ui16SendMss = pstConnInfo->ui16SendMss;
+        pstConnStats->ui16RXDataLength = pstConnInfo->ui16RXDataLength;
+        pstConnStats->ui16PendingTXDataLength = pstConnInfo->ui16PendingTXDataLength;
+    }
+    else
+    {
+        /* invalid connection: no counters and CLOSED state */
+        MEM_SET(pstConnStats, UC_NULL, sizeof(TCP_st_ConnStats));
+        pstConnStats->eState = TCP_KE_STATE_CLOSED;
+    }
+}
+
+
+/* get the last error occurred on a connection */
+EXPORTED TCP_ke_ConnError TCP_getConnError( TCP_ke_ConnIndex eConnIndex )
+{
+    TCP_ke_ConnError eConnError;
+
+    /* if connection index is valid and allocated */
+    if(IS_CONN_ALLOCATED(eConnIndex))
+    {
+        eConnError = stOpenConnInfo[eConnIndex].eConnError;
+    }
+    else
+    {
+        /* invalid connection */
+        eConnError = TCP_KE_ERR_INVALID_CONN;
+    }
+
+    return eConnError;
+}
+
+
+/* manage TCP module periodically */
+EXPORTED void TCP_PeriodicTask( void )
+{
+    uint8 ui8ConnCount;
+    st_OpenConnInfo *pstConnInfo;
+    uint8 *pui8SynDataPtr;
+
+    /* manage all connections */
+    for(ui8ConnCount = UC_NULL; ui8ConnCount < UC_NUM_OF_MAX_CONN; ui8ConnCount++)
+    {
+        /* get connection info pointer */
+        pstConnInfo = &stOpenConnInfo[ui8ConnCount];
+
+        /* manage retransmission timer first: retransmitted segments take precedence */
+        manageRetxTimer(pstConnInfo);
+
+        /* if acknowledged data space is held and no more segments reference TX buffer data */
+        if((pstConnInfo->ui16TXHeldLength > US_NULL)
+        && (UC_NULL == pstConnInfo->ui8TXDataRefNum))
+        {
+            /* give it back */
+            pstConnInfo->ui16TXHeldLength = US_NULL;
+            notifyEvent(pstConnInfo, TCP_KE_EVT_SEND_SPACE);
+        }
+        else
+        {
+            /* no space to give back */
+        }
+
+        if(B_TRUE != pstConnInfo->bInUse)
+        {
+            /* free slot: do nothing */
+        }
+        else if((KE_ESTABLISHED == pstConnInfo->eCurrConnState)
+        || (KE_HALF_OPEN == pstConnInfo->eCurrConnState))
+        {
+            /* if a close is requested and all sent data have been acknowledged */
+            if(( KE_COMM_CLOSE == pstConnInfo->ePendingConnCommand )
+            && ( US_NULL == pstConnInfo->ui16PendingTXDataLength ))
+            {
+                /* send a FIN message. ATTENTION: do it before updating sent data length */
+                if(B_TRUE == prepareAndSendMsg(pstConnInfo, KE_MSG_FIN, GET_SND_NEXT(pstConnInfo), NULL_PTR, US_NULL))
                 {
-                    /* if it is awaiting for an ACK of a SYN message */
-                    if(KE_WAIT_SYN_ACK == stOpenConnInfo[ui8SocketIndex].eCurrConnState)
+                    /* FIN message takes one sequence number */
+                    pstConnInfo->ui16SentDataLength = UC_1;
+                    /* FIN shall be acknowledged: start retransmission timer */
+                    startRetxTimer(pstConnInfo, pstConnInfo->ui32SeqNumber);
+
+                    if(KE_ESTABLISHED == pstConnInfo->eCurrConnState)
                     {
-                        /* connection is now ESTABLISHED */
-                        stOpenConnInfo[ui8SocketIndex].eCurrConnState = KE_ESTABLISHED;
-                        /* update ACK number */
-                        stOpenConnInfo[ui8SocketIndex].ui32AckNumber = ui32SeqNumber + UC_1;
-                        /* send an ACK message */
-                        prepareAndSendMsg(&stOpenConnInfo[ui8SocketIndex], KE_MSG_ACK, NULL_PTR, US_NULL);
+                        pstConnInfo->eCurrConnState = KE_WAIT_FIN_ACK;
                     }
-                    else
+                    else    /* KE_HALF_OPEN */
                     {
-                        /* unexpected SYN, ignore it and do NOT send back an ACK */
+                        pstConnInfo->eCurrConnState = KE_WAIT_LAST_ACK;
                     }
+
+                    /* clear pending command */
+                    pstConnInfo->ePendingConnCommand = KE_NO_COMMAND;
                 }
                 else
                 {
-                    /* if it was awaiting for a ACK to a previous FYN message */
-                    if( KE_WAIT_FIN_ACK == stOpenConnInfo[ui8SocketIndex].eCurrConnState )
-                    {
-                        /* connection is now HALF CLOSED */
-                        stOpenConnInfo[ui8SocketIndex].eCurrConnState = KE_HALF_CLOSED;
-                    }
-                    /* else if it was awaiting for a last ACK message */
-                    else if( KE_WAIT_LAST_ACK == stOpenConnInfo[ui8SocketIndex].eCurrConnState )
-                    {
-                        /* connection is now CLOSED */
-                        stOpenConnInfo[ui8SocketIndex].eCurrConnState = KE_CLOSED;
-                    }
-                    else
-                    {
-                        /* calculate data length */
-                        ui16MsgLength -= (ui8DataOffset * UC_4);
-                        /* call local function to get received data */
-                        getReceivedData(ui8SocketIndex, pui32HdrPtr, ui16MsgLength);
-                        /* update ACK number */
-                        stOpenConnInfo[ui8SocketIndex].ui32AckNumber = (uint32)(ui32SeqNumber + ui16MsgLength);
-                        /* if it was a awaiting for an ACK of a previous sent data packet */
-                        if((KE_ESTAB_WAIT_ACK == stOpenConnInfo[ui8SocketIndex].eCurrConnState)
-                        || (KE_HALF_OPEN_WAIT_ACK == stOpenConnInfo[ui8SocketIndex].eCurrConnState))
-                        {
-                            /* ACK received. decrement pending data length */
-                            stOpenConnInfo[ui8SocketIndex].ui16PendingTXDataLength -= stOpenConnInfo[ui8SocketIndex].ui16SentDataLength;
-                            /* move on TX data pointer */
-                            stOpenConnInfo[ui8SocketIndex].pui8TXDataPtr += stOpenConnInfo[ui8SocketIndex].ui16SentDataLength;
-
-                            if(KE_ESTAB_WAIT_ACK == stOpenConnInfo[ui8SocketIndex].eCurrConnState)
-                            {
-                                stOpenConnInfo[ui8SocketIndex].eCurrConnState = KE_ESTABLISHED;
-                            }
-                            else    /* KE_HALF_OPEN_WAIT_ACK */
-                            {
-                                stOpenConnInfo[ui8SocketIndex].eCurrConnState = KE_HALF_OPEN;
-                            }
-                        }
-                        /* else a data packet has been received from other end-point */
-                        else
-                        {
-                            /* do nothing in particular */
-                        }
-                        /* send back a ACK anyway */
-                        prepareAndSendMsg(&stOpenConnInfo[ui8SocketIndex], KE_MSG_ACK, NULL_PTR, US_NULL);
-                    }
+                    /* IP buffer is busy: try again at next run */
                 }
-                /* clear sent data length */
-                stOpenConnInfo[ui8SocketIndex].ui16SentDataLength = US_NULL;
             }
             else
             {
-                /* ACK number is wrong, send a RESET message */
-                prepareAndSendMsg(&stOpenConnInfo[ui8SocketIndex], KE_MSG_RST, NULL_PTR, US_NULL);
-                /* close connection at the moment */
-                stOpenConnInfo[ui8SocketIndex].eCurrConnState = KE_CLOSED;
+                /* send pending data as long as the send window allows it */
+                sendPendingData(pstConnInfo);
+                /* probe the peer window if it is closed */
+                managePersistTimer(pstConnInfo);
+            }
+        }
+        else if(KE_CLOSED == pstConnInfo->eCurrConnState)
+        {
+            /* if the connection has been closed on request */
+            if( B_TRUE == pstConnInfo->bReleaseReq )
+            {
+                /* give back the slot */
+                releaseConnSlot(ui8ConnCount);
+            }
+            else if( KE_COMM_OPEN == pstConnInfo->ePendingConnCommand )
+            {
+                /* get data to send with the SYN, if Fast Open allows it */
+                pstConnInfo->ui16SynDataLength = getSynDataSpan(pstConnInfo, &pui8SynDataPtr);
+                pstConnInfo->ui16SynDataSentLength = pstConnInfo->ui16SynDataLength;
+
+                /* update next pending sequence number increment: SYN and its data */
+                pstConnInfo->ui16SentDataLength = (uint16)(UC_1 + pstConnInfo->ui16SynDataLength);
+
+                prepareAndSendMsg(pstConnInfo, KE_MSG_SYN, pstConnInfo->ui32SeqNumber, pui8SynDataPtr, pstConnInfo->ui16SynDataLength);
+
+                /* SYN shall be acknowledged: start retransmission timer. A failed send is retransmitted at timer expiry */
+                startRetxTimer(pstConnInfo, pstConnInfo->ui32SeqNumber);
+
+                pstConnInfo->eCurrConnState = KE_WAIT_SYN_ACK;
+
+                /* clear pending command */
+                pstConnInfo->ePendingConnCommand = KE_NO_COMMAND;
+            }
+            else
+            {
+                /* do nothing */
+            }
+        }
+        else
+        {
+            /* do nothing */
+        }
+
+        /* send any delayed ACK not piggybacked on outgoing segments and any window update */
+        if(B_TRUE == pstConnInfo->bInUse)
+        {
+            manageDelAckTimer(pstConnInfo);
+            manageWindowUpdate(pstConnInfo);
+            /* probe the peer if the connection is idle */
+            manageKeepAlive(pstConnInfo);
+        }
+        else
+        {
+            /* free slot */
+        }
+    }
+}
+
+
+/* unpack TCP messages */
+EXPORTED void TCP_unpackMessage( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint8 *pui8DataPtr, uint16 ui16MsgLength, uint8 ui8Ecn, uint32 ui32DataSum )
+{
+    uint32 *pui32HdrPtr;
+    uint32 ui32HdrWord;
+    uint8 ui8SocketIndex;
+    uint16 ui16SrcPort;
+    uint16 ui16DstPort;
+    uint32 ui32SeqNumber;
+    uint32 ui32AckNumber;
+    uint32 ui32AckedLength;
+    uint8 ui8DataOffset;
+    uint32 ui32FlagsWord;
+    uint16 ui16WindowSize;
+    st_OpenConnInfo *pstConnInfo;
+    IPv4_st_PacketDescriptor stIPv4PacketDscpt;
+    uint16 ui16Checksum;
+    uint16 ui16DataLength;
+    boolean bDupAck;
+    boolean bRSTValid;
+    boolean bSynchronized;
+    boolean bSegmentValid;
+    uint16 ui16SynDataAckedLength;
+    st_RXOptions stRXOptions;
+
+    /* if whole segment has not been summed by hardware */
+    if(IPV4_UL_NO_DATA_SUM == ui32DataSum)
+    {
+        /* sum it by software */
+        ui32DataSum = IPV4_copyAndSum(NULL_PTR, pui8DataPtr, ui16MsgLength, UL_NULL);
+    }
+    else
+    {
+        /* segment sum is ready */
+    }
+
+    /* add pseudo header sum for checksum verification */
+    stIPv4PacketDscpt.enProtocol = IPV4_PROT_TCP;
+    stIPv4PacketDscpt.ui16DataLength = ui16MsgLength;
+    stIPv4PacketDscpt.ui32IPSrcAddress = ui32SrcIPAdd;
+    stIPv4PacketDscpt.ui32IPDstAddress = ui32DstIPAdd;
+    ui16Checksum = IPV4_foldChecksum(ui32DataSum + IPV4_getPseudoHdrSum(&stIPv4PacketDscpt));
+
+    /* set 32-bit header pointer */
+    pui32HdrPtr = (uint32 *)pui8DataPtr;
+
+    /* get src and dst ports */
+    READ_32BIT_AND_NEXT(pui32HdrPtr, ui32HdrWord);
+    ui16SrcPort = GET_HDR_SRC_PORT(ui32HdrWord);
+    ui16DstPort = GET_HDR_DST_PORT(ui32HdrWord);
+
+    /* get the sequence number */
+    READ_32BIT_AND_NEXT(pui32HdrPtr, ui32HdrWord);
+    ui32SeqNumber = GET_HDR_SEQ_NUM(ui32HdrWord);
+    /* get the ACK number */
+    READ_32BIT_AND_NEXT(pui32HdrPtr, ui32HdrWord);
+    ui32AckNumber = GET_HDR_ACK_NUM(ui32HdrWord);
+    /* get data offset, flags and windows size */
+    READ_32BIT_AND_NEXT(pui32HdrPtr, ui32HdrWord);
+    ui8DataOffset = GET_HDR_DATA_OFF(ui32HdrWord);  /* get data offset */
+    ui32FlagsWord = ui32HdrWord;    /* copy word for flags check */
+    ui16WindowSize = GET_HDR_WINDOW_SIZE(ui32FlagsWord);   /* get window size */
+    /* get checksum and urgent pointer */
+    READ_32BIT_AND_NEXT(pui32HdrPtr, ui32HdrWord);
+    /* checksum has been already summed */
+    //ui32ReadValue = GET_HDR_URG_PTR(ui32HdrWord);   /* get urgent pointer */
+
+    /* if header length is valid */
+    if((ui8DataOffset >= UC_TCP_HDR_MIN_LENGTH_WORDS)
+    && ((uint16)(ui8DataOffset * UC_4) <= ui16MsgLength))
+    {
+        /* parse options following the fixed header */
+        parseOptions((uint8 *)pui32HdrPtr, (uint8)((ui8DataOffset - UC_TCP_HDR_MIN_LENGTH_WORDS) * UC_4), &stRXOptions);
+        /* a SYN with ECE and CWR set requests ECN (RFC 3168) */
+        if((UC_1 == GET_HDR_ECE_BIT(ui32FlagsWord))
+        && (UC_1 == GET_HDR_CWR_BIT(ui32FlagsWord)))
+        {
+            stRXOptions.bEcnSetup = B_TRUE;
+        }
+        else
+        {
+            stRXOptions.bEcnSetup = B_FALSE;
+        }
+        /* calculate data length */
+        ui16DataLength = (uint16)(ui16MsgLength - (ui8DataOffset * UC_4));
+    }
+    else
+    {
+        /* malformed segment: discard it as a corrupted one */
+        ui16Checksum = US_MAX_USHORT;
+        ui16DataLength = US_NULL;
+    }
+
+    /* get socket id from src and dst addresses and ports */
+    ui8SocketIndex = getSocketIndex(ui32SrcIPAdd, ui32DstIPAdd, ui16SrcPort, ui16DstPort);
+    /* if checksum is wrong or segment is malformed */
+    if(US_NULL != ui16Checksum)
+    {
+        /* corrupted segment: discard it. The peer retransmits it */
+    }
+    /* else if RST message. ATTENTION: CLOSED connections, as reset or aborted ones, are never found */
+    else if((ui8SocketIndex != UC_NULL_SLOT_INDEX)
+         && (UC_1 == GET_HDR_RST_BIT(ui32FlagsWord)))
+    {
+        /* get connection info pointer */
+        pstConnInfo = &stOpenConnInfo[ui8SocketIndex];
+        pstConnInfo->stStats.ui32SegmentsIn++;
+        pstConnInfo->stStats.ui32RstIn++;
+
+        /* if it is awaiting for a SYN ACK: RST is valid if it acknowledges the SYN and no more than data sent with it (RFC 793) */
+        if(KE_WAIT_SYN_ACK == pstConnInfo->eCurrConnState)
+        {
+            if(( UC_1 == GET_HDR_ACK_BIT(ui32FlagsWord) )
+            && ( (uint32)(ui32AckNumber - pstConnInfo->ui32SeqNumber - UL_1) < (uint32)pstConnInfo->ui16SentDataLength ))
+            {
+                bRSTValid = B_TRUE;
+            }
+            else
+            {
+                bRSTValid = B_FALSE;
+            }
+        }
+        /* else connection is synchronized: RST is valid if its sequence number is within the RX window (RFC 793) */
+        else if((uint32)(ui32SeqNumber - pstConnInfo->ui32AckNumber) <= (uint32)GET_RX_FREE_SPACE(pstConnInfo))
+        {
+            bRSTValid = B_TRUE;
+        }
+        else
+        {
+            bRSTValid = B_FALSE;
+        }
+
+        /* if RST is valid */
+        if(B_TRUE == bRSTValid)
+        {
+            /* close the connection giving back its buffers and notify it. ATTENTION: no answer to a RST */
+            resetConnection(pstConnInfo, TCP_KE_ERR_RESET);
+            /* if the index is not owned by the application anymore: closed or not yet accepted */
+            if(B_TRUE == pstConnInfo->bReleaseReq)
+            {
+                /* give back the slot immediately */
+                releaseConnSlot(ui8SocketIndex);
+            }
+            else
+            {
+                /* slot is released once the application closes the connection */
+            }
+        }
+        else
+        {
+            /* old or forged RST: ignore it */
+        }
+    }
+    else if(ui8SocketIndex != UC_NULL_SLOT_INDEX)
+    {
+        /* get connection info pointer */
+        pstConnInfo = &stOpenConnInfo[ui8SocketIndex];
+
+        pstConnInfo->stStats.ui32SegmentsIn++;
+
+        /* peer is alive: restart keepalive idle time counting */
+        pstConnInfo->ui32KeepAliveTimerMs = pstConnInfo->ui32KeepAliveIdleMs;
+        pstConnInfo->ui8KeepAliveProbeCount = UC_NULL;
+
+        /* check ACK packet */
+        if( UC_1 == GET_HDR_ACK_BIT(ui32FlagsWord) )
+        {
+            /* acknowledged length from the oldest unacknowledged sequence number */
+            ui32AckedLength = (uint32)(ui32AckNumber - pstConnInfo->ui32SeqNumber);
+
+            /* if the SYN has been retransmitted without its data, the peer may have accepted them with the first one (RFC 7413) */
+            if((KE_WAIT_SYN_ACK == pstConnInfo->eCurrConnState)
+            && (ui32AckedLength > (uint32)pstConnInfo->ui16SentDataLength)
+            && (ui32AckedLength <= (uint32)(UC_1 + pstConnInfo->ui16SynDataSentLength)))
+            {
+                /* they are still the first TX data: consider them sent with the SYN, so acknowledged ones are released and not sent again */
+                pstConnInfo->ui16SynDataLength = pstConnInfo->ui16SynDataSentLength;
+                pstConnInfo->ui16SentDataLength = (uint16)(UC_1 + pstConnInfo->ui16SynDataSentLength);
+            }
+            else
+            {
+                /* ACK refers to sent data only */
+            }
+
+            /* connection is synchronized once the handshake is over */
+            if((KE_WAIT_SYN_ACK == pstConnInfo->eCurrConnState)
+            || (KE_SYN_RECEIVED == pstConnInfo->eCurrConnState))
+            {
+                bSynchronized = B_FALSE;
+            }
+            else
+            {
+                bSynchronized = B_TRUE;
+            }
+
+            /* check ACK number: it shall be between the oldest unacknowledged and the next sequence number. During the handshake it shall acknowledge the SYN */
+            if((ui32AckedLength <= (uint32)pstConnInfo->ui16SentDataLength)
+            && ((B_TRUE == bSynchronized) || (ui32AckedLength > UL_NULL)))
+            {
+                /* duplicate ACK: no new data acknowledged while data are in flight, no data, no SYN or FIN and same window (RFC 5681) */
+                if((UL_NULL == ui32AckedLength)
+                && (pstConnInfo->ui16SentDataLength > US_NULL)
+                && (US_NULL == ui16DataLength)
+                && (UC_0 == GET_HDR_SYN_BIT(ui32FlagsWord))
+                && (UC_0 == GET_HDR_FIN_BIT(ui32FlagsWord))
+                && (ui16WindowSize == pstConnInfo->ui16PeerWindowSize))
+                {
+                    bDupAck = B_TRUE;
+                    pstConnInfo->stStats.ui32DupAcksIn++;
+                }
+                else
+                {
+                    bDupAck = B_FALSE;
+                }
+                /* update peer window size */
+                pstConnInfo->ui16PeerWindowSize = ui16WindowSize;
+                /* release acknowledged data and move on the sequence number */
+                releaseAckedData(pstConnInfo, (uint16)ui32AckedLength);
+                /* update RTT estimation and retransmission timer */
+                updateRetxOnAck(pstConnInfo, (uint16)ui32AckedLength);
+                /* update congestion window and recover from losses */
+                updateCongestionOnAck(pstConnInfo, (uint16)ui32AckedLength, bDupAck);
+
+                /* if it was awaiting for an ACK of a SYN ACK message and the SYN ACK has been acknowledged */
+                if(( KE_SYN_RECEIVED == pstConnInfo->eCurrConnState )
+                && ( US_NULL == pstConnInfo->ui16SentDataLength ))
+                {
+                    /* connection is now ESTABLISHED and ready to be accepted. Go on managing any FIN or data */
+                    pstConnInfo->eCurrConnState = KE_ESTABLISHED;
+                }
+                else
+                {
+                    /* do nothing */
+                }
+
+                /* go on managing the segment */
+                bSegmentValid = B_TRUE;
+            }
+            /* else if it is an old ACK: ignore it but go on managing data and FIN (RFC 9293). Peer window is not updated */
+            else if((B_TRUE == bSynchronized)
+                 && (!SEQ_NUM_GE(ui32AckNumber, pstConnInfo->ui32SeqNumber)))
+            {
+                bSegmentValid = B_TRUE;
+            }
+            /* else if the ACK is beyond the next sequence number */
+            else if(B_TRUE == bSynchronized)
+            {
+                /* send back an ACK and discard the segment (RFC 9293) */
+                prepareAndSendMsg(pstConnInfo, KE_MSG_ACK, GET_SND_NEXT(pstConnInfo), NULL_PTR, US_NULL);
+                bSegmentValid = B_FALSE;
+            }
+            else
+            {
+                /* handshake ACK is wrong, send a RESET message with the received ACK number as sequence number */
+                prepareAndSendMsg(pstConnInfo, KE_MSG_RST, ui32AckNumber, NULL_PTR, US_NULL);
+                /* drop the segment and stay in the current state: it may be old or forged (RFC 9293) */
+                bSegmentValid = B_FALSE;
+            }
+
+            /* if the segment shall be managed */
+            if(B_TRUE == bSegmentValid)
+            {
+                /* if segment is within the receive window: manage congestion marks and their echoes */
+                if(B_TRUE == isSeqAcceptable(pstConnInfo, ui32SeqNumber, ui16DataLength))
+                {
+                    manageRXEcn(pstConnInfo, ui32FlagsWord, ui8Ecn);
+                }
+                else
+                {
+                    /* old, duplicate or out-of-window segment: its marks are ignored (RFC 3168) */
+                }
+
+                /* if FIN message */
+                if( UC_1 == GET_HDR_FIN_BIT(ui32FlagsWord) )
+                {
+                    /* if FIN message carries data */
+                    if(ui16DataLength > US_NULL)
+                    {
+                        /* store them before managing the FIN. ATTENTION: skip header options */
+                        receiveSegmentData(pstConnInfo, ui32SeqNumber, (pui8DataPtr + (ui8DataOffset * UC_4)), ui16DataLength);
+                    }
+                    else
+                    {
+                        /* FIN only */
+                    }
+
+                    /* if FIN is in order: all data preceding it have been stored */
+                    if((uint32)(ui32SeqNumber + ui16DataLength) == pstConnInfo->ui32AckNumber)
+                    {
+                        /* acknowledge the FIN */
+                        pstConnInfo->ui32AckNumber += UL_1;
+                        /* if connection is in ESTABLISHED state */
+                        if(KE_ESTABLISHED == pstConnInfo->eCurrConnState)
+                        {
+                            /* connection is now HALF OPEN */
+                            pstConnInfo->eCurrConnState = KE_HALF_OPEN;
+                            /* peer will not send data anymore */
+                            notifyEvent(pstConnInfo, TCP_KE_EVT_PEER_CLOSED);
+                            /* if connection can not be left in HALF OPEN state */
+                            if( B_FALSE == pstConnInfo->bKeepHalfOpen )
+                            {
+                                /* request to close it */
+                                pstConnInfo->ePendingConnCommand = KE_COMM_CLOSE;
+                            }
+                            else
+                            {
+                                /* leave it HALF OPEN */
+                            }
+                        }
+                        /* else if connection is HALF CLOSED or it is awaiting for ACK to a FIN message */
+                        else if((KE_HALF_CLOSED == pstConnInfo->eCurrConnState)
+                             || (KE_WAIT_FIN_ACK == pstConnInfo->eCurrConnState))
+                        {
+                            /* connection is now CLOSED */
+                            pstConnInfo->eCurrConnState = KE_CLOSED;
+                            notifyEvent(pstConnInfo, TCP_KE_EVT_CLOSED);
+                        }
+                        else
+                        {
+                            /* unexpected FIN message, ignore it but send back an ACK anyway */
+                        }
+                    }
+                    else
+                    {
+                        /* FIN out of order, already acknowledged or preceding data not stored: ignore it. The peer retransmits it */
+                    }
+                    /* send a ACK message */
+                    prepareAndSendMsg(pstConnInfo, KE_MSG_ACK, GET_SND_NEXT(pstConnInfo), NULL_PTR, US_NULL);
+                }
+                /* else SYN message */
+                else if( UC_1 == GET_HDR_SYN_BIT(ui32FlagsWord) )
+                {
+                    /* if it is awaiting for an ACK of a SYN message and the SYN has been acknowledged. Data sent with it may be not */
+                    if((KE_WAIT_SYN_ACK == pstConnInfo->eCurrConnState)
+                    && (pstConnInfo->ui16SentDataLength <= pstConnInfo->ui16SynDataLength))
+                    {
+                        /* connection is now ESTABLISHED */
+                        pstConnInfo->eCurrConnState = KE_ESTABLISHED;
+                        /* segments size depends on peer MSS */
+                        pstConnInfo->ui16SendMss = getSendMss(&stRXOptions);
+                        initCongestionCtrl(pstConnInfo);
+                        /* ECN is negotiated if requested and the SYN ACK has ECE set and CWR cleared (RFC 3168) */
+                        if((B_TRUE == B_ECN_ENABLED)
+                        && (UC_1 == GET_HDR_ECE_BIT(ui32FlagsWord))
+                        && (UC_0 == GET_HDR_CWR_BIT(ui32FlagsWord)))
+                        {
+                            pstConnInfo->bEcn = B_TRUE;
+                        }
+                        else
+                        {
+                            pstConnInfo->bEcn = B_FALSE;
+                        }
+                        /* update ACK number */
+                        pstConnInfo->ui32AckNumber = ui32SeqNumber + UC_1;
+                        /* send an ACK message */
+                        prepareAndSendMsg(pstConnInfo, KE_MSG_ACK, GET_SND_NEXT(pstConnInfo), NULL_PTR, US_NULL);
+                        /* data can be sent now */
+                        notifyEvent(pstConnInfo, TCP_KE_EVT_CONNECTED);
+
+                        /* if a new cookie has been received, cache it for next connections */
+                        if(stRXOptions.ui8FastOpenCookieLength > UC_NULL)
+                        {
+                            storeFastOpenCookie(pstConnInfo->ui32DstIPAdd, stRXOptions.pui8FastOpenCookiePtr, stRXOptions.ui8FastOpenCookieLength);
+                        }
+                        /* else if server has not accepted data nor answered with the Fast Open option: cached cookie is not valid */
+                        else if((pstConnInfo->ui16SynDataLength > US_NULL)
+                             && (B_TRUE != stRXOptions.bFastOpen))
+                        {
+                            storeFastOpenCookie(pstConnInfo->ui32DstIPAdd, NULL_PTR, UC_NULL);
+                        }
+                        else
+                        {
+                            /* keep cached cookie, if any */
+                        }
+
+                        /* if data have been sent with the SYN */
+                        if(pstConnInfo->ui16SynDataLength > US_NULL)
+                        {
+                            /* release acknowledged ones as normal data from the first one. The others are sent again as normal segments (RFC 7413) */
+                            ui16SynDataAckedLength = (uint16)(pstConnInfo->ui16SynDataLength - pstConnInfo->ui16SentDataLength);
+                            pstConnInfo->ui32SeqNumber -= ui16SynDataAckedLength;
+                            pstConnInfo->ui16SentDataLength = ui16SynDataAckedLength;
+                            pstConnInfo->ui16SynDataLength = US_NULL;
+                            releaseAckedData(pstConnInfo, ui16SynDataAckedLength);
+                        }
+                        else
+                        {
+                            /* normal handshake */
+                        }
+
+                    }
+                    /* else if connection is synchronized: the peer may have lost the final ACK of the handshake */
+                    else if(B_TRUE == bSynchronized)
+                    {
+                        /* send back an ACK with current numbers and discard the segment (RFC 9293, RFC 5961 challenge ACK) */
+                        prepareAndSendMsg(pstConnInfo, KE_MSG_ACK, GET_SND_NEXT(pstConnInfo), NULL_PTR, US_NULL);
+                    }
+                    else
+                    {
+                        /* unexpected SYN during the handshake, ignore it and do NOT send back an ACK */
+                    }
+                }
+                else
+                {
+                    /* if it was awaiting for a ACK to a previous FYN message and FIN has been acknowledged */
+                    if(( KE_WAIT_FIN_ACK == pstConnInfo->eCurrConnState )
+                    && ( US_NULL == pstConnInfo->ui16SentDataLength ))
+                    {
+                        /* connection is now HALF CLOSED */
+                        pstConnInfo->eCurrConnState = KE_HALF_CLOSED;
+                    }
+                    /* else if it was awaiting for a last ACK message and FIN has been acknowledged */
+                    else if(( KE_WAIT_LAST_ACK == pstConnInfo->eCurrConnState )
+                         && ( US_NULL == pstConnInfo->ui16SentDataLength ))
+                    {
+                        /* connection is now CLOSED */
+                        pstConnInfo->eCurrConnState = KE_CLOSED;
+                        notifyEvent(pstConnInfo, TCP_KE_EVT_CLOSED);
+                    }
+                    else
+                    {
+                        /* if data have been received. A pure ACK is not acknowledged */
+                        if(ui16DataLength > US_NULL)
+                        {
+                            /* store received data according to their sequence number. ATTENTION: skip header options */
+                            receiveSegmentData(pstConnInfo, ui32SeqNumber, (pui8DataPtr + (ui8DataOffset * UC_4)), ui16DataLength);
+                        }
+                        else
+                        {
+                            /* ACK only: acknowledged data have been already released */
+                        }
+                    }
+                }
+            }
+            else
+            {
+                /* segment discarded */
+            }
+        }
+        else
+        {
+            /* this packet has not ACK bit set, do nothing. Manage ACK packets only */
+        }
+    }
+    /* else if it is a connection request */
+    else if(( UC_1 == GET_HDR_SYN_BIT(ui32FlagsWord) )
+         && ( UC_0 == GET_HDR_ACK_BIT(ui32FlagsWord) ))
+    {
+        /* accept it if the port is listened */
+        acceptIncomingConn(ui32SrcIPAdd, ui32DstIPAdd, ui16SrcPort, ui16DstPort, ui32SeqNumber, ui16WindowSize, &stRXOptions);
+    }
+    else
+    {
+        /* related connection doesn't exist */
+    }
+}
+
+
+
+
+/* ------------------- Local functions declaration ---------------- */
+
+/* send pending data segments within the send window */
+LOCAL void sendPendingData( st_OpenConnInfo *pstConnInfo )
+{
+    uint16 ui16WindowLength;
+    uint16 ui16UnsentLength;
+    uint16 ui16SegmentLength;
+    uint8 *pui8SegmentPtr;
+    boolean bSegmentSent = B_TRUE;
+
+    /* send window is the lowest between peer and congestion windows. ATTENTION: data in flight are limited by TX buffer length too */
+    ui16WindowLength = pstConnInfo->ui16PeerWindowSize;
+    if(pstConnInfo->ui32CongWindow < (uint32)ui16WindowLength)
+    {
+        ui16WindowLength = (uint16)pstConnInfo->ui32CongWindow;
+    }
+    else
+    {
+        /* peer window is the limit */
+    }
+
+    /* data not sent yet are placed after data in flight */
+    ui16UnsentLength = (uint16)(pstConnInfo->ui16PendingTXDataLength - pstConnInfo->ui16SentDataLength);
+
+    /* send segments until there are unsent data, window is not full and IP layer accepts them */
+    while((B_TRUE == bSegmentSent)
+    &&    (ui16UnsentLength > US_NULL)
+    &&    (ui16WindowLength > pstConnInfo->ui16SentDataLength))
+    {
+        /* segment length is limited by unsent data, maximum TX length and free window */
+        ui16SegmentLength = ui16UnsentLength;
+        if(ui16SegmentLength > pstConnInfo->ui16SendMss)
+        {
+            ui16SegmentLength = pstConnInfo->ui16SendMss;
+        }
+        else
+        {
+            /* length is already valid */
+        }
+        if(ui16SegmentLength > (uint16)(ui16WindowLength - pstConnInfo->ui16SentDataLength))
+        {
+            ui16SegmentLength = (uint16)(ui16WindowLength - pstConnInfo->ui16SentDataLength);
+        }
+        else
+        {
+            /* length is already valid */
+        }
+
+        /* Nagle algorithm: if it is a small segment and data are in flight, wait for their ACK to coalesce more data */
+        if((ui16SegmentLength < pstConnInfo->ui16SendMss)
+        && (pstConnInfo->ui16SentDataLength > US_NULL)
+        && (B_TRUE != pstConnInfo->bNoDelay))
+        {
+            /* stop sending */
+            bSegmentSent = B_FALSE;
+        }
+        else
+        {
+            /* get segment data pointer. ATTENTION: a segment does not wrap around the end of the TX buffer */
+            ui16SegmentLength = getTXDataSpan(pstConnInfo, pstConnInfo->ui16SentDataLength, ui16SegmentLength, &pui8SegmentPtr);
+
+            /* prepare and send a data message starting from the next sequence number */
+            bSegmentSent = prepareAndSendMsg(pstConnInfo,
+                                             KE_MSG_DATA,
+                                             GET_SND_NEXT(pstConnInfo),
+                                             pui8SegmentPtr,
+                                             ui16SegmentLength);
+        }
+        if(B_TRUE == bSegmentSent)
+        {
+            /* start retransmission timer if not running and time this segment if none is timed */
+            startRetxTimer(pstConnInfo, GET_SND_NEXT(pstConnInfo));
+            /* segment is now in flight */
+            pstConnInfo->ui16SentDataLength += ui16SegmentLength;
+            ui16UnsentLength -= ui16SegmentLength;
+        }
+        else
+        {
+            /* IP buffer is busy or segment is delayed: try again at next run */
+        }
+    }
+}
+
+
+/* release acknowledged data and update the oldest unacknowledged sequence number */
+LOCAL void releaseAckedData( st_OpenConnInfo *pstConnInfo, uint16 ui16AckedLength )
+{
+    /* move on the oldest unacknowledged sequence number */
+    pstConnInfo->ui32SeqNumber += ui16AckedLength;
+    /* decrement data in flight */
+    pstConnInfo->ui16SentDataLength -= ui16AckedLength;
+
+    /* if data are being sent */
+    if((KE_ESTABLISHED == pstConnInfo->eCurrConnState)
+    || (KE_HALF_OPEN == pstConnInfo->eCurrConnState))
+    {
+        /* decrement pending data length */
+        pstConnInfo->ui16PendingTXDataLength -= ui16AckedLength;
+        /* if acknowledged data are still referenced by queued segments */
+        if(pstConnInfo->ui8TXDataRefNum > UC_NULL)
+        {
+            /* hold their space until the segments are released. See TCP_PeriodicTask() */
+            pstConnInfo->ui16TXHeldLength += ui16AckedLength;
+        }
+        /* else if TX buffer space has been freed */
+        else if(ui16AckedLength > US_NULL)
+        {
+            notifyEvent(pstConnInfo, TCP_KE_EVT_SEND_SPACE);
+        }
+        else
+        {
+            /* nothing released */
+        }
+        /* move on TX read index wrapping around the end of the buffer */
+        pstConnInfo->ui16TXReadIndex += ui16AckedLength;
+        if(pstConnInfo->ui16TXReadIndex >= pstConnInfo->ui16TXBufferLength)
+        {
+            pstConnInfo->ui16TXReadIndex -= pstConnInfo->ui16TXBufferLength;
+        }
+        else
+        {
+            /* no wrap around */
+        }
+    }
+    else
+    {
+        /* SYN or FIN acknowledged: no data to release */
+    }
+}
+
+
+/* get a pointer to pending TX data at the given offset from the oldest unacknowledged byte. Return the length limited to the contiguous span */
+LOCAL uint16 getTXDataSpan( st_OpenConnInfo *pstConnInfo, uint16 ui16Offset, uint16 ui16Length, uint8 **ppui8DataPtr )
+{
+    uint16 ui16Index;
+
+    /* get buffer index wrapping around the end of the buffer */
+    ui16Index = (uint16)(pstConnInfo->ui16TXReadIndex + ui16Offset);
+    if(ui16Index >= pstConnInfo->ui16TXBufferLength)
+    {
+        ui16Index -= pstConnInfo->ui16TXBufferLength;
+    }
+    else
+    {
+        /* no wrap around */
+    }
+
+    /* limit length up to the end of the buffer */
+    if(ui16Length > (uint16)(pstConnInfo->ui16TXBufferLength - ui16Index))
+    {
+        ui16Length = (uint16)(pstConnInfo->ui16TXBufferLength - ui16Index);
+    }
+    else
+    {
+        /* length is already valid */
+    }
+
+    *ppui8DataPtr = &pstConnInfo->pui8TXBufferPtr[ui16Index];
+
+    return ui16Length;
+}
+
+
+/* start retransmission timer if stopped and take a RTT sample of the given segment if none is pending */
+LOCAL void startRetxTimer( st_OpenConnInfo *pstConnInfo, uint32 ui32SegSeqNumber )
+{
+    /* if timer is stopped */
+    if(UL_NULL == pstConnInfo->ui32RetxTimerMs)
+    {
+        /* arm timer with current retransmission timeout */
+        pstConnInfo->ui32RetxTimerMs = pstConnInfo->ui32RtoMs;
+    }
+    else
+    {
+        /* timer is already running */
+    }
+
+    /* if no segment is being timed */
+    if(B_FALSE == pstConnInfo->bRttPending)
+    {
+        /* sample is taken when the byte next to the segment start is acknowledged */
+        pstConnInfo->ui32RttSeqNumber = (uint32)(ui32SegSeqNumber + UL_1);
+        pstConnInfo->ui32RttStartMs = RTOS_tickCountGet();
+        pstConnInfo->bRttPending = B_TRUE;
+    }
+    else
+    {
+        /* a segment is already being timed */
+    }
+}
+
+
+/* update RTT estimation and retransmission timer on new acknowledged data */
+LOCAL void updateRetxOnAck( st_OpenConnInfo *pstConnInfo, uint16 ui16AckedLength )
+{
+    uint32 ui32RttSampleMs;
+    uint32 ui32RttDeltaMs;
+
+    /* if new data have been acknowledged */
+    if(ui16AckedLength > US_NULL)
+    {
+        /* if the timed segment has been acknowledged */
+        if((B_TRUE == pstConnInfo->bRttPending)
+        && (SEQ_NUM_GE(pstConnInfo->ui32SeqNumber, pstConnInfo->ui32RttSeqNumber)))
+        {
+            /* get RTT sample */
+            ui32RttSampleMs = (uint32)(RTOS_tickCountGet() - pstConnInfo->ui32RttStartMs);
+
+            /* keep the lowest sample: a 0 ms one is stored as 1 ms to tell it from no samples */
+            if((UL_NULL == pstConnInfo->stStats.ui32MinRttMs)
+            || (ui32RttSampleMs < pstConnInfo->stStats.ui32MinRttMs))
+            {
+                pstConnInfo->stStats.ui32MinRttMs = ui32RttSampleMs;
+                if(UL_NULL == ui32RttSampleMs)
+                {
+                    pstConnInfo->stStats.ui32MinRttMs = UL_1;
+                }
+                else
+                {
+                    /* sample is valid */
+                }
+            }
+            else
+            {
+                /* minimum is unchanged */
+            }
+
+            /* if it is the first sample */
+            if(UL_NULL == pstConnInfo->ui32SmoothRttMs)
+            {
+                /* SRTT = R, RTTVAR = R / 2 */
+                pstConnInfo->ui32SmoothRttMs = ui32RttSampleMs;
+                pstConnInfo->ui32RttVarMs = (ui32RttSampleMs >> UL_SHIFT_1);
+            }
+            else
+            {
+                /* get absolute difference between SRTT and sample */
+                if(pstConnInfo->ui32SmoothRttMs > ui32RttSampleMs)
+                {
+                    ui32RttDeltaMs = (pstConnInfo->ui32SmoothRttMs - ui32RttSampleMs);
+                }
+                else
+                {
+                    ui32RttDeltaMs = (ui32RttSampleMs - pstConnInfo->ui32SmoothRttMs);
+                }
+                /* RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R| */
+                pstConnInfo->ui32RttVarMs = (((pstConnInfo->ui32RttVarMs * (uint32)3) + ui32RttDeltaMs) >> UL_SHIFT_2);
+                /* SRTT = 7/8 SRTT + 1/8 R */
+                pstConnInfo->ui32SmoothRttMs = (((pstConnInfo->ui32SmoothRttMs * (uint32)7) + ui32RttSampleMs) >> UL_SHIFT_3);
+                /* ATTENTION: a null SRTT means no samples. Keep it valid */
+                if(UL_NULL == pstConnInfo->ui32SmoothRttMs)
+                {
+                    pstConnInfo->ui32SmoothRttMs = UL_1;
+                }
+                else
+                {
+                    /* SRTT is valid */
+                }
+            }
+
+            /* RTO = SRTT + max(G, 4 * RTTVAR) */
+            if((pstConnInfo->ui32RttVarMs << UL_SHIFT_2) > UL_RTO_CLOCK_GRANULARITY_MS)
+            {
+                pstConnInfo->ui32RtoMs = pstConnInfo->ui32SmoothRttMs + (pstConnInfo->ui32RttVarMs << UL_SHIFT_2);
+            }
+            else
+            {
+                pstConnInfo->ui32RtoMs = pstConnInfo->ui32SmoothRttMs + UL_RTO_CLOCK_GRANULARITY_MS;
+            }
+            /* limit RTO value */
+            if(pstConnInfo->ui32RtoMs < UL_RTO_MIN_MS)
+            {
+                pstConnInfo->ui32RtoMs = UL_RTO_MIN_MS;
+            }
+            else if(pstConnInfo->ui32RtoMs > UL_RTO_MAX_MS)
+            {
+                pstConnInfo->ui32RtoMs = UL_RTO_MAX_MS;
+            }
+            else
+            {
+                /* RTO is valid */
+            }
+
+            /* sample taken */
+            pstConnInfo->bRttPending = B_FALSE;
+        }
+        else
+        {
+            /* timed segment not acknowledged yet */
+        }
+
+        /* new data acknowledged: reset retransmissions counter */
+        pstConnInfo->ui8RetxCount = UC_NULL;
+
+        /* if all sent data have been acknowledged */
+        if(US_NULL == pstConnInfo->ui16SentDataLength)
+        {
+            /* stop the timer */
+            pstConnInfo->ui32RetxTimerMs = UL_NULL;
+        }
+        else
+        {
+            /* restart the timer for remaining data in flight */
+            pstConnInfo->ui32RetxTimerMs = pstConnInfo->ui32RtoMs;
+        }
+    }
+    else
+    {
+        /* duplicated ACK or window update: leave the timer running */
+    }
+}
+
+
+/* manage retransmission timer expiry */
+LOCAL void manageRetxTimer( st_OpenConnInfo *pstConnInfo )
+{
+    /* if timer is running */
+    if(pstConnInfo->ui32RetxTimerMs > UL_NULL)
+    {
+        /* if timer is not expired yet */
+        if(pstConnInfo->ui32RetxTimerMs > UL_RTO_CLOCK_GRANULARITY_MS)
+        {
+            /* leave it expiring */
+            pstConnInfo->ui32RetxTimerMs -= UL_RTO_CLOCK_GRANULARITY_MS;
+        }
+        /* else if maximum number of retransmissions has been reached */
+        else if(pstConnInfo->ui8RetxCount >= pstConnInfo->ui8MaxRetxNum)
+        {
+            /* peer is not reachable: abort the connection */
+            abortConnection(pstConnInfo, TCP_KE_ERR_TIMEOUT);
+        }
+        else
+        {
+            /* back off the timer: double RTO value */
+            pstConnInfo->ui32RtoMs <<= UL_SHIFT_1;
+            if(pstConnInfo->ui32RtoMs > UL_RTO_MAX_MS)
+            {
+                pstConnInfo->ui32RtoMs = UL_RTO_MAX_MS;
+            }
+            else
+            {
+                /* RTO is valid */
+            }
+
+            /* ATTENTION: do not take a RTT sample of a retransmitted segment (Karn's algorithm) */
+            pstConnInfo->bRttPending = B_FALSE;
+
+            /* loss detected by timeout: restart from slow start with one segment window (RFC 5681) and exit fast recovery */
+            reduceSlowStartThresh(pstConnInfo);
+            pstConnInfo->ui32CongWindow = (uint32)pstConnInfo->ui16SendMss;
+            pstConnInfo->ui32CongAvoidAckedBytes = UL_NULL;
+            pstConnInfo->ui8DupAckCount = UC_NULL;
+            pstConnInfo->bFastRecovery = B_FALSE;
+            pstConnInfo->ui32RecoverSeqNumber = GET_SND_NEXT(pstConnInfo);
+
+            /* retransmit the oldest unacknowledged segment. If IP buffer is busy it is retried at next expiry */
+            retransmitOldestSegment(pstConnInfo);
+
+            /* increment retransmissions counter */
+            pstConnInfo->ui8RetxCount++;
+
+            /* re-arm the timer */
+            pstConnInfo->ui32RetxTimerMs = pstConnInfo->ui32RtoMs;
+        }
+    }
+    else
+    {
+        /* timer is stopped */
+    }
+}
+
+
+/* retransmit the oldest unacknowledged segment according to the connection state */
+LOCAL boolean retransmitOldestSegment( st_OpenConnInfo *pstConnInfo )
+{
+    boolean bSuccess;
+    uint16 ui16SegmentLength;
+    uint8 *pui8SegmentPtr;
+
+    switch(pstConnInfo->eCurrConnState)
+    {
+        case KE_WAIT_SYN_ACK:
+        {
+            /* SYN message is lost. If it carried data, fall back to a SYN without them: they are sent once the connection is established (RFC 7413) */
+            pstConnInfo->ui16SentDataLength -= pstConnInfo->ui16SynDataLength;
+            pstConnInfo->ui16SynDataLength = US_NULL;
+            bSuccess = prepareAndSendMsg(pstConnInfo, KE_MSG_SYN, pstConnInfo->ui32SeqNumber, NULL_PTR, US_NULL);
+            break;
+        }
+        case KE_SYN_RECEIVED:
+        {
+            /* SYN ACK message is lost */
+            bSuccess = prepareAndSendMsg(pstConnInfo, KE_MSG_SYN_ACK, pstConnInfo->ui32SeqNumber, NULL_PTR, US_NULL);
+            break;
+        }
+        case KE_WAIT_FIN_ACK:
+        case KE_WAIT_LAST_ACK:
+        {
+            /* FIN message is lost */
+            bSuccess = prepareAndSendMsg(pstConnInfo, KE_MSG_FIN, pstConnInfo->ui32SeqNumber, NULL_PTR, US_NULL);
+            break;
+        }
+        case KE_ESTABLISHED:
+        case KE_HALF_OPEN:
+        {
+            /* oldest data segment is lost: resend up to one segment from the oldest unacknowledged byte */
+            ui16SegmentLength = pstConnInfo->ui16SentDataLength;
+            if(ui16SegmentLength > pstConnInfo->ui16SendMss)
+            {
+                ui16SegmentLength = pstConnInfo->ui16SendMss;
+            }
+            else
+            {
+                /* length is already valid */
+            }
+            ui16SegmentLength = getTXDataSpan(pstConnInfo, US_NULL, ui16SegmentLength, &pui8SegmentPtr);
+            bSuccess = prepareAndSendMsg(pstConnInfo, KE_MSG_DATA, pstConnInfo->ui32SeqNumber, pui8SegmentPtr, ui16SegmentLength);
+            break;
+        }
+        default:
+        {
+            /* nothing to retransmit */
+            bSuccess = B_FALSE;
+            break;
+        }
+    }
+
+    /* if a segment has been retransmitted */
+    if(B_TRUE == bSuccess)
+    {
+        pstConnInfo->stStats.ui32RetransmitsNum++;
+    }
+    else
+    {
+        /* nothing sent */
+    }
+
+    return bSuccess;
+}
+
+
+/* delay the ACK of a received data segment. Send it immediately every UC_ACK_EVERY_SEG_NUM segments */
+LOCAL void delayAck( st_OpenConnInfo *pstConnInfo )
+{
+    /* one more segment to acknowledge */
+    pstConnInfo->ui8UnackedSegNum++;
+
+    /* if enough segments have been received */
+    if(pstConnInfo->ui8UnackedSegNum >= UC_ACK_EVERY_SEG_NUM)
+    {
+        /* send a ACK message now. If IP buffer is busy it is sent at timer expiry */
+        prepareAndSendMsg(pstConnInfo, KE_MSG_ACK, GET_SND_NEXT(pstConnInfo), NULL_PTR, US_NULL);
+    }
+    else
+    {
+        /* nothing to do now */
+    }
+
+    /* if ACK is still pending and timer is stopped */
+    if((pstConnInfo->ui8UnackedSegNum > UC_NULL)
+    && (UL_NULL == pstConnInfo->ui32DelAckTimerMs))
+    {
+        /* start delayed ACK timer */
+        pstConnInfo->ui32DelAckTimerMs = UL_DELAYED_ACK_TIMEOUT_MS;
+    }
+    else
+    {
+        /* ACK already sent or timer already running */
+    }
+}
+
+
+/* manage delayed ACK timer expiry */
+LOCAL void manageDelAckTimer( st_OpenConnInfo *pstConnInfo )
+{
+    /* if timer is running */
+    if(pstConnInfo->ui32DelAckTimerMs > UL_NULL)
+    {
+        /* if timer is not expired yet */
+        if(pstConnInfo->ui32DelAckTimerMs > UL_RTO_CLOCK_GRANULARITY_MS)
+        {
+            /* leave it expiring */
+            pstConnInfo->ui32DelAckTimerMs -= UL_RTO_CLOCK_GRANULARITY_MS;
+        }
+        /* else send the delayed ACK. On success, timer is stopped by prepareAndSendMsg() */
+        else if(B_FALSE == prepareAndSendMsg(pstConnInfo, KE_MSG_ACK, GET_SND_NEXT(pstConnInfo), NULL_PTR, US_NULL))
+        {
+            /* IP buffer is busy: try again at next run */
+            pstConnInfo->ui32DelAckTimerMs = UL_RTO_CLOCK_GRANULARITY_MS;
+        }
+        else
+        {
+            /* ACK sent */
+        }
+    }
+    else
+    {
+        /* timer is stopped */
+    }
+}
+
+
+/* initialize congestion control once the send MSS is known */
+LOCAL void initCongestionCtrl( st_OpenConnInfo *pstConnInfo )
+{
+    /* initial window: min(4 * MSS, max(2 * MSS, 4380)) (RFC 3390) */
+    pstConnInfo->ui32CongWindow = ((uint32)pstConnInfo->ui16SendMss << UL_SHIFT_1);
+    if(pstConnInfo->ui32CongWindow < UL_INITIAL_WINDOW_MAX_BYTES)
+    {
+        pstConnInfo->ui32CongWindow = UL_INITIAL_WINDOW_MAX_BYTES;
+    }
+    else
+    {
+        /* 2 * MSS is already greater */
+    }
+    if(pstConnInfo->ui32CongWindow > ((uint32)pstConnInfo->ui16SendMss << UL_SHIFT_2))
+    {
+        pstConnInfo->ui32CongWindow = ((uint32)pstConnInfo->ui16SendMss << UL_SHIFT_2);
+    }
+    else
+    {
+        /* window is already valid */
+    }
+
+    /* slow start threshold is arbitrarily high at the beginning */
+    pstConnInfo->ui32SlowStartThresh = UL_MAX_SLOW_START_THRESH;
+    pstConnInfo->ui32CongAvoidAckedBytes = UL_NULL;
+    pstConnInfo->ui8DupAckCount = UC_NULL;
+    pstConnInfo->bFastRecovery = B_FALSE;
+    pstConnInfo->ui32RecoverSeqNumber = pstConnInfo->ui32SeqNumber;
+}
+
+
+/* reduce the slow start threshold after a loss: max(FlightSize / 2, 2 * MSS) */
+LOCAL void reduceSlowStartThresh( st_OpenConnInfo *pstConnInfo )
+{
+    pstConnInfo->ui32SlowStartThresh = ((uint32)pstConnInfo->ui16SentDataLength >> UL_SHIFT_1);
+    if(pstConnInfo->ui32SlowStartThresh < ((uint32)pstConnInfo->ui16SendMss << UL_SHIFT_1))
+    {
+        pstConnInfo->ui32SlowStartThresh = ((uint32)pstConnInfo->ui16SendMss << UL_SHIFT_1);
+    }
+    else
+    {
+        /* threshold is already valid */
+    }
+}
+
+
+/* update congestion window on a received ACK: slow start, congestion avoidance, fast retransmit and NewReno fast recovery */
+LOCAL void updateCongestionOnAck( st_OpenConnInfo *pstConnInfo, uint16 ui16AckedLength, boolean bDupAck )
+{
+    /* if new data have been acknowledged */
+    if(ui16AckedLength > US_NULL)
+    {
+        /* reset duplicate ACKs counter */
+        pstConnInfo->ui8DupAckCount = UC_NULL;
+
+        /* if fast recovery is in progress */
+        if(B_TRUE == pstConnInfo->bFastRecovery)
+        {
+            /* if all data sent before the loss have been acknowledged (full ACK) */
+            if(SEQ_NUM_GE(pstConnInfo->ui32SeqNumber, pstConnInfo->ui32RecoverSeqNumber))
+            {
+                /* deflate the window: min(ssthresh, FlightSize + MSS) and exit fast recovery (RFC 6582) */
+                pstConnInfo->ui32CongWindow = (uint32)pstConnInfo->ui16SentDataLength + (uint32)pstConnInfo->ui16SendMss;
+                if(pstConnInfo->ui32CongWindow > pstConnInfo->ui32SlowStartThresh)
+                {
+                    pstConnInfo->ui32CongWindow = pstConnInfo->ui32SlowStartThresh;
+                }
+                else
+                {
+                    /* window is already valid */
+                }
+                pstConnInfo->bFastRecovery = B_FALSE;
+                pstConnInfo->ui32CongAvoidAckedBytes = UL_NULL;
+            }
+            else
+            {
+                /* partial ACK: the next segment is lost too, retransmit it without waiting for duplicate ACKs */
+                retransmitOldestSegment(pstConnInfo);
+
+                /* deflate the window by the acknowledged data and add back one MSS if at least one MSS has been acknowledged */
+                if(pstConnInfo->ui32CongWindow > (uint32)ui16AckedLength)
+                {
+                    pstConnInfo->ui32CongWindow -= (uint32)ui16AckedLength;
+                }
+                else
+                {
+                    pstConnInfo->ui32CongWindow = UL_NULL;
+                }
+                if(ui16AckedLength >= pstConnInfo->ui16SendMss)
+                {
+                    pstConnInfo->ui32CongWindow += (uint32)pstConnInfo->ui16SendMss;
+                }
+                else
+                {
+                    /* less than one MSS acknowledged */
+                }
+            }
+        }
+        /* else if slow start */
+        else if(pstConnInfo->ui32CongWindow < pstConnInfo->ui32SlowStartThresh)
+        {
+            /* increase window by acknowledged data, one MSS at most per ACK */
+            if(ui16AckedLength < pstConnInfo->ui16SendMss)
+            {
+                pstConnInfo->ui32CongWindow += (uint32)ui16AckedLength;
+            }
+            else
+            {
+                pstConnInfo->ui32CongWindow += (uint32)pstConnInfo->ui16SendMss;
+            }
+        }
+        else
+        {
+            /* congestion avoidance: increase window by one MSS per window of acknowledged data */
+            pstConnInfo->ui32CongAvoidAckedBytes += (uint32)ui16AckedLength;
+            if(pstConnInfo->ui32CongAvoidAckedBytes >= pstConnInfo->ui32CongWindow)
+            {
+                pstConnInfo->ui32CongAvoidAckedBytes -= pstConnInfo->ui32CongWindow;
+                pstConnInfo->ui32CongWindow += (uint32)pstConnInfo->ui16SendMss;
+            }
+            else
+            {
+                /* window not fully acknowledged yet */
+            }
+        }
+    }
+    /* else if it is a duplicate ACK */
+    else if(B_TRUE == bDupAck)
+    {
+        /* one more duplicate ACK */
+        pstConnInfo->ui8DupAckCount++;
+
+        /* if fast recovery is in progress */
+        if(B_TRUE == pstConnInfo->bFastRecovery)
+        {
+            /* a segment has left the network: inflate the window to send new data */
+            pstConnInfo->ui32CongWindow += (uint32)pstConnInfo->ui16SendMss;
+        }
+        /* else if enough duplicate ACKs and the loss is not related to an already recovered window (RFC 6582) */
+        else if((UC_DUP_ACK_THRESHOLD == pstConnInfo->ui8DupAckCount)
+             && (SEQ_NUM_GE(pstConnInfo->ui32SeqNumber, pstConnInfo->ui32RecoverSeqNumber)))
+        {
+            /* enter fast recovery: data sent so far shall be acknowledged to exit it */
+            reduceSlowStartThresh(pstConnInfo);
+            pstConnInfo->ui32RecoverSeqNumber = GET_SND_NEXT(pstConnInfo);
+            pstConnInfo->bFastRecovery = B_TRUE;
+
+            /* ATTENTION: do not take a RTT sample of a retransmitted segment (Karn's algorithm) */
+            pstConnInfo->bRttPending = B_FALSE;
+
+            /* fast retransmit the oldest unacknowledged segment. If IP buffer is busy the retransmission timer recovers it */
+            retransmitOldestSegment(pstConnInfo);
+
+            /* window is ssthresh plus the segments which have left the network */
+            pstConnInfo->ui32CongWindow = pstConnInfo->ui32SlowStartThresh + ((uint32)pstConnInfo->ui16SendMss * (uint32)UC_DUP_ACK_THRESHOLD);
+        }
+        else
+        {
+            /* not enough duplicate ACKs yet */
+        }
+    }
+    else
+    {
+        /* window update or ACK without data in flight */
+    }
+}
+
+
+/* send a window update once the application has freed enough RX buffer space (receiver SWS avoidance, RFC 1122) */
+LOCAL void manageWindowUpdate( st_OpenConnInfo *pstConnInfo )
+{
+    uint32 ui32RightEdge;
+
+    /* if peer can still send data */
+    if((KE_ESTABLISHED == pstConnInfo->eCurrConnState)
+    || (KE_WAIT_FIN_ACK == pstConnInfo->eCurrConnState)
+    || (KE_HALF_CLOSED == pstConnInfo->eCurrConnState))
+    {
+        /* get the right edge of the window that would be advertised now */
+        ui32RightEdge = (uint32)(pstConnInfo->ui32AckNumber + GET_RX_FREE_SPACE(pstConnInfo));
+
+        /* if window has grown enough since the last advertisement */
+        if((uint32)(ui32RightEdge - pstConnInfo->ui32AdvRightEdge) >= (uint32)GET_WND_UPDATE_MIN_LENGTH(pstConnInfo))
+        {
+            /* send a window update. If IP buffer is busy it is sent at next run */
+            prepareAndSendMsg(pstConnInfo, KE_MSG_ACK, GET_SND_NEXT(pstConnInfo), NULL_PTR, US_NULL);
+        }
+        else
+        {
+            /* avoid advertising small window increments */
+        }
+    }
+    else
+    {
+        /* peer does not send data anymore */
+    }
+}
+
+
+/* manage persist timer: probe a zero window of the peer until it opens */
+LOCAL void managePersistTimer( st_OpenConnInfo *pstConnInfo )
+{
+    /* if peer window is closed while there are data to send and no data in flight */
+    if((US_NULL == pstConnInfo->ui16PeerWindowSize)
+    && (pstConnInfo->ui16PendingTXDataLength > pstConnInfo->ui16SentDataLength)
+    && (US_NULL == pstConnInfo->ui16SentDataLength))
+    {
+        /* if timer is stopped */
+        if(UL_NULL == pstConnInfo->ui32PersistTimerMs)
+        {
+            /* start it from the current retransmission timeout */
+            pstConnInfo->ui32PersistBackoffMs = pstConnInfo->ui32RtoMs;
+            pstConnInfo->ui32PersistTimerMs = pstConnInfo->ui32PersistBackoffMs;
+            /* sending is stalled by the peer */
+            pstConnInfo->stStats.ui32PeerZeroWindowNum++;
+        }
+        /* else if timer is not expired yet */
+        else if(pstConnInfo->ui32PersistTimerMs > UL_RTO_CLOCK_GRANULARITY_MS)
+        {
+            /* leave it expiring */
+            pstConnInfo->ui32PersistTimerMs -= UL_RTO_CLOCK_GRANULARITY_MS;
+        }
+        else
+        {
+            /* send a window probe: an old sequence number makes the peer reply with its current window */
+            prepareAndSendMsg(pstConnInfo, KE_MSG_ACK, (uint32)(pstConnInfo->ui32SeqNumber - UL_1), NULL_PTR, US_NULL);
+
+            /* back off the timer. ATTENTION: the connection is never aborted while the peer answers probes */
+            pstConnInfo->ui32PersistBackoffMs <<= UL_SHIFT_1;
+            if(pstConnInfo->ui32PersistBackoffMs > UL_PERSIST_MAX_MS)
+            {
+                pstConnInfo->ui32PersistBackoffMs = UL_PERSIST_MAX_MS;
+            }
+            else
+            {
+                /* backoff is valid */
+            }
+            pstConnInfo->ui32PersistTimerMs = pstConnInfo->ui32PersistBackoffMs;
+        }
+    }
+    else
+    {
+        /* window is open or nothing to send: stop the timer */
+        pstConnInfo->ui32PersistTimerMs = UL_NULL;
+    }
+}
+
+
+/* manage keepalive timer: probe an idle connection and abort it if the peer does not answer */
+LOCAL void manageKeepAlive( st_OpenConnInfo *pstConnInfo )
+{
+    /* if keepalive is enabled and the connection is idle: open and nothing to send or to be acknowledged */
+    if((B_TRUE == pstConnInfo->bKeepAlive)
+    && ((KE_ESTABLISHED == pstConnInfo->eCurrConnState)
+     || (KE_HALF_OPEN == pstConnInfo->eCurrConnState)
+     || (KE_HALF_CLOSED == pstConnInfo->eCurrConnState))
+    && (US_NULL == pstConnInfo->ui16PendingTXDataLength))
+    {
+        /* if timer is not expired yet */
+        if(pstConnInfo->ui32KeepAliveTimerMs > UL_RTO_CLOCK_GRANULARITY_MS)
+        {
+            /* leave it expiring */
+            pstConnInfo->ui32KeepAliveTimerMs -= UL_RTO_CLOCK_GRANULARITY_MS;
+        }
+        /* else if all probes have not been answered */
+        else if(pstConnInfo->ui8KeepAliveProbeCount >= pstConnInfo->ui8KeepAliveProbesNum)
+        {
+            /* peer is dead or not reachable anymore: abort the connection */
+            abortConnection(pstConnInfo, TCP_KE_ERR_PEER_DEAD);
+        }
+        /* else send a probe: an old sequence number makes the peer reply with an ACK (RFC 1122) */
+        else if(B_TRUE == prepareAndSendMsg(pstConnInfo, KE_MSG_ACK, (uint32)(GET_SND_NEXT(pstConnInfo) - UL_1), NULL_PTR, US_NULL))
+        {
+            /* wait for the answer before the next probe */
+            pstConnInfo->ui8KeepAliveProbeCount++;
+            pstConnInfo->ui32KeepAliveTimerMs = pstConnInfo->ui32KeepAliveIntvMs;
+        }
+        else
+        {
+            /* IP buffer is busy: try again at next run */
+        }
+    }
+    else
+    {
+        /* connection is not idle: restart idle time counting */
+        pstConnInfo->ui32KeepAliveTimerMs = pstConnInfo->ui32KeepAliveIdleMs;
+        pstConnInfo->ui8KeepAliveProbeCount = UC_NULL;
+    }
+}
+
+
+/* check if a received segment is acceptable: it shall overlap the receive window (RFC 9293) */
+LOCAL boolean isSeqAcceptable( st_OpenConnInfo *pstConnInfo, uint32 ui32SeqNumber, uint16 ui16DataLength )
+{
+    boolean bAcceptable;
+    uint32 ui32Offset;
+    uint32 ui32Window = (uint32)GET_RX_FREE_SPACE(pstConnInfo);
+
+    /* offset of the segment from the next expected sequence number */
+    ui32Offset = (uint32)(ui32SeqNumber - pstConnInfo->ui32AckNumber);
+
+    /* if segment carries no data: it shall start within the window, or at its edge if the window is closed */
+    if(US_NULL == ui16DataLength)
+    {
+        if((SEQ_NUM_GE(ui32SeqNumber, pstConnInfo->ui32AckNumber))
+        && (ui32Offset <= ui32Window))
+        {
+            bAcceptable = B_TRUE;
+        }
+        else
+        {
+            bAcceptable = B_FALSE;
+        }
+    }
+    /* else if it carries new data and starts before the window end */
+    else if((!SEQ_NUM_GE(pstConnInfo->ui32AckNumber, (uint32)(ui32SeqNumber + ui16DataLength)))
+         && ((!SEQ_NUM_GE(ui32SeqNumber, pstConnInfo->ui32AckNumber)) || (ui32Offset < ui32Window)))
+    {
+        bAcceptable = B_TRUE;
+    }
+    else
+    {
+        /* already received or beyond the window */
+        bAcceptable = B_FALSE;
+    }
+
+    return bAcceptable;
+}
+
+
+/* manage ECN on a received segment: echo congestion experienced marks and reduce the congestion window on echoes (RFC 3168) */
+LOCAL void manageRXEcn( st_OpenConnInfo *pstConnInfo, uint32 ui32FlagsWord, uint8 ui8Ecn )
+{
+    /* if ECN has been negotiated */
+    if(B_TRUE == pstConnInfo->bEcn)
+    {
+        /* if the peer has reduced its window: stop echoing. ATTENTION: check it before a new mark */
+        if(UC_1 == GET_HDR_CWR_BIT(ui32FlagsWord))
+        {
+            pstConnInfo->bEcnEchoPending = B_FALSE;
+        }
+        else
+        {
+            /* go on echoing, if needed */
+        }
+        /* if congestion has been experienced along the path: echo it until CWR is received */
+        if(IPV4_UC_ECN_CE == ui8Ecn)
+        {
+            pstConnInfo->bEcnEchoPending = B_TRUE;
+        }
+        else
+        {
+            /* no congestion */
+        }
+
+        /* if congestion is echoed by the peer, not yet reacted in this window and no loss is being recovered */
+        if((UC_1 == GET_HDR_ECE_BIT(ui32FlagsWord))
+        && (UC_0 == GET_HDR_SYN_BIT(ui32FlagsWord))
+        && (B_TRUE != pstConnInfo->bFastRecovery)
+        && (SEQ_NUM_GE(pstConnInfo->ui32SeqNumber, pstConnInfo->ui32EcnRecoverSeqNumber)))
+        {
+            /* react as to a loss without retransmitting: halve the window and notify it with CWR */
+            reduceSlowStartThresh(pstConnInfo);
+            pstConnInfo->ui32CongWindow = pstConnInfo->ui32SlowStartThresh;
+            pstConnInfo->ui32CongAvoidAckedBytes = UL_NULL;
+            pstConnInfo->ui32EcnRecoverSeqNumber = GET_SND_NEXT(pstConnInfo);
+            pstConnInfo->bCwrPending = B_TRUE;
+            pstConnInfo->stStats.ui32EcnReductionsNum++;
+        }
+        else
+        {
+            /* no reaction */
+        }
+    }
+    else
+    {
+        /* ECN is not used */
+    }
+}
+
+
+/* abort a connection: send a RST message and close it reporting the error */
+LOCAL void abortConnection( st_OpenConnInfo *pstConnInfo, TCP_ke_ConnError eConnError )
+{
+    /* notify the peer. ATTENTION: RST is not retransmitted */
+    prepareAndSendMsg(pstConnInfo, KE_MSG_RST, GET_SND_NEXT(pstConnInfo), NULL_PTR, US_NULL);
+
+    /* close it */
+    resetConnection(pstConnInfo, eConnError);
+}
+
+
+/* close a connection at the moment without notifying the peer: give back its buffers and report the error */
+LOCAL void resetConnection( st_OpenConnInfo *pstConnInfo, TCP_ke_ConnError eConnError )
+{
+    /* stop retransmission, persist and delayed ACK timers */
+    pstConnInfo->ui32RetxTimerMs = UL_NULL;
+    pstConnInfo->ui32PersistTimerMs = UL_NULL;
+    pstConnInfo->bRttPending = B_FALSE;
+    pstConnInfo->ui32DelAckTimerMs = UL_NULL;
+    pstConnInfo->ui8UnackedSegNum = UC_NULL;
+
+    /* discard pending commands */
+    pstConnInfo->ePendingConnCommand = KE_NO_COMMAND;
+    /* give back RX and TX buffers: unread data are lost */
+    releaseConnBuffer(pstConnInfo);
+
+    /* connection is now CLOSED */
+    pstConnInfo->eCurrConnState = KE_CLOSED;
+
+    /* report the error */
+    pstConnInfo->eConnError = eConnError;
+    notifyEvent(pstConnInfo, TCP_KE_EVT_ABORTED);
+}
+
+
+/* notify an event of a connection to its callback, if any */
+LOCAL void notifyEvent( st_OpenConnInfo *pstConnInfo, TCP_ke_ConnEvent eEvent )
+{
+    /* if a callback has been set */
+    if(NULL_PTR != pstConnInfo->pvEventCallback)
+    {
+        /* connection index is the slot index */
+        pstConnInfo->pvEventCallback((TCP_ke_ConnIndex)(pstConnInfo - stOpenConnInfo), eEvent);
+    }
+    else
+    {
+        /* application polls the connection */
+    }
+}
+
+
+/* store received data at the given offset after the in-order ones into the RX circular buffer. Return the stored length */
+LOCAL uint16 getReceivedData( st_OpenConnInfo *pstConnInfo, uint16 ui16Offset, uint8 *pui8DataPtr, uint16 ui16DataLengthToCopy )
+{
+    uint16 ui16WriteIndex;
+    uint16 ui16SpanLength;
+
+    /* if offset is beyond the free space */
+    if(ui16Offset >= GET_RX_FREE_SPACE(pstConnInfo))
+    {
+        /* data are out of the advertised window: discard them */
+        ui16DataLengthToCopy = US_NULL;
+    }
+    /* else if received data are more than free space. ATTENTION: it should not happen since free space is the advertised window */
+    else if(ui16DataLengthToCopy > (uint16)(GET_RX_FREE_SPACE(pstConnInfo) - ui16Offset))
+    {
+        /* store data up to free space: remaining ones are not acknowledged */
+        ui16DataLengthToCopy = (uint16)(GET_RX_FREE_SPACE(pstConnInfo) - ui16Offset);
+    }
+    else
+    {
+        /* else there is enough space in the RX buffer: store all received data */
+    }
+
+    /* if there are data to store */
+    if(ui16DataLengthToCopy > US_NULL)
+    {
+        /* get write index: it follows the last unread byte by the given offset */
+        ui16WriteIndex = (uint16)(pstConnInfo->ui16RXReadIndex + pstConnInfo->ui16RXDataLength + ui16Offset);
+        if(ui16WriteIndex >= pstConnInfo->ui16RXBufferLength)
+        {
+            ui16WriteIndex -= pstConnInfo->ui16RXBufferLength;
+        }
+        else
+        {
+            /* no wrap around */
+        }
+
+        /* get length up to the end of the buffer */
+        ui16SpanLength = (uint16)(pstConnInfo->ui16RXBufferLength - ui16WriteIndex);
+        if(ui16SpanLength >= ui16DataLengthToCopy)
+        {
+            /* all data fit before the end of the buffer */
+            MEM_COPY(&pstConnInfo->pui8RXBufferPtr[ui16WriteIndex], pui8DataPtr, ui16DataLengthToCopy);
+        }
+        else
+        {
+            /* data wrap around: copy the first part until the end of the buffer and the rest from its start */
+            MEM_COPY(&pstConnInfo->pui8RXBufferPtr[ui16WriteIndex], pui8DataPtr, ui16SpanLength);
+            MEM_COPY(pstConnInfo->pui8RXBufferPtr, &pui8DataPtr[ui16SpanLength], (ui16DataLengthToCopy - ui16SpanLength));
+        }
+    }
+    else
+    {
+        /* no data or RX buffer is full: discard data */
+    }
+
+    return ui16DataLengthToCopy;
+}
+
+
+/* store a received data segment according to its sequence number and acknowledge it */
+LOCAL void receiveSegmentData( st_OpenConnInfo *pstConnInfo, uint32 ui32SeqNumber, uint8 *pui8DataPtr, uint16 ui16DataLength )
+{
+    uint32 ui32Offset;
+    uint16 ui16StoredLength;
+    uint16 ui16RXDataLength = pstConnInfo->ui16RXDataLength;
+    boolean bDelayAck = B_FALSE;
+
+    /* offset of the segment from the next expected sequence number */
+    ui32Offset = (uint32)(ui32SeqNumber - pstConnInfo->ui32AckNumber);
+
+    /* if segment starts before the next expected sequence number: it overlaps already received data */
+    if(!SEQ_NUM_GE(ui32SeqNumber, pstConnInfo->ui32AckNumber))
+    {
+        /* get the already received length */
+        ui32Offset = (uint32)(pstConnInfo->ui32AckNumber - ui32SeqNumber);
+        /* if segment carries new data too */
+        if(ui32Offset < (uint32)ui16DataLength)
+        {
+            /* skip already received data and go on as an in-order segment */
+            pui8DataPtr += ui32Offset;
+            ui16DataLength -= (uint16)ui32Offset;
+            ui32Offset = UL_NULL;
+        }
+        else
+        {
+            /* duplicated segment: discard it */
+            ui16DataLength = US_NULL;
+            pstConnInfo->stStats.ui32DiscardedSegmentsIn++;
+        }
+    }
+    else
+    {
+        /* in-order or future segment */
+    }
+
+    /* if there are no data to store */
+    if(US_NULL == ui16DataLength)
+    {
+        /* nothing to store: send back an ACK anyway */
+    }
+    /* else if it is an in-order segment */
+    else if(UL_NULL == ui32Offset)
+    {
+        /* store data within the advertised window */
+        ui16StoredLength = getReceivedData(pstConnInfo, US_NULL, pui8DataPtr, ui16DataLength);
+        if(ui16StoredLength < ui16DataLength)
+        {
+            /* RX buffer is full */
+            pstConnInfo->stStats.ui32RXWindowFullNum++;
+        }
+        else
+        {
+            /* all data stored */
+        }
+
+        /* if all data have been stored and no gap has been filled */
+        if((ui16StoredLength == ui16DataLength)
+        && (UC_NULL == pstConnInfo->ui8OooRangesNum))
+        {
+            /* the ACK can be delayed */
+            bDelayAck = B_TRUE;
+        }
+        else
+        {
+            /* the peer shall know immediately that the window is full or the gap is filled */
+        }
+
+        /* stored data are now in order together with any queued contiguous ones */
+        advanceRXData(pstConnInfo, ui16StoredLength);
+    }
+    /* else if segment starts within the advertised window */
+    else if(ui32Offset < (uint32)GET_RX_FREE_SPACE(pstConnInfo))
+    {
+        /* store data in their position and queue their range until the gap is filled */
+        ui16StoredLength = getReceivedData(pstConnInfo, (uint16)ui32Offset, pui8DataPtr, ui16DataLength);
+        queueOooRange(pstConnInfo, (uint16)ui32Offset, ui16StoredLength);
+        pstConnInfo->stStats.ui32OooSegmentsIn++;
+        if(ui16StoredLength < ui16DataLength)
+        {
+            /* RX buffer is full */
+            pstConnInfo->stStats.ui32RXWindowFullNum++;
+        }
+        else
+        {
+            /* all data stored */
+        }
+    }
+    else
+    {
+        /* segment out of the window: discard it */
+        pstConnInfo->stStats.ui32DiscardedSegmentsIn++;
+    }
+
+    /* if ACK can be delayed */
+    if(B_TRUE == bDelayAck)
+    {
+        /* delay the ACK: it can be piggybacked or coalesced */
+        delayAck(pstConnInfo);
+    }
+    else
+    {
+        /* send back a duplicate or updated ACK immediately (RFC 5681) */
+        prepareAndSendMsg(pstConnInfo, KE_MSG_ACK, GET_SND_NEXT(pstConnInfo), NULL_PTR, US_NULL);
+    }
+
+    /* if new in-order data can be read */
+    if(pstConnInfo->ui16RXDataLength > ui16RXDataLength)
+    {
+        notifyEvent(pstConnInfo, TCP_KE_EVT_DATA_READY);
+    }
+    else
+    {
+        /* no new readable data */
+    }
+}
+
+
+/* move in-order received data on by the given length and append queued out-of-order data which became contiguous */
+LOCAL void advanceRXData( st_OpenConnInfo *pstConnInfo, uint16 ui16Length )
+{
+    uint8 ui8Index;
+    uint8 ui8KeptNum;
+    uint16 ui16RangeEnd;
+    uint16 ui16NextLength;
+
+    /* until there are data to move on */
+    while(ui16Length > US_NULL)
+    {
+        /* increment unread data length and next expected sequence number. ATTENTION: should be an atomic operation */
+        pstConnInfo->ui16RXDataLength += ui16Length;
+        pstConnInfo->ui32AckNumber += (uint32)ui16Length;
+        pstConnInfo->stStats.ui32BytesIn += (uint32)ui16Length;
+
+        /* update queued ranges: offsets are relative to the next expected sequence number */
+        ui8KeptNum = UC_NULL;
+        ui16NextLength = US_NULL;
+        for(ui8Index = UC_NULL; ui8Index < pstConnInfo->ui8OooRangesNum; ui8Index++)
+        {
+            ui16RangeEnd = (uint16)(pstConnInfo->astOooRanges[ui8Index].ui16Offset + pstConnInfo->astOooRanges[ui8Index].ui16Length);
+
+            /* if range is still beyond in-order data */
+            if(pstConnInfo->astOooRanges[ui8Index].ui16Offset > ui16Length)
+            {
+                /* keep it */
+                pstConnInfo->astOooRanges[ui8KeptNum].ui16Offset = (uint16)(pstConnInfo->astOooRanges[ui8Index].ui16Offset - ui16Length);
+                pstConnInfo->astOooRanges[ui8KeptNum].ui16Length = pstConnInfo->astOooRanges[ui8Index].ui16Length;
+                ui8KeptNum++;
+            }
+            /* else if range is contiguous to in-order data */
+            else if(ui16RangeEnd > ui16Length)
+            {
+                /* its remaining part is now in order */
+                ui16NextLength = (uint16)(ui16RangeEnd - ui16Length);
+            }
+            else
+            {
+                /* range completely covered by in-order data: drop it */
+            }
+        }
+        pstConnInfo->ui8OooRangesNum = ui8KeptNum;
+
+        /* move on contiguous data, if any */
+        ui16Length = ui16NextLength;
+    }
+}
+
+
+/* queue a range of out-of-order data merging it with overlapping or contiguous ones */
+LOCAL void queueOooRange( st_OpenConnInfo *pstConnInfo, uint16 ui16Offset, uint16 ui16Length )
+{
+    st_RXRange astRanges[UC_OOO_MAX_RANGES_NUM + UC_1];
+    uint8 ui8RangesNum = UC_NULL;
+    uint8 ui8Index;
+    uint16 ui16End;
+    uint16 ui16RangeEnd;
+    boolean bQueued = B_FALSE;
+
+    /* if there are data */
+    if(ui16Length > US_NULL)
+    {
+        ui16End = (uint16)(ui16Offset + ui16Length);
+
+        /* build the new sorted list of ranges */
+        for(ui8Index = UC_NULL; ui8Index < pstConnInfo->ui8OooRangesNum; ui8Index++)
+        {
+            ui16RangeEnd = (uint16)(pstConnInfo->astOooRanges[ui8Index].ui16Offset + pstConnInfo->astOooRanges[ui8Index].ui16Length);
+
+            /* if range is before the new one */
+            if(ui16RangeEnd < ui16Offset)
+            {
+                /* copy it */
+                astRanges[ui8RangesNum] = pstConnInfo->astOooRanges[ui8Index];
+                ui8RangesNum++;
+            }
+            /* else if range is after the new one */
+            else if(pstConnInfo->astOooRanges[ui8Index].ui16Offset > ui16End)
+            {
+                /* if new range has not been queued yet */
+                if(B_FALSE == bQueued)
+                {
+                    /* queue it before this one */
+                    astRanges[ui8RangesNum].ui16Offset = ui16Offset;
+                    astRanges[ui8RangesNum].ui16Length = (uint16)(ui16End - ui16Offset);
+                    ui8RangesNum++;
+                    bQueued = B_TRUE;
+                }
+                else
+                {
+                    /* already queued */
+                }
+                /* copy it */
+                astRanges[ui8RangesNum] = pstConnInfo->astOooRanges[ui8Index];
+                ui8RangesNum++;
+            }
+            else
+            {
+                /* overlapping or contiguous range: merge it into the new one */
+                if(pstConnInfo->astOooRanges[ui8Index].ui16Offset < ui16Offset)
+                {
+                    ui16Offset = pstConnInfo->astOooRanges[ui8Index].ui16Offset;
+                }
+                else
+                {
+                    /* new range starts first */
+                }
+                if(ui16RangeEnd > ui16End)
+                {
+                    ui16End = ui16RangeEnd;
+                }
+                else
+                {
+                    /* new range ends last */
+                }
+            }
+        }
+
+        /* if new range has not been queued yet */
+        if(B_FALSE == bQueued)
+        {
+            /* it is the last one */
+            astRanges[ui8RangesNum].ui16Offset = ui16Offset;
+            astRanges[ui8RangesNum].ui16Length = (uint16)(ui16End - ui16Offset);
+            ui8RangesNum++;
+        }
+        else
+        {
+            /* already queued */
+        }
+
+        /* if queue is overflowed */
+        if(ui8RangesNum > UC_OOO_MAX_RANGES_NUM)
+        {
+            /* drop the farthest range: its data are not acknowledged and the peer retransmits them */
+            ui8RangesNum = UC_OOO_MAX_RANGES_NUM;
+        }
+        else
+        {
+            /* all ranges fit */
+        }
+
+        /* store the new list */
+        for(ui8Index = UC_NULL; ui8Index < ui8RangesNum; ui8Index++)
+        {
+            pstConnInfo->astOooRanges[ui8Index] = astRanges[ui8Index];
+        }
+        pstConnInfo->ui8OooRangesNum = ui8RangesNum;
+    }
+    else
+    {
+        /* nothing to queue */
+    }
+}
+
+
+/* prepare and send a SYN message */
+LOCAL boolean prepareAndSendMsg( st_OpenConnInfo *pstConnInfo, ke_MsgType eMsgType, uint32 ui32SeqNumber, uint8 *pui8DataPtr, uint16 ui16DataLength )
+{
+    boolean bSuccess;
+    uint8 *pui8BufferPtr;
+    uint32 *pui32HdrWords;
+    uint32 ui32HdrWord = UL_NULL;   /* it is very important to clean this variable */
+    uint16 ui16Checksum;
+    uint32 ui32Sum;
+    uint8 ui8HdrWordsLength;
+    IPv4_st_PacketDescriptor stIPv4PacketDscpt;
+    st_FastOpenCookie *pstFastOpenCookie = NULL_PTR;
+    uint8 ui8FastOpenOptLength = UC_NULL;
+    uint8 ui8PadLength = UC_NULL;
+    uint8 *pui8OptPtr;
+    PBUF_st_Buffer *pstPbuf;
+    PBUF_st_Buffer *pstDataPbuf;
+    boolean bCwrSent = B_FALSE;
+
+    /* get a free small packet buffer for the longest header: lower layers add their headers in front of it */
+    pstPbuf = PBUF_alloc(PBUF_US_SMALL_LENGTH);
+    if(pstPbuf != NULL_PTR)
+    {
+        /* header starts at 32-bit aligned buffer data */
+        pui8BufferPtr = pstPbuf->pui8Payload;
+        /* set 32-bit header pointer */
+        pui32HdrWords = (uint32 *)pui8BufferPtr;
+
+        /* TODO: consider to clear the buffer */
+        /*memset(pui32HdrWords, UC_NULL, (ui16DataLength + UC_TCP_HDR_MIN_LENGTH_BYTES));*/
+
+        SET_HDR_SRC_PORT(ui32HdrWord, pstConnInfo->ui16SrcPort);
+        SET_HDR_DST_PORT(ui32HdrWord, pstConnInfo->ui16DstPort);
+        WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
+        SET_HDR_SEQ_NUM(ui32HdrWord, ui32SeqNumber);
+        WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
+        SET_HDR_ACK_NUM(ui32HdrWord, pstConnInfo->ui32AckNumber);
+        WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
+        /* set TCP header size in 32-bit words */
+        ui8HdrWordsLength = UC_TCP_HDR_MIN_LENGTH_WORDS;
+        /* if SYN message */
+        if((KE_MSG_SYN == eMsgType)
+        || (KE_MSG_SYN_ACK == eMsgType))
+        {
+            /* add MSS option length */
+            ui8HdrWordsLength += (UC_OPT_LENGTH_MSS / UC_4);
+        }
+        else
+        {
+            /* length is already updated */
+        }
+        /* if Fast Open SYN message */
+        if((KE_MSG_SYN == eMsgType)
+        && (B_TRUE == pstConnInfo->bFastOpen))
+        {
+            /* send the cached cookie or an empty option to request one */
+            ui8FastOpenOptLength = UC_OPT_LENGTH_FAST_OPEN_MIN;
+            pstFastOpenCookie = getFastOpenCookie(pstConnInfo->ui32DstIPAdd);
+            if(NULL_PTR != pstFastOpenCookie)
+            {
+                ui8FastOpenOptLength += pstFastOpenCookie->ui8CookieLength;
+            }
+            else
+            {
+                /* cookie request */
+            }
+            /* add Fast Open option length padded to a multiple of 4 bytes */
+            ui8PadLength = (uint8)((UC_4 - (ui8FastOpenOptLength & UC_3)) & UC_3);
+            ui8HdrWordsLength += (uint8)((ui8FastOpenOptLength + ui8PadLength) / UC_4);
+        }
+        else
+        {
+            /* no Fast Open option */
+        }
+        SET_HDR_DATA_OFF(ui32HdrWord, ui8HdrWordsLength);
+
+        /* TODO: consider to set these flags */
+        /*SET_HDR_NS_BIT(ui32HdrWord, 1);
+        SET_HDR_URG_BIT(ui32HdrWord, 0);*/
+
+        /* not ECN-capable packet by default */
+        stIPv4PacketDscpt.ui8Ecn = IPV4_UC_ECN_NOT_ECT;
+        /* if SYN message: request ECN setting ECE and CWR (RFC 3168) */
+        if(KE_MSG_SYN == eMsgType)
+        {
+            if(B_TRUE == B_ECN_ENABLED)
+            {
+                SET_HDR_ECE_BIT(ui32HdrWord, 1);
+                SET_HDR_CWR_BIT(ui32HdrWord, 1);
+            }
+            else
+            {
+                /* ECN is disabled */
+            }
+        }
+        /* else if ECN has been negotiated */
+        else if(B_TRUE == pstConnInfo->bEcn)
+        {
+            /* SYN ACK accepts ECN setting ECE only. Other segments echo congestion experienced marks */
+            if((KE_MSG_SYN_ACK == eMsgType)
+            || ((KE_MSG_RST != eMsgType) && (B_TRUE == pstConnInfo->bEcnEchoPending)))
+            {
+                SET_HDR_ECE_BIT(ui32HdrWord, 1);
+            }
+            else
+            {
+                /* no congestion to echo */
+            }
+            /* if new data segment: retransmissions and pure ACKs are never ECN-capable (RFC 3168) */
+            if((KE_MSG_DATA == eMsgType)
+            && (ui32SeqNumber == GET_SND_NEXT(pstConnInfo)))
+            {
+                stIPv4PacketDscpt.ui8Ecn = IPV4_UC_ECN_ECT_0;
+                /* notify the window reduction, if any */
+                if(B_TRUE == pstConnInfo->bCwrPending)
+                {
+                    SET_HDR_CWR_BIT(ui32HdrWord, 1);
+                    bCwrSent = B_TRUE;
+                }
+                else
+                {
+                    /* no window reduction */
+                }
+            }
+            else
+            {
+                /* not ECN-capable */
+            }
+        }
+        else
+        {
+            /* ECN is not used */
+        }
+
+        switch(eMsgType)
+        {
+            case KE_MSG_ACK:
+            {
+                /* set ACK */
+                SET_HDR_ACK_BIT(ui32HdrWord, 1);
+                break;
+            }
+            case KE_MSG_SYN:
+            {
+                /* set SYN */
+                SET_HDR_SYN_BIT(ui32HdrWord, 1);
+                break;
+            }
+            case KE_MSG_SYN_ACK:
+            {
+                /* set SYN and ACK */
+                SET_HDR_SYN_BIT(ui32HdrWord, 1);
+                SET_HDR_ACK_BIT(ui32HdrWord, 1);
+                break;
+            }
+            case KE_MSG_FIN:
+            {
+                /* set FIN */
+                SET_HDR_FIN_BIT(ui32HdrWord, 1);
+                SET_HDR_ACK_BIT(ui32HdrWord, 1);    /* ATTENTION: FIN packet contains also the ACK flag */
+                break;
+            }
+            case KE_MSG_RST:
+            {
+                SET_HDR_RST_BIT(ui32HdrWord, 1);
+                break;
+            }
+            case KE_MSG_DATA:
+            {
+                SET_HDR_ACK_BIT(ui32HdrWord, 1);
+                SET_HDR_PSH_BIT(ui32HdrWord, 1);    /* ATTENTION: push data! */
+                break;
+            }
+            default:
+            {
+                /* do nothing */
+                break;
+            }
+        }
+
+        /* set window size: free space of the RX buffer */
+        SET_HDR_WINDOW_SIZE(ui32HdrWord, GET_RX_FREE_SPACE(pstConnInfo));
+        WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
+        /* set checksum and urgent pointer */
+        SET_HDR_CHECKSUM(ui32HdrWord, 0);
+        SET_HDR_URG_PTR(ui32HdrWord, 0);
+        WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
+        
+        
+        /* if SYN message */
+        if((KE_MSG_SYN == eMsgType)
+        || (KE_MSG_SYN_ACK == eMsgType))
+        {
+            /* set MSS option: segments are received in a single datagram as well */
+            ui32HdrWord = (((uint32)UC_OPT_KIND_MSS << UL_SHIFT_24) | ((uint32)UC_OPT_LENGTH_MSS << UL_SHIFT_16) | (uint32)US_LOCAL_MSS);
+            WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
+        }
+        else
+        {
+            /* do nothing */
+        }
+
+        /* if Fast Open option is sent */
+        if(ui8FastOpenOptLength > UC_NULL)
+        {
+            /* pad with NOPs first: option ends at the end of the header */
+            pui8OptPtr = (uint8 *)pui32HdrWords;
+            while(ui8PadLength > UC_NULL)
+            {
+                *pui8OptPtr++ = UC_OPT_KIND_NO_OPERATION;
+                ui8PadLength--;
+            }
+            /* set kind, length and cookie, if any */
+            *pui8OptPtr++ = UC_OPT_KIND_FAST_OPEN;
+            *pui8OptPtr++ = ui8FastOpenOptLength;
+            if(NULL_PTR != pstFastOpenCookie)
+            {
+                MEM_COPY(pui8OptPtr, pstFastOpenCookie->aui8Cookie, pstFastOpenCookie->ui8CookieLength);
+            }
+            else
+            {
+                /* empty cookie */
+            }
+        }
+        else
+        {
+            /* no Fast Open option */
+        }
+
+
+        /* set IPv4 descriptor */
+        stIPv4PacketDscpt.enProtocol = IPV4_PROT_TCP;
+        stIPv4PacketDscpt.bDoNotFragment = B_FALSE; /* ATTENTION: this value can change according to application request */
+        stIPv4PacketDscpt.ui16DataLength = (ui16DataLength + ((uint16)(ui8HdrWordsLength * UC_4)));
+        stIPv4PacketDscpt.ui32IPDstAddress = pstConnInfo->ui32DstIPAdd;
+        stIPv4PacketDscpt.ui32IPSrcAddress = pstConnInfo->ui32SrcIPAdd;
+
+        /* sum pseudo header and TCP header. ATTENTION: header length is a multiple of 4 bytes */
+        ui32Sum = IPV4_getPseudoHdrSum(&stIPv4PacketDscpt);
+        ui32Sum = IPV4_copyAndSum(NULL_PTR, pui8BufferPtr, ((uint16)(ui8HdrWordsLength * UC_4)), ui32Sum);
+
+        /* if data message or SYN message carrying data */
+        if((KE_MSG_DATA == eMsgType)
+        || (KE_MSG_SYN == eMsgType))
+        {
+            /* sum data only: they are sent in place from the TX buffer */
+            ui32Sum = IPV4_copyAndSum(NULL_PTR, pui8DataPtr, ui16DataLength, ui32Sum);
+        }
+        else
+        {
+            /* no data */
+            ui16DataLength = US_NULL;
+        }
+
+        /* update checksum field */
+        ui16Checksum = IPV4_foldChecksum(ui32Sum);
+        pui32HdrWords = (uint32 *)pui8BufferPtr;
+        pui32HdrWords += 4;
+        UPDATE_HDR_CHECKSUM(pui32HdrWords, ui16Checksum);
+
+        /* first buffer holds the header only */
+        PBUF_setLength(pstPbuf, ((uint16)(ui8HdrWordsLength * UC_4)));
+
+        /* chain data, if any. ATTENTION: data are not copied, their TX buffer space is held until acknowledged and no more referenced */
+        if(ui16DataLength > US_NULL)
+        {
+            pstDataPbuf = PBUF_allocRef(pui8DataPtr, US_NULL, ui16DataLength, &pstConnInfo->ui8TXDataRefNum);
+            if(pstDataPbuf != NULL_PTR)
+            {
+                PBUF_cat(pstPbuf, pstDataPbuf);
+            }
+            else
+            {
+                /* no free buffers: release the header one */
+                PBUF_free(pstPbuf);
+                pstPbuf = NULL_PTR;
+            }
+        }
+        else
+        {
+            /* header only */
+        }
+
+        /* send TCP segment through IP and check operation result. IP layer releases the chain */
+        if((pstPbuf != NULL_PTR)
+        && (IPV4_OP_OK == IPV4_SendPbuf(stIPv4PacketDscpt, pstPbuf)))
+        {
+            /* operation success */
+            bSuccess = B_TRUE;
+            pstConnInfo->stStats.ui32SegmentsOut++;
+            pstConnInfo->stStats.ui32BytesOut += (uint32)ui16DataLength;
+            /* if CWR has been sent */
+            if(B_TRUE == bCwrSent)
+            {
+                pstConnInfo->bCwrPending = B_FALSE;
+            }
+            else
+            {
+                /* CWR still pending, if any */
+            }
+            if(KE_MSG_RST == eMsgType)
+            {
+                pstConnInfo->stStats.ui32RstOut++;
+            }
+            else
+            {
+                /* not a RST */
+            }
+
+            /* if ACK bit is set, all received data are acknowledged: no more ACK to delay */
+            if((KE_MSG_SYN != eMsgType)
+            && (KE_MSG_RST != eMsgType))
+            {
+                pstConnInfo->ui8UnackedSegNum = UC_NULL;
+                pstConnInfo->ui32DelAckTimerMs = UL_NULL;
+                /* store the advertised window right edge */
+                pstConnInfo->ui32AdvRightEdge = (uint32)(pstConnInfo->ui32AckNumber + GET_RX_FREE_SPACE(pstConnInfo));
+            }
+            else
+            {
+                /* no ACK */
+            }
+        }
+        else
+        {
+            /* IP buffer may be full, return a fail */
+            bSuccess = B_FALSE;
+        }
+    }
+    else
+    {
+        /* IP buffer is full, try later */
+        bSuccess = B_FALSE;
+    }
+
+    return bSuccess;
+}
+
+
+/* allocate and init a CLOSED connection. Return its slot index or UC_NULL_SLOT_INDEX on failure */
+LOCAL uint8 createConnection( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint16 ui16SrcPort, uint16 ui16DstPort, TCP_st_ConnOptions *pstOptions )
+{
+    uint8 *pui8BufPtr;
+    TCP_ke_ConnIndex eConnIndex;
+    uint8 ui8HashIndex;
+    uint16 ui16RXBufferLength;
+    uint16 ui16TXBufferLength;
+
+    /* init connections table at first use */
+    if(B_FALSE == bConnTableInit)
+    {
+        initConnTable();
+    }
+    else
+    {
+        /* already init */
+    }
+
+    /* get RX and TX buffers block from the pool, if their lengths are valid */
+    ui16RXBufferLength = getBufferLength(pstOptions->ui16RXBufferLength);
+    ui16TXBufferLength = getBufferLength(pstOptions->ui16TXBufferLength);
+    if((ui16RXBufferLength != US_NULL)
+    && (ui16TXBufferLength != US_NULL))
+    {
+        pui8BufPtr = allocConnBuffer((uint16)(ui16RXBufferLength + ui16TXBufferLength));
+    }
+    else
+    {
+        /* invalid lengths: connection is not opened */
+        pui8BufPtr = NULL_PTR;
+    }
+    /* get a free connection slot */
+    eConnIndex = (TCP_ke_ConnIndex)allocConnSlot();
+    /* check pointer and slot validity */
+    if((pui8BufPtr != NULL_PTR)
+    && (TCP_KE_NULL_CONN_INDEX != eConnIndex))
+    {
+        if( B_TRUE == pstOptions->bKeepHalfOpen)
+        {
+            /* keep the connection half open if needed */
+            stOpenConnInfo[eConnIndex].bKeepHalfOpen = B_TRUE;
+        }
+        else
+        {
+            /* any other values, do not keep the connection half open if needed. Close it. */
+            stOpenConnInfo[eConnIndex].bKeepHalfOpen = B_FALSE;
+        }
+        /* TX circular buffer follows the RX one and it is empty */
+        stOpenConnInfo[eConnIndex].pui8TXBufferPtr = &pui8BufPtr[ui16RXBufferLength];
+        stOpenConnInfo[eConnIndex].ui16TXBufferLength = ui16TXBufferLength;
+        stOpenConnInfo[eConnIndex].ui16TXReadIndex = US_NULL;
+        stOpenConnInfo[eConnIndex].ui16TXHeldLength = US_NULL;
+        stOpenConnInfo[eConnIndex].ui16PendingTXDataLength = US_NULL;
+        if(B_TRUE == pstOptions->bNoDelay)
+        {
+            /* send small segments immediately */
+            stOpenConnInfo[eConnIndex].bNoDelay = B_TRUE;
+        }
+        else
+        {
+            /* any other values, coalesce small segments */
+            stOpenConnInfo[eConnIndex].bNoDelay = B_FALSE;
+        }
+        /* set RX circular buffer pointer */
+        stOpenConnInfo[eConnIndex].pui8RXBufferPtr = pui8BufPtr;
+        stOpenConnInfo[eConnIndex].ui16RXBufferLength = ui16RXBufferLength;
+        /* RX circular buffer is empty */
+        stOpenConnInfo[eConnIndex].ui16RXReadIndex = US_NULL;
+        stOpenConnInfo[eConnIndex].ui16RXDataLength = US_NULL;
+        stOpenConnInfo[eConnIndex].ui8OooRangesNum = UC_NULL;
+        /* reset sent data length */
+        stOpenConnInfo[eConnIndex].ui16SentDataLength = US_NULL;
+        /* peer window and MSS are unknown until SYN ACK reception */
+        stOpenConnInfo[eConnIndex].ui16PeerWindowSize = US_NULL;
+        stOpenConnInfo[eConnIndex].ui16SendMss = US_DEFAULT_MSS;
+        /* no RTT samples yet: start from the initial retransmission timeout */
+        stOpenConnInfo[eConnIndex].ui32SmoothRttMs = UL_NULL;
+        stOpenConnInfo[eConnIndex].ui32RttVarMs = UL_NULL;
+        stOpenConnInfo[eConnIndex].ui32RtoMs = UL_RTO_INITIAL_MS;
+        /* retransmission and delayed ACK timers are stopped */
+        stOpenConnInfo[eConnIndex].ui32RetxTimerMs = UL_NULL;
+        stOpenConnInfo[eConnIndex].ui32DelAckTimerMs = UL_NULL;
+        stOpenConnInfo[eConnIndex].ui8UnackedSegNum = UC_NULL;
+        stOpenConnInfo[eConnIndex].ui32PersistTimerMs = UL_NULL;
+        /* no window advertised yet */
+        stOpenConnInfo[eConnIndex].ui32AdvRightEdge = UL_NULL;
+        /* no events callback: application polls the connection */
+        stOpenConnInfo[eConnIndex].pvEventCallback = NULL_PTR;
+        /* ECN is not negotiated yet */
+        stOpenConnInfo[eConnIndex].bEcn = B_FALSE;
+        stOpenConnInfo[eConnIndex].bEcnEchoPending = B_FALSE;
+        stOpenConnInfo[eConnIndex].bCwrPending = B_FALSE;
+        stOpenConnInfo[eConnIndex].ui32EcnRecoverSeqNumber = ui32SequenceNumber;
+        /* clear statistics */
+        MEM_SET(&stOpenConnInfo[eConnIndex].stStats, UC_NULL, sizeof(TCP_st_ConnStats));
+        /* Fast Open as requested */
+        TCP_setFastOpen(eConnIndex, pstOptions->bFastOpen);
+        stOpenConnInfo[eConnIndex].ui16SynDataLength = US_NULL;
+        stOpenConnInfo[eConnIndex].ui16SynDataSentLength = US_NULL;
+        /* keepalive as requested */
+        TCP_setKeepAlive(eConnIndex, pstOptions->bKeepAlive, pstOptions->ui32KeepAliveIdleMs, pstOptions->ui32KeepAliveIntvMs, pstOptions->ui8KeepAliveProbesNum);
+        stOpenConnInfo[eConnIndex].ui8RetxCount = UC_NULL;
+        /* at least one retransmission before aborting */
+        stOpenConnInfo[eConnIndex].ui8MaxRetxNum = pstOptions->ui8MaxRetxNum;
+        if(UC_NULL == stOpenConnInfo[eConnIndex].ui8MaxRetxNum)
+        {
+            stOpenConnInfo[eConnIndex].ui8MaxRetxNum = UC_1;
+        }
+        else
+        {
+            /* value is valid */
+        }
+        stOpenConnInfo[eConnIndex].bRttPending = B_FALSE;
+        /* clear connection error */
+        stOpenConnInfo[eConnIndex].eConnError = TCP_KE_ERR_NONE;
+        /* clear ACK number */
+        stOpenConnInfo[eConnIndex].ui32AckNumber = UL_NULL;
+        /* init the sequence number */
+        stOpenConnInfo[eConnIndex].ui32SeqNumber = ui32SequenceNumber;
+        /* update next sequence number */
+        UPDATE_SEQUENCE_NUMBER(ui32SequenceNumber);
+        /* congestion control starts with the default MSS. It is initialized again once the peer MSS is known */
+        initCongestionCtrl(&stOpenConnInfo[eConnIndex]);
+
+        /* store all connections info in the next free position */
+        stOpenConnInfo[eConnIndex].ui16SrcPort = ui16SrcPort;
+        stOpenConnInfo[eConnIndex].ui16DstPort = ui16DstPort;
+        stOpenConnInfo[eConnIndex].ui32SrcIPAdd = ui32SrcIPAdd;
+        stOpenConnInfo[eConnIndex].ui32DstIPAdd = ui32DstIPAdd;
+
+        /* reset to CLOSED state */
+        stOpenConnInfo[eConnIndex].eCurrConnState = KE_CLOSED;
+        /* no pending commands */
+        stOpenConnInfo[eConnIndex].ePendingConnCommand = KE_NO_COMMAND;
+        /* slot is released on close request only */
+        stOpenConnInfo[eConnIndex].bReleaseReq = B_FALSE;
+        /* not owned by any listener */
+        stOpenConnInfo[eConnIndex].ui8ListenerIndex = (uint8)TCP_KE_NULL_LISTENER_INDEX;
+
+        /* insert the connection at the head of its hash chain */
+        ui8HashIndex = getConnHash(ui32DstIPAdd, ui16SrcPort, ui16DstPort);
+        stOpenConnInfo[eConnIndex].ui8NextSlotIndex = aui8ConnHashTable[ui8HashIndex];
+        aui8ConnHashTable[ui8HashIndex] = (uint8)eConnIndex;
+    }
+    else
+    {
+        /* fail to open the connection: give back allocated resources */
+        if(pui8BufPtr != NULL_PTR)
+        {
+            freeConnBuffer(pui8BufPtr, (uint16)(ui16RXBufferLength + ui16TXBufferLength));
+        }
+        else
+        {
+            /* buffer not allocated */
+        }
+        if(TCP_KE_NULL_CONN_INDEX != eConnIndex)
+        {
+            /* slot is not in any hash chain yet: put it back into the free list */
+            stOpenConnInfo[eConnIndex].bInUse = B_FALSE;
+            stOpenConnInfo[eConnIndex].ui8NextSlotIndex = ui8FreeSlotIndex;
+            ui8FreeSlotIndex = (uint8)eConnIndex;
+            eConnIndex = TCP_KE_NULL_CONN_INDEX;
+        }
+        else
+        {
+            /* no free slots */
+        }
+    }
+
+    return (uint8)eConnIndex;
+}
+
+
+/* create a connection for a SYN received on a listened port and answer with a SYN ACK */
+LOCAL void acceptIncomingConn( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint16 ui16SrcPort, uint16 ui16DstPort, uint32 ui32PeerSeqNumber, uint16 ui16PeerWindowSize, st_RXOptions *pstRXOptions )
+{
+    uint8 ui8ListenerIndex;
+    uint8 ui8SlotIndex;
+    st_OpenConnInfo *pstConnInfo;
+    TCP_st_ConnOptions stOptions;
+
+    /* look for a listener of the destination port and address */
+    for(ui8ListenerIndex = UC_NULL; ui8ListenerIndex < UC_NUM_OF_MAX_LISTENERS; ui8ListenerIndex++)
+    {
+        if((B_TRUE == stListenerInfo[ui8ListenerIndex].bInUse)
+        && (stListenerInfo[ui8ListenerIndex].ui16LocalPort == ui16DstPort)
+        && ((stListenerInfo[ui8ListenerIndex].ui32LocalIPAdd == ui32DstIPAdd) || (stListenerInfo[ui8ListenerIndex].ui32LocalIPAdd == UL_NULL)))
+        {
+            /* listener found */
+            break;
+        }
+        else
+        {
+            /* go on */
+        }
+    }
+
+    /* if listener exists and its backlog is not full */
+    if((ui8ListenerIndex < UC_NUM_OF_MAX_LISTENERS)
+    && (stListenerInfo[ui8ListenerIndex].ui8PendingConnNum < stListenerInfo[ui8ListenerIndex].ui8Backlog))
+    {
+        /* create the connection: local end is the destination */
+        /* default options but listener half open behaviour */
+        TCP_getDefaultConnOptions(&stOptions);
+        stOptions.bKeepHalfOpen = stListenerInfo[ui8ListenerIndex].bKeepHalfOpen;
+        ui8SlotIndex = createConnection(ui32DstIPAdd, ui32SrcIPAdd, ui16DstPort, ui16SrcPort, &stOptions);
+        if(ui8SlotIndex != UC_NULL_SLOT_INDEX)
+        {
+            pstConnInfo = &stOpenConnInfo[ui8SlotIndex];
+
+            /* connection belongs to the listener until accepted: release it if closed before */
+            pstConnInfo->ui8ListenerIndex = ui8ListenerIndex;
+            pstConnInfo->bReleaseReq = B_TRUE;
+            stListenerInfo[ui8ListenerIndex].ui8PendingConnNum++;
+
+            /* acknowledge peer SYN and store its window and MSS */
+            pstConnInfo->ui32AckNumber = (uint32)(ui32PeerSeqNumber + UL_1);
+            pstConnInfo->ui16PeerWindowSize = ui16PeerWindowSize;
+            pstConnInfo->ui16SendMss = getSendMss(pstRXOptions);
+            initCongestionCtrl(pstConnInfo);
+            /* accept ECN if the peer requests it */
+            if((B_TRUE == B_ECN_ENABLED)
+            && (B_TRUE == pstRXOptions->bEcnSetup))
+            {
+                pstConnInfo->bEcn = B_TRUE;
+            }
+            else
+            {
+                pstConnInfo->bEcn = B_FALSE;
             }
+
+            /* SYN ACK takes one sequence number */
+            pstConnInfo->ui16SentDataLength = UC_1;
+            prepareAndSendMsg(pstConnInfo, KE_MSG_SYN_ACK, pstConnInfo->ui32SeqNumber, NULL_PTR, US_NULL);
+
+            /* SYN ACK shall be acknowledged: start retransmission timer. A failed send is retransmitted at timer expiry */
+            startRetxTimer(pstConnInfo, pstConnInfo->ui32SeqNumber);
+
+            pstConnInfo->eCurrConnState = KE_SYN_RECEIVED;
         }
         else
         {
-            /* this packet has not ACK bit set, do nothing. Manage ACK packets only */
+            /* no free slots: ignore the SYN. The peer retries later */
         }
     }
     else
     {
-        /* related connection doesn't exist */
+        /* port not listened or backlog full: ignore the SYN */
     }
 }
 
 
-
-
-/* ------------------- Local functions declaration ---------------- */
-
-/* get received data from packet */
-LOCAL void getReceivedData( uint8 ui8SocketIndex, uint32 * pui32HdrPtr, uint16 ui16DataLengthToCopy )
+/* parse received options. Unknown options are skipped */
+LOCAL void parseOptions( uint8 *pui8OptPtr, uint8 ui8OptLength, st_RXOptions *pstRXOptions )
 {
-    /* if there are data */
-    if(ui16DataLengthToCopy > US_NULL)
+    uint8 ui8Index = UC_NULL;
+    uint8 ui8Kind;
+    uint8 ui8Length;
+
+    /* set default values */
+    pstRXOptions->ui16PeerMss = US_DEFAULT_MSS;
+    pstRXOptions->bFastOpen = B_FALSE;
+    pstRXOptions->pui8FastOpenCookiePtr = NULL_PTR;
+    pstRXOptions->ui8FastOpenCookieLength = UC_NULL;
+
+    /* parse all options */
+    while(ui8Index < ui8OptLength)
     {
-        /* if received data are more than available space */
-        if((stOpenConnInfo[ui8SocketIndex].ui16RXDataLength + ui16DataLengthToCopy) > US_MAX_RX_DATA_LENGTH_ALLOWED)
+        /* get option kind */
+        ui8Kind = pui8OptPtr[ui8Index];
+
+        if(UC_OPT_KIND_END_OF_LIST == ui8Kind)
         {
-            /* maximum RX data length to copy */
-            ui16DataLengthToCopy = (uint16)(US_MAX_RX_DATA_LENGTH_ALLOWED - stOpenConnInfo[ui8SocketIndex].ui16RXDataLength);
+            /* no more options */
+            ui8Index = ui8OptLength;
         }
-        else
+        else if(UC_OPT_KIND_NO_OPERATION == ui8Kind)
         {
-            /* else there is still enough space in the RX buffer: copy all received data */
+            /* single byte padding */
+            ui8Index++;
         }
+        /* else if option length is available */
+        else if((uint8)(ui8Index + UC_1) < ui8OptLength)
+        {
+            /* get option length. It includes kind and length bytes */
+            ui8Length = pui8OptPtr[ui8Index + UC_1];
+
+            /* if length is not valid */
+            if((ui8Length < UC_2)
+            || (ui8Length > (uint8)(ui8OptLength - ui8Index)))
+            {
+                /* malformed options: stop parsing */
+                ui8Index = ui8OptLength;
+            }
+            else
+            {
+                /* if MSS option */
+                if((UC_OPT_KIND_MSS == ui8Kind)
+                && (UC_OPT_LENGTH_MSS == ui8Length))
+                {
+                    pstRXOptions->ui16PeerMss = (uint16)(((uint16)pui8OptPtr[ui8Index + UC_2] << US_SHIFT_8) | (uint16)pui8OptPtr[ui8Index + UC_3]);
+                }
+                /* else if Fast Open option */
+                else if(UC_OPT_KIND_FAST_OPEN == ui8Kind)
+                {
+                    pstRXOptions->bFastOpen = B_TRUE;
+                    /* if cookie length is valid: an even length between min and max ones (RFC 7413) */
+                    if(((uint8)(ui8Length - UC_OPT_LENGTH_FAST_OPEN_MIN) >= UC_FAST_OPEN_COOKIE_MIN_LENGTH)
+                    && ((uint8)(ui8Length - UC_OPT_LENGTH_FAST_OPEN_MIN) <= UC_FAST_OPEN_COOKIE_MAX_LENGTH)
+                    && (UC_0 == (ui8Length & UC_1)))
+                    {
+                        pstRXOptions->pui8FastOpenCookiePtr = &pui8OptPtr[ui8Index + UC_OPT_LENGTH_FAST_OPEN_MIN];
+                        pstRXOptions->ui8FastOpenCookieLength = (uint8)(ui8Length - UC_OPT_LENGTH_FAST_OPEN_MIN);
+                    }
+                    else
+                    {
+                        /* no cookie or invalid one */
+                    }
+                }
+                else
+                {
+                    /* unknown option: skip it */
+                }
 
-        /* copy received data */
-        MEM_COPY(stOpenConnInfo[ui8SocketIndex].pui8RXDataPtr,
-                 pui32HdrPtr,
-                 ui16DataLengthToCopy);
+                /* next option */
+                ui8Index += ui8Length;
+            }
+        }
+        else
+        {
+            /* truncated option: stop parsing */
+            ui8Index = ui8OptLength;
+        }
+    }
+}
 
-        /* increment RX data length */
-        stOpenConnInfo[ui8SocketIndex].ui16RXDataLength += ui16DataLengthToCopy;
 
-        /* increment RX data pointer */
-        stOpenConnInfo[ui8SocketIndex].pui8RXDataPtr += ui16DataLengthToCopy;
+/* get the MSS to send: lowest between local and peer ones */
+LOCAL uint16 getSendMss( st_RXOptions *pstRXOptions )
+{
+    uint16 ui16Mss;
 
-        /* set flag. ATTENTION: should be an atomic operation */
-        stOpenConnInfo[ui8SocketIndex].bNewRXAvailData = B_TRUE;
+    /* if peer MSS is valid and lower than the local one */
+    if((pstRXOptions->ui16PeerMss < US_LOCAL_MSS)
+    && (pstRXOptions->ui16PeerMss > US_NULL))
+    {
+        ui16Mss = pstRXOptions->ui16PeerMss;
     }
     else
     {
-        /* length is more than maximum available: discard data at the moment */
+        ui16Mss = US_LOCAL_MSS;
     }
+
+    return ui16Mss;
 }
 
 
-/* prepare and send a SYN message */
-LOCAL boolean prepareAndSendMsg( st_OpenConnInfo *pstConnInfo, ke_MsgType eMsgType, uint8 *pui8DataPtr, uint16 ui16DataLength )
+/* get the cached Fast Open cookie of a server. Return NULL_PTR if none is cached */
+LOCAL st_FastOpenCookie * getFastOpenCookie( uint32 ui32IPAdd )
 {
-    boolean bSuccess;
-    uint8 *pui8BufferPtr;
-    uint32 *pui32HdrWords;
-    uint32 ui32HdrWord = UL_NULL;   /* it is very important to clean this variable */
-    uint16 ui16Checksum;
-    uint8 ui8HdrWordsLength;
-    IPv4_st_PacketDescriptor stIPv4PacketDscpt;
+    st_FastOpenCookie *pstCookie = NULL_PTR;
+    uint8 ui8Index;
 
-    /* get next free buffer pointer from IP */
-    pui8BufferPtr = (uint8 *)IPV4_getDataBuffPtr();
-    if(pui8BufferPtr != NULL)
+    /* look for the server among valid entries */
+    for(ui8Index = UC_NULL; ui8Index < UC_FAST_OPEN_CACHE_SIZE; ui8Index++)
     {
-        /* perform a 32-bit word alignment */
-        ALIGN_32BIT_OF_8BIT_PTR(pui8BufferPtr);
-        /* set 32-bit header pointer */
-        pui32HdrWords = (uint32 *)pui8BufferPtr;
-
-        /* TODO: consider to clear the buffer */
-        /*memset(pui32HdrWords, UC_NULL, (ui16DataLength + UC_TCP_HDR_MIN_LENGTH_BYTES));*/
-
-        SET_HDR_SRC_PORT(ui32HdrWord, pstConnInfo->ui16SrcPort);
-        SET_HDR_DST_PORT(ui32HdrWord, pstConnInfo->ui16DstPort);
-        WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
-        SET_HDR_SEQ_NUM(ui32HdrWord, pstConnInfo->ui32SeqNumber);
-        WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
-        SET_HDR_ACK_NUM(ui32HdrWord, pstConnInfo->ui32AckNumber);
-        WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
-        /* set TCP header size in 32-bit words */
-        ui8HdrWordsLength = UC_TCP_HDR_MIN_LENGTH_WORDS;
-        /* OPTIONS TEST! */
-        if(KE_MSG_SYN == eMsgType)
+        if((stFastOpenCache[ui8Index].ui8CookieLength > UC_NULL)
+        && (ui32IPAdd == stFastOpenCache[ui8Index].ui32IPAdd))
         {
-            /* add TEST option length! */
-            ui8HdrWordsLength += UC_1;
+            pstCookie = &stFastOpenCache[ui8Index];
         }
         else
         {
-            /* length is already updated */
+            /* go on */
         }
-        SET_HDR_DATA_OFF(ui32HdrWord, ui8HdrWordsLength);
-
-        /* TODO: consider to set these flags */
-        /*SET_HDR_NS_BIT(ui32HdrWord, 1);
-        SET_HDR_CWR_BIT(ui32HdrWord, 0);
-        SET_HDR_ECE_BIT(ui32HdrWord, 1);
-        SET_HDR_URG_BIT(ui32HdrWord, 0);*/
+    }
 
-        switch(eMsgType)
-        {
-            case KE_MSG_ACK:
-            {
-                /* set ACK */
-                SET_HDR_ACK_BIT(ui32HdrWord, 1);
-                break;
-            }
-            case KE_MSG_SYN:
-            {
-                /* set SYN */
-                SET_HDR_SYN_BIT(ui32HdrWord, 1);
-                break;
-            }
-            case KE_MSG_FIN:
-            {
-                /* set FIN */
-                SET_HDR_FIN_BIT(ui32HdrWord, 1);
-                SET_HDR_ACK_BIT(ui32HdrWord, 1);    /* ATTENTION: FIN packet contains also the ACK flag */
-                break;
-            }
-            case KE_MSG_RST:
-            {
-                SET_HDR_RST_BIT(ui32HdrWord, 1);
-                break;
-            }
-            case KE_MSG_DATA:
-            {
-                SET_HDR_ACK_BIT(ui32HdrWord, 1);
-                SET_HDR_PSH_BIT(ui32HdrWord, 1);    /* ATTENTION: push data! */
-                break;
-            }
-            default:
-            {
-                /* do nothing */
-                break;
-            }
-        }
+    return pstCookie;
+}
 
-        /* set window size */
-        SET_HDR_WINDOW_SIZE(ui32HdrWord, TCP_DEFAULT_WINDOW_SIZE);
-        WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
-        /* set checksum and urgent pointer */
-        SET_HDR_CHECKSUM(ui32HdrWord, 0);
-        SET_HDR_URG_PTR(ui32HdrWord, 0);
-        WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
-        
-        
-        /* OPTIONS TEST! */
-        if(KE_MSG_SYN == eMsgType)
-        {
-            ui32HdrWord = 0x020405B4;
-            WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
-        }
-        else
-        {
-            /* do nothing */
-        }
 
+/* cache the Fast Open cookie of a server replacing any previous one. A null length removes it */
+LOCAL void storeFastOpenCookie( uint32 ui32IPAdd, uint8 *pui8CookiePtr, uint8 ui8CookieLength )
+{
+    st_FastOpenCookie *pstCookie;
 
-        /* attach data */
-        if(KE_MSG_DATA == eMsgType)
+    /* get server entry, if any */
+    pstCookie = getFastOpenCookie(ui32IPAdd);
+    /* if server has not a cookie yet and a new one is received */
+    if((NULL_PTR == pstCookie)
+    && (ui8CookieLength > UC_NULL))
+    {
+        /* replace the oldest entry */
+        pstCookie = &stFastOpenCache[ui8FastOpenCacheNextIndex];
+        ui8FastOpenCacheNextIndex++;
+        if(ui8FastOpenCacheNextIndex >= UC_FAST_OPEN_CACHE_SIZE)
         {
-            /* attach data */
-            MEM_COPY((uint8 *)pui32HdrWords, pui8DataPtr, ui16DataLength);
+            ui8FastOpenCacheNextIndex = UC_NULL;
         }
         else
         {
-            /* do nothing */
+            /* no wrap around */
         }
+    }
+    else
+    {
+        /* update or remove existing entry, if any */
+    }
 
-        /* set IPv4 descriptor */
-        stIPv4PacketDscpt.enProtocol = IPV4_PROT_TCP;
-        stIPv4PacketDscpt.bDoNotFragment = B_FALSE; /* ATTENTION: this value can change according to application request */
-        stIPv4PacketDscpt.ui16DataLength = (ui16DataLength + ((uint16)(ui8HdrWordsLength * UC_4)));
-        stIPv4PacketDscpt.ui32IPDstAddress = pstConnInfo->ui32DstIPAdd;
-        stIPv4PacketDscpt.ui32IPSrcAddress = pstConnInfo->ui32SrcIPAdd;
+    /* if there is an entry to update */
+    if(NULL_PTR != pstCookie)
+    {
+        pstCookie->ui32IPAdd = ui32IPAdd;
+        pstCookie->ui8CookieLength = ui8CookieLength;
+        MEM_COPY(pstCookie->aui8Cookie, pui8CookiePtr, ui8CookieLength);
+    }
+    else
+    {
+        /* nothing to remove */
+    }
+}
 
-        /* calculate and update checksum field */
-        pui32HdrWords = (uint32 *)pui8BufferPtr;
-        ui16Checksum = calculateChecksum(&stIPv4PacketDscpt, (uint16 *)pui32HdrWords);
-        pui32HdrWords += 4;
-        UPDATE_HDR_CHECKSUM(pui32HdrWords, ui16Checksum);
 
-        /* send TCP segment through IP and check operation result */
-        if(IPV4_OP_OK == IPV4_SendPacket(stIPv4PacketDscpt))
+/* get a pointer to pending TX data to send with the SYN. Return their length: 0 if Fast Open is disabled or no cookie of the server is cached */
+LOCAL uint16 getSynDataSpan( st_OpenConnInfo *pstConnInfo, uint8 **ppui8DataPtr )
+{
+    uint16 ui16DataLength;
+
+    /* if Fast Open is enabled, a cookie is cached and there are data */
+    if((B_TRUE == pstConnInfo->bFastOpen)
+    && (NULL_PTR != getFastOpenCookie(pstConnInfo->ui32DstIPAdd))
+    && (pstConnInfo->ui16PendingTXDataLength > US_NULL))
+    {
+        /* limit length to one segment the server can surely receive */
+        ui16DataLength = pstConnInfo->ui16PendingTXDataLength;
+        if(ui16DataLength > US_FAST_OPEN_MAX_SYN_DATA_LENGTH)
         {
-            /* operation success */
-            bSuccess = B_TRUE;
+            ui16DataLength = US_FAST_OPEN_MAX_SYN_DATA_LENGTH;
         }
         else
         {
-            /* IP buffer may be full, return a fail */
-            bSuccess = B_FALSE;
+            /* length is already valid */
         }
+        /* ATTENTION: data do not wrap around the end of the TX buffer */
+        ui16DataLength = getTXDataSpan(pstConnInfo, US_NULL, ui16DataLength, ppui8DataPtr);
     }
     else
     {
-        /* IP buffer is full, try later */
-        bSuccess = B_FALSE;
+        /* normal SYN */
+        ui16DataLength = US_NULL;
+        *ppui8DataPtr = NULL_PTR;
     }
 
-    return bSuccess;
+    return ui16DataLength;
 }
 
 
-/* get socket index from src and dst addresses and ports */
+/* get the connection slot index of a received segment looking up its hash chain */
 LOCAL uint8 getSocketIndex(uint32 ui32SourceAdd, uint32 ui32DestAdd, uint16 ui16SourcePort, uint16 ui16DestPort)
 {
-    uint8 ui8SktIdx = UC_NULL;
+    uint8 ui8SktIdx = UC_NULL_SLOT_INDEX;
+
+    /* if no connections have been opened yet, the hash table is not init */
+    if(B_TRUE == bConnTableInit)
+    {
+        /* get the first slot of the related hash chain: the remote end is the source */
+        ui8SktIdx = aui8ConnHashTable[getConnHash(ui32SourceAdd, ui16DestPort, ui16SourcePort)];
+    }
+    else
+    {
+        /* no connections */
+    }
 
-    /* search socket */
-    while(  (   (stOpenConnInfo[ui8SktIdx].eCurrConnState == KE_CLOSED) /* socket is still open */
+    /* search socket along the chain */
+    while(  (ui8SktIdx != UC_NULL_SLOT_INDEX)
+    &&      (   (stOpenConnInfo[ui8SktIdx].eCurrConnState == KE_CLOSED) /* socket is still open */
             ||  ((stOpenConnInfo[ui8SktIdx].ui32SrcIPAdd != ui32DestAdd) && (stOpenConnInfo[ui8SktIdx].ui32SrcIPAdd != 0x00000000))     /* this device is the destination or source address is not 0.0.0.0 */
-            ||  ((stOpenConnInfo[ui8SktIdx].ui32DstIPAdd != ui32SourceAdd) && (stOpenConnInfo[ui8SktIdx].ui32DstIPAdd != 0xFFFFFFFF))   /* the sender is the expected one or destination address is not a IP broadcast address */
+            ||  (stOpenConnInfo[ui8SktIdx].ui32DstIPAdd != ui32SourceAdd)   /* the sender is the expected one */
             ||  (stOpenConnInfo[ui8SktIdx].ui16SrcPort != ui16DestPort)     /* destination port is this one */
-            ||  (stOpenConnInfo[ui8SktIdx].ui16DstPort != ui16SourcePort))  /* source port is the expected one */
-    &&      (ui8SktIdx < UC_NUM_OF_MAX_CONN))
-
+            ||  (stOpenConnInfo[ui8SktIdx].ui16DstPort != ui16SourcePort))) /* source port is the expected one */
     {
-        /* next socket */
-        ui8SktIdx++;
+        /* next socket in the chain */
+        ui8SktIdx = stOpenConnInfo[ui8SktIdx].ui8NextSlotIndex;
     }
 
     return ui8SktIdx;
 }
 
 
-/* Function to calculate checksum */
-LOCAL uint16 calculateChecksum(IPv4_st_PacketDescriptor *stIPv4Header, uint16 *pui16TCPSegment)
+/* get the hash table index of a connection from remote address and local and remote ports */
+LOCAL uint8 getConnHash(uint32 ui32RemoteAdd, uint16 ui16LocalPort, uint16 ui16RemotePort)
+{
+    uint32 ui32Hash;
+
+    /* fold all fields into 32 bits. ATTENTION: the local address is not hashed since it can be 0.0.0.0 */
+    ui32Hash = ui32RemoteAdd ^ (((uint32)ui16LocalPort << UL_SHIFT_16) | (uint32)ui16RemotePort);
+    /* mix upper bits into the lower ones */
+    ui32Hash ^= (ui32Hash >> UL_SHIFT_16);
+    ui32Hash ^= (ui32Hash >> UL_SHIFT_8);
+
+    return (uint8)(ui32Hash & UC_CONN_HASH_MASK);
+}
+
+
+/* init connections hash table and free slots list */
+LOCAL void initConnTable( void )
+{
+    uint8 ui8Index;
+
+    /* all hash chains are empty */
+    for(ui8Index = UC_NULL; ui8Index < UC_CONN_HASH_TABLE_SIZE; ui8Index++)
+    {
+        aui8ConnHashTable[ui8Index] = UC_NULL_SLOT_INDEX;
+    }
+
+    /* link all slots into the free list */
+    for(ui8Index = UC_NULL; ui8Index < UC_NUM_OF_MAX_CONN; ui8Index++)
+    {
+        stOpenConnInfo[ui8Index].bInUse = B_FALSE;
+        stOpenConnInfo[ui8Index].eCurrConnState = KE_CLOSED;
+        stOpenConnInfo[ui8Index].ePendingConnCommand = KE_NO_COMMAND;
+        stOpenConnInfo[ui8Index].ui32RetxTimerMs = UL_NULL;
+        stOpenConnInfo[ui8Index].ui8NextSlotIndex = (uint8)(ui8Index + UC_1);
+    }
+    stOpenConnInfo[UC_NUM_OF_MAX_CONN - UC_1].ui8NextSlotIndex = UC_NULL_SLOT_INDEX;
+    ui8FreeSlotIndex = UC_NULL;
+
+    /* all pool units are free */
+    freeConnBuffer(aui8ConnBufferPool, (uint16)(US_NUM_OF_BUFFER_UNITS * US_BUFFER_UNIT_LENGTH));
+
+    /* table is ready */
+    bConnTableInit = B_TRUE;
+}
+
+
+/* get a slot from the free list. Return UC_NULL_SLOT_INDEX if none is free */
+LOCAL uint8 allocConnSlot( void )
+{
+    uint8 ui8SlotIndex;
+
+    /* get the head of the free list */
+    ui8SlotIndex = ui8FreeSlotIndex;
+    if(ui8SlotIndex != UC_NULL_SLOT_INDEX)
+    {
+        /* remove it from the list */
+        ui8FreeSlotIndex = stOpenConnInfo[ui8SlotIndex].ui8NextSlotIndex;
+        stOpenConnInfo[ui8SlotIndex].ui8NextSlotIndex = UC_NULL_SLOT_INDEX;
+        stOpenConnInfo[ui8SlotIndex].bInUse = B_TRUE;
+    }
+    else
+    {
+        /* no free slots */
+    }
+
+    return ui8SlotIndex;
+}
+
+
+/* remove a slot from its hash chain, give back its buffers and put it back into the free list */
+LOCAL void releaseConnSlot( uint8 ui8SlotIndex )
 {
-    uint32 ui32Sum = 0;
-    uint16 ui16Length = stIPv4Header->ui16DataLength;
+    st_OpenConnInfo *pstConnInfo = &stOpenConnInfo[ui8SlotIndex];
+    uint8 *pui8LinkPtr;
+
+    /* look for the link pointing to this slot along its hash chain */
+    pui8LinkPtr = &aui8ConnHashTable[getConnHash(pstConnInfo->ui32DstIPAdd, pstConnInfo->ui16SrcPort, pstConnInfo->ui16DstPort)];
+    while((*pui8LinkPtr != UC_NULL_SLOT_INDEX)
+    &&    (*pui8LinkPtr != ui8SlotIndex))
+    {
+        pui8LinkPtr = &stOpenConnInfo[*pui8LinkPtr].ui8NextSlotIndex;
+    }
+    /* unlink it */
+    if(*pui8LinkPtr == ui8SlotIndex)
+    {
+        *pui8LinkPtr = pstConnInfo->ui8NextSlotIndex;
+    }
+    else
+    {
+        /* ATTENTION: slot not found in its chain. It should not happen */
+    }
+
+    /* if the connection has been closed before being accepted */
+    if(pstConnInfo->ui8ListenerIndex != (uint8)TCP_KE_NULL_LISTENER_INDEX)
+    {
+        /* it is no longer pending on its listener */
+        stListenerInfo[pstConnInfo->ui8ListenerIndex].ui8PendingConnNum--;
+        pstConnInfo->ui8ListenerIndex = (uint8)TCP_KE_NULL_LISTENER_INDEX;
+    }
+    else
+    {
+        /* active or accepted connection */
+    }
+
+    /* give back RX and TX buffers block, if not already done on reset */
+    releaseConnBuffer(pstConnInfo);
 
-    ui32Sum += ((SWAP_BYTES_ORDER_32BIT_(stIPv4Header->ui32IPSrcAddress) >> UL_SHIFT_16) & 0xFFFF);
-    ui32Sum += (SWAP_BYTES_ORDER_32BIT_(stIPv4Header->ui32IPSrcAddress) & 0xFFFF);
+    /* slot is free */
+    pstConnInfo->bInUse = B_FALSE;
+    pstConnInfo->bReleaseReq = B_FALSE;
+    pstConnInfo->ePendingConnCommand = KE_NO_COMMAND;
+    pstConnInfo->ui32RetxTimerMs = UL_NULL;
+
+    /* put it at the head of the free list */
+    pstConnInfo->ui8NextSlotIndex = ui8FreeSlotIndex;
+    ui8FreeSlotIndex = ui8SlotIndex;
+}
 
-    ui32Sum += ((SWAP_BYTES_ORDER_32BIT_(stIPv4Header->ui32IPDstAddress) >> UL_SHIFT_16) & 0xFFFF);
-    ui32Sum += (SWAP_BYTES_ORDER_32BIT_(stIPv4Header->ui32IPDstAddress) & 0xFFFF);
 
-    ui32Sum += SWAP_BYTES_ORDER_16BIT_(stIPv4Header->enProtocol);
+/* get a RX and TX buffers block of the given length from the pool: first run of free units long enough. Return NULL_PTR if none is found */
+LOCAL uint8 * allocConnBuffer( uint16 ui16Length )
+{
+    uint8 *pui8BufPtr;
+    uint16 ui16UnitsNum = GET_BUFFER_UNITS_NUM(ui16Length);
+    uint16 ui16RunLength = US_NULL;
+    uint16 ui16Index;
 
-    ui32Sum += SWAP_BYTES_ORDER_16BIT_(stIPv4Header->ui16DataLength);
+    /* look for enough contiguous free units */
+    for(ui16Index = US_NULL; (ui16Index < US_NUM_OF_BUFFER_UNITS) && (ui16RunLength < ui16UnitsNum); ui16Index++)
+    {
+        if(B_TRUE == abBufferUnitUsed[ui16Index])
+        {
+            /* run is broken: start again from the next unit */
+            ui16RunLength = US_NULL;
+        }
+        else
+        {
+            ui16RunLength++;
+        }
+    }
 
-    while( ui16Length > 1 )
+    /* if a run has been found */
+    if(ui16RunLength == ui16UnitsNum)
+    {
+        /* take its units: it ends at the last checked one */
+        ui16Index -= ui16UnitsNum;
+        pui8BufPtr = &aui8ConnBufferPool[(uint32)ui16Index * US_BUFFER_UNIT_LENGTH];
+        while(ui16RunLength > US_NULL)
+        {
+            abBufferUnitUsed[ui16Index] = B_TRUE;
+            ui16Index++;
+            ui16RunLength--;
+        }
+    }
+    else
     {
-        ui32Sum += *pui16TCPSegment;
-        pui16TCPSegment++;
-        ui16Length -= 2;
+        /* pool is exhausted or too fragmented */
+        pui8BufPtr = NULL_PTR;
     }
 
-    if( ui16Length > 0 )
+    return pui8BufPtr;
+}
+
+
+/* give back a buffers block of the given length to the pool */
+LOCAL void freeConnBuffer( uint8 *pui8BufPtr, uint16 ui16Length )
+{
+    uint16 ui16UnitsNum = GET_BUFFER_UNITS_NUM(ui16Length);
+    uint16 ui16Index;
+
+    /* free all block units */
+    ui16Index = (uint16)((pui8BufPtr - aui8ConnBufferPool) / US_BUFFER_UNIT_LENGTH);
+    while(ui16UnitsNum > US_NULL)
     {
-        ui32Sum += ((*pui16TCPSegment) & SWAP_BYTES_ORDER_16BIT_(0xFF00));
+        abBufferUnitUsed[ui16Index] = B_FALSE;
+        ui16Index++;
+        ui16UnitsNum--;
     }
+}
 
-    /* Fold 32-bit sum to 16 bits: add carrier to result */
-    while( ui32Sum >> 16 )
+
+/* check a requested RX or TX buffer length. Return it if it is within allowed values, 0 otherwise */
+LOCAL uint16 getBufferLength( uint16 ui16Length )
+{
+    if((ui16Length < US_MIN_BUFFER_LENGTH)
+    || (ui16Length > US_MAX_BUFFER_LENGTH))
     {
-        ui32Sum = (ui32Sum & 0xFFFF) + (ui32Sum >> 16);
+        /* reject it: it would not be the requested one */
+        ui16Length = US_NULL;
     }
-    ui32Sum = ~ui32Sum;
+    else
+    {
+        /* length is valid */
+    }
+
+    return ui16Length;
+}
+
+
+/* give back the RX and TX buffers block of a connection to the pool, if it has one */
+LOCAL void releaseConnBuffer( st_OpenConnInfo *pstConnInfo )
+{
+    /* if buffers have not been given back yet */
+    if(NULL_PTR != pstConnInfo->pui8RXBufferPtr)
+    {
+        /* queued segments shall not reference TX buffer data once the block is given back */
+        if(pstConnInfo->ui8TXDataRefNum > UC_NULL)
+        {
+            IPV4_discardPbufs(&pstConnInfo->ui8TXDataRefNum);
+        }
+        else
+        {
+            /* no referenced data */
+        }
 
-    /* swap bytes order */
-    ui32Sum = SWAP_BYTES_ORDER_16BIT_(ui32Sum);
+        /* RX buffer is at the beginning of the block, TX one follows it */
+        freeConnBuffer(pstConnInfo->pui8RXBufferPtr, (uint16)(pstConnInfo->ui16RXBufferLength + pstConnInfo->ui16TXBufferLength));
+    }
+    else
+    {
+        /* already given back */
+    }
 
-    return (uint16)ui32Sum;
+    /* connection has no buffers: nothing to read or to send */
+    pstConnInfo->pui8RXBufferPtr = NULL_PTR;
+    pstConnInfo->pui8TXBufferPtr = NULL_PTR;
+    pstConnInfo->ui16RXDataLength = US_NULL;
+    pstConnInfo->ui16RXReadIndex = US_NULL;
+    pstConnInfo->ui8OooRangesNum = UC_NULL;
+    pstConnInfo->ui16PendingTXDataLength = US_NULL;
+    pstConnInfo->ui16SentDataLength = US_NULL;
+    pstConnInfo->ui16TXHeldLength = US_NULL;
 }
 
 
 
 
+
+
 /* End of file */
@@ -38,30 +38,164 @@
 
 
 
+/* ------------ Exported defines --------------- */
+
+/* Maximum number of TCP connections. It can be overridden at build time. ATTENTION: it shall be less than 255 */
+#ifndef TCP_UC_MAX_CONN_NUM
+#define TCP_UC_MAX_CONN_NUM     16
+#endif
+
+/* Maximum number of TCP listeners. It can be overridden at build time */
+#ifndef TCP_UC_MAX_LISTEN_NUM
+#define TCP_UC_MAX_LISTEN_NUM   4
+#endif
+
+/* Request ECN on opened connections and accept it on incoming ones: 1 to enable, 0 to disable. It can be overridden at build time */
+#ifndef TCP_UC_ECN_ENABLE
+#define TCP_UC_ECN_ENABLE       1
+#endif
+
+/* Number of connection RX and TX buffers in the static pool: it limits simultaneously open connections. It can be overridden at build time */
+#ifndef TCP_UC_BUFFER_POOL_NUM
+#define TCP_UC_BUFFER_POOL_NUM  4
+#endif
+
+
+
 /* ------------ Exported enums --------------- */
 
-/* TCP connection indexes */
+/* TCP connection indexes. They are allocated by TCP_openConnection */
 typedef enum
 {
     TCP_KE_FIRST_CONN,
-    TCP_KE_CONN_1 = TCP_KE_FIRST_CONN,
-    TCP_KE_CONN_2,
-    TCP_KE_CONN_3,
-    TCP_KE_CONN_4,
-    TCP_KE_LAST_CONN = TCP_KE_CONN_4,
-    TCP_KE_CONN_MAX_NUM,
+    TCP_KE_CONN_MAX_NUM = TCP_UC_MAX_CONN_NUM,
     TCP_KE_NULL_CONN_INDEX = 0xFF  
 } TCP_ke_ConnIndex;
 
 
+/* TCP listener indexes. They are allocated by TCP_listen */
+typedef enum
+{
+    TCP_KE_FIRST_LISTENER,
+    TCP_KE_LISTENER_MAX_NUM = TCP_UC_MAX_LISTEN_NUM,
+    TCP_KE_NULL_LISTENER_INDEX = 0xFF
+} TCP_ke_ListenerIndex;
+
+
+/* TCP connection errors */
+typedef enum
+{
+    TCP_KE_ERR_NONE,
+    TCP_KE_ERR_TIMEOUT,     /* retransmissions limit reached: connection aborted */
+    TCP_KE_ERR_PEER_DEAD,   /* keepalive probes not answered: connection aborted */
+    TCP_KE_ERR_RESET,       /* RST received: connection reset by the peer */
+    TCP_KE_ERR_PROTOCOL,    /* not reported: an unacceptable handshake ACK is answered with a RST and the connection is kept */
+    TCP_KE_ERR_INVALID_CONN /* connection index is not allocated */
+} TCP_ke_ConnError;
+
+
+/* TCP connection states */
+typedef enum
+{
+    TCP_KE_STATE_OPENING,
+    TCP_KE_STATE_SYN_SENT,      /* SYN sent: waiting for SYN ACK */
+    TCP_KE_STATE_SYN_RECEIVED,  /* SYN ACK sent: waiting for its ACK */
+    TCP_KE_STATE_ESTABLISHED,
+    TCP_KE_STATE_FIN_WAIT,      /* FIN sent: waiting for its ACK */
+    TCP_KE_STATE_HALF_OPEN,     /* FIN received: peer has closed its side */
+    TCP_KE_STATE_HALF_CLOSED,   /* FIN sent and acknowledged: waiting for peer FIN */
+    TCP_KE_STATE_LAST_ACK,      /* FIN sent after peer one: waiting for its ACK */
+    TCP_KE_STATE_CLOSED
+} TCP_ke_ConnState;
+
+
+/* TCP connection events */
+typedef enum
+{
+    TCP_KE_EVT_CONNECTED,   /* connection established: data can be sent */
+    TCP_KE_EVT_DATA_READY,  /* new data can be read */
+    TCP_KE_EVT_SEND_SPACE,  /* sent data acknowledged: TX buffer space freed */
+    TCP_KE_EVT_PEER_CLOSED, /* peer has closed its side: no more data will be received */
+    TCP_KE_EVT_CLOSED,      /* connection closed */
+    TCP_KE_EVT_ABORTED      /* connection reset or aborted. See TCP_getConnError() */
+} TCP_ke_ConnEvent;
+
+
+
+/* ------------ Exported types --------------- */
+
+/* connection events callback type */
+typedef void (* TCP_event_cb_ptr_t)(TCP_ke_ConnIndex, TCP_ke_ConnEvent);
+
+
+/* connection statistics. Counters start from 0 at connection opening */
+typedef struct
+{
+    TCP_ke_ConnState eState;
+    uint32  ui32SmoothRttMs;            /* smoothed round trip time. 0 if no samples yet */
+    uint32  ui32RttVarMs;               /* round trip time variance */
+    uint32  ui32MinRttMs;               /* lowest round trip time sample. 0 if no samples yet */
+    uint32  ui32RtoMs;                  /* current retransmission timeout */
+    uint32  ui32CongWindow;             /* congestion window in bytes */
+    uint16  ui16PeerWindowSize;         /* last window advertised by the peer */
+    uint16  ui16SendMss;                /* maximum segment size to send */
+    uint16  ui16RXDataLength;           /* received and unread data length */
+    uint16  ui16PendingTXDataLength;    /* data not yet acknowledged: in flight plus unsent */
+    uint32  ui32SegmentsIn;             /* valid segments received */
+    uint32  ui32SegmentsOut;            /* segments sent, retransmissions included */
+    uint32  ui32BytesIn;                /* data bytes received in order */
+    uint32  ui32BytesOut;               /* data bytes sent, retransmissions included */
+    uint32  ui32RetransmitsNum;         /* segments retransmitted on timeout or fast retransmit */
+    uint32  ui32DupAcksIn;              /* duplicate ACKs received */
+    uint32  ui32RstIn;                  /* RST segments received, valid or not */
+    uint32  ui32RstOut;                 /* RST segments sent */
+    uint32  ui32OooSegmentsIn;          /* segments received out of order and queued */
+    uint32  ui32RXWindowFullNum;        /* in-window segments truncated for lack of RX buffer space */
+    uint32  ui32DiscardedSegmentsIn;    /* duplicated or out of window data segments discarded */
+    uint32  ui32PeerZeroWindowNum;      /* times sending has been stalled by a zero peer window */
+    uint32  ui32EcnReductionsNum;       /* congestion window reductions on ECN echoes */
+} TCP_st_ConnStats;
+
+
+
+/* connection options applied at opening. Get defaults with TCP_getDefaultConnOptions() */
+typedef struct
+{
+    uint16  ui16RXBufferLength;         /* RX buffer length: maximum advertised window. 64 bytes at least */
+    uint16  ui16TXBufferLength;         /* TX buffer length: maximum sent and not yet acknowledged data. 64 bytes at least */
+    boolean bKeepHalfOpen;              /* keep the connection open when the peer closes its side */
+    boolean bNoDelay;                   /* send small segments immediately */
+    boolean bFastOpen;                  /* send data with the SYN */
+    boolean bKeepAlive;                 /* send keepalive probes on idle connection */
+    uint32  ui32KeepAliveIdleMs;        /* idle time before the first probe */
+    uint32  ui32KeepAliveIntvMs;        /* interval between probes */
+    uint8   ui8KeepAliveProbesNum;      /* unanswered probes before declaring the peer dead */
+    uint8   ui8MaxRetxNum;              /* consecutive retransmissions before aborting the connection */
+} TCP_st_ConnOptions;
+
+
+
 /* ------------ Exported functions prototypes */
 
-EXTERN boolean  TCP_openConnection  (TCP_ke_ConnIndex, uint32, uint32, uint16, uint16, boolean);
+EXTERN TCP_ke_ConnIndex TCP_openConnection (uint32, uint32, uint16, uint16, boolean);
+EXTERN TCP_ke_ConnIndex TCP_openConnectionWithOptions (uint32, uint32, uint16, uint16, TCP_st_ConnOptions *);
+EXTERN void     TCP_getDefaultConnOptions (TCP_st_ConnOptions *);
 EXTERN void     TCP_closeConnection (TCP_ke_ConnIndex);
-EXTERN boolean  TCP_sendData        (TCP_ke_ConnIndex, uint8 *, uint16);
+EXTERN TCP_ke_ListenerIndex TCP_listen (uint32, uint16, uint8, boolean);
+EXTERN TCP_ke_ConnIndex TCP_accept (TCP_ke_ListenerIndex);
+EXTERN void     TCP_closeListener   (TCP_ke_ListenerIndex);
+EXTERN uint16   TCP_sendData        (TCP_ke_ConnIndex, uint8 *, uint16);
+EXTERN void     TCP_setNoDelay      (TCP_ke_ConnIndex, boolean);
+EXTERN void     TCP_setFastOpen     (TCP_ke_ConnIndex, boolean);
+EXTERN void     TCP_setEventCallback (TCP_ke_ConnIndex, TCP_event_cb_ptr_t);
+EXTERN void     TCP_setKeepAlive    (TCP_ke_ConnIndex, boolean, uint32, uint32, uint8);
 EXTERN void     TCP_getReceivedData (TCP_ke_ConnIndex, uint8 *, uint16 *);
+EXTERN uint16   TCP_peekReceivedData (TCP_ke_ConnIndex, uint8 **);
+EXTERN void     TCP_consumeReceivedData (TCP_ke_ConnIndex, uint16);
+EXTERN TCP_ke_ConnError TCP_getConnError (TCP_ke_ConnIndex);
+EXTERN void     TCP_getConnStats    (TCP_ke_ConnIndex, TCP_st_ConnStats *);
 EXTERN void     TCP_PeriodicTask    (void);
-EXTERN void     TCP_unpackMessage   (uint32, uint32, uint8 *, uint16);
+EXTERN void     TCP_unpackMessage   (uint32, uint32, uint8 *, uint16, uint8, uint32);
 
 
 
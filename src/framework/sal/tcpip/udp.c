@@ -40,7 +40,6 @@ TODO LIST:
         This is done in UDP_SendDataBuffer() API function at the moment.
         So, in the event of TX data buffer pointer not valid the request is discarded at the moment.
         See UDP_SendDataBuffer() API function.
-    4)  implement header checksum validity check in UDP_unpackMessage() function
     5)  do not close sockets in case of pending RX or TX data. See UDP_CloseUDPSocket() function
 */
 
@@ -122,7 +121,6 @@ LOCAL st_UDPSocketInfo stUDPSocketInfo[UDP_SOCKET_MAX_NUM];
 /* --------------- Local functions prototypes ----------------- */
 
 LOCAL uint8     getSocketIndex      (uint32, uint32, uint16, uint16);
-LOCAL uint16    calculateChecksum   (IPv4_st_PacketDescriptor *, uint16 *);
 
 
 
@@ -154,7 +152,7 @@ EXPORTED void UDP_checkReceivedData(UDP_keSocketNum unSocketNum, uint8 **pui8Dat
 
 
 /* request to unpack a data buffer */
-EXPORTED void UDP_unpackMessage( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint8 *ui8MessagePtr )
+EXPORTED void UDP_unpackMessage( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint8 *ui8MessagePtr, uint16 ui16MsgLength, uint32 ui32DataSum )
 {
     uint32 *pui32HeaderPtr;
     uint32 ui32HdrWord;
@@ -163,6 +161,7 @@ EXPORTED void UDP_unpackMessage( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint8
     uint16 ui16SourcePort;
     uint16 ui16DestPort;
     uint8 ui8SocketIndex;
+    IPv4_st_PacketDescriptor stIPv4PacketDscpt;
 
     /* get buffer pointer */
     pui32HeaderPtr = (uint32 *)ui8MessagePtr;
@@ -176,41 +175,79 @@ EXPORTED void UDP_unpackMessage( uint32 ui32SrcIPAdd, uint32 ui32DstIPAdd, uint8
     ui16Length = GET_HDR_LENGTH(ui32HdrWord);
     /* get checksum */
     ui16Checksum = GET_HDR_CHECKSUM(ui32HdrWord);
-    /* checksum validity check */
-    //...
-
-    /* get socket id from src and dst addresses and ports */
-    ui8SocketIndex = getSocketIndex(ui32SrcIPAdd, ui32DstIPAdd, ui16SourcePort, ui16DestPort);
-    if(ui8SocketIndex < UDP_SOCKET_MAX_NUM)
+    /* if UDP length is shorter than the header or goes beyond IP data */
+    if((ui16Length < UDP_HEADER_BYTE_LENGTH)
+    || (ui16Length > ui16MsgLength))
     {
-        /* calculate data length: remove header length from total length */
-        ui16Length -= UDP_HEADER_BYTE_LENGTH;
+        /* malformed packet: discard it */
+    }
+    else
+    {
+        /* if checksum has been sent by the peer */
+        if(ui16Checksum != US_NULL)
+        {
+            /* if whole packet has not been summed by hardware or IP data go beyond it */
+            if((IPV4_UL_NO_DATA_SUM == ui32DataSum)
+            || (ui16Length != ui16MsgLength))
+            {
+                /* sum it by software */
+                ui32DataSum = IPV4_copyAndSum(NULL_PTR, ui8MessagePtr, ui16Length, UL_NULL);
+            }
+            else
+            {
+                /* packet sum is ready */
+            }
 
-        /* check length */
-        if(ui16Length <= UDP_MAX_DATA_LENGTH_ALLOWED)
+            /* add pseudo header sum: result is null if valid */
+            stIPv4PacketDscpt.enProtocol = IPV4_PROT_UDP;
+            stIPv4PacketDscpt.ui16DataLength = ui16Length;
+            stIPv4PacketDscpt.ui32IPSrcAddress = ui32SrcIPAdd;
+            stIPv4PacketDscpt.ui32IPDstAddress = ui32DstIPAdd;
+            ui16Checksum = IPV4_foldChecksum(ui32DataSum + IPV4_getPseudoHdrSum(&stIPv4PacketDscpt));
+        }
+        else
         {
-            /* store data length */
-            stUDPSocketInfo[ui8SocketIndex].ui16RXDataLength = ui16Length;
+            /* checksum not used */
+        }
+
+        /* get socket id from src and dst addresses and ports */
+        ui8SocketIndex = getSocketIndex(ui32SrcIPAdd, ui32DstIPAdd, ui16SourcePort, ui16DestPort);
+        /* if checksum is wrong */
+        if(ui16Checksum != US_NULL)
+        {
+            /* corrupted packet: discard it */
+        }
+        else if(ui8SocketIndex < UDP_SOCKET_MAX_NUM)
+        {
+            /* calculate data length: remove header length from total length */
+            ui16Length -= UDP_HEADER_BYTE_LENGTH;
+
+            /* check length */
+            if(ui16Length <= UDP_MAX_DATA_LENGTH_ALLOWED)
+            {
+                /* store data length */
+                stUDPSocketInfo[ui8SocketIndex].ui16RXDataLength = ui16Length;
 
-            /* copy received data */
-            MEM_COPY(stUDPSocketInfo[ui8SocketIndex].pui8RXDataBufPtr,
-                     pui32HeaderPtr,
-                     ui16Length);
+                /* copy received data */
+                MEM_COPY(stUDPSocketInfo[ui8SocketIndex].pui8RXDataBufPtr,
+                         pui32HeaderPtr,
+                         ui16Length);
 
-            /* set flag. ATTENTION: should be an atomic operation */
-            stUDPSocketInfo[ui8SocketIndex].bNewRXAvailData = B_TRUE;
+                /* set flag. ATTENTION: should be an atomic operation */
+                stUDPSocketInfo[ui8SocketIndex].bNewRXAvailData = B_TRUE;
+            }
+            else
+            {
+                /* length is more than maximum available: discard data at the moment */
+            }
         }
         else
         {
-            /* length is more than maximum available: discard data at the moment */
+            /* ATTENTION */
+            /* received data are not for an open socket */
+            /* discard data */
         }
     }
-    else
-    {
-        /* ATTENTION */
-        /* received data are not for an open socket */
-        /* discard data */
-    }
 }
 
 
@@ -268,20 +305,22 @@ EXPORTED UDP_keOpResult UDP_SendDataBuffer(UDP_keSocketNum unSocketNum, uint8 *p
     IPV4_keOpResult unIPOpResult;
     IPv4_st_PacketDescriptor stIPv4PacketDscpt;
     uint16 ui16Checksum;
+    uint32 ui32Sum;
     uint8 *pui8BufferPtr;
     uint32 *pui32HdrWords;
     uint32 ui32HdrWord = UL_NULL;
+    PBUF_st_Buffer *pstPbuf;
 
     /* check required socket number and if the socket is open */
     if((unSocketNum < UDP_SOCKET_MAX_NUM)
     && (stUDPSocketInfo[unSocketNum].bSocketOpen == B_TRUE))
     {
-        /* ATTENTION: a pointer availability check is needed */
-        pui8BufferPtr = (uint8 *)IPV4_getDataBuffPtr();
-        if(pui8BufferPtr != NULL)
+        /* get a packet buffer for header and data: lower layers add their headers in front of it */
+        pstPbuf = PBUF_alloc((uint16)(ui16BuffLength + UDP_HEADER_BYTE_LENGTH));
+        if(pstPbuf != NULL_PTR)
         {
-            /* perform a 32-bit word alignment */
-            ALIGN_32BIT_OF_8BIT_PTR(pui8BufferPtr);
+            /* header starts at 32-bit aligned buffer data */
+            pui8BufferPtr = pstPbuf->pui8Payload;
             /* set 32-bit header pointer */
             pui32HdrWords = (uint32 *)pui8BufferPtr;
 
@@ -292,23 +331,35 @@ EXPORTED UDP_keOpResult UDP_SendDataBuffer(UDP_keSocketNum unSocketNum, uint8 *p
             WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
             /* set UDP length as data length plus header length */
             SET_HDR_LENGTH(ui32HdrWord, (ui16BuffLength + UDP_HEADER_BYTE_LENGTH));
-            /* ATTENTION: checksum is fixed at 0 (not mandatory) */
+            /* clear checksum: it is updated once data are attached */
             SET_HDR_CHECKSUM(ui32HdrWord, 0x0000);
             WRITE_32BIT_AND_NEXT(pui32HdrWords, ui32HdrWord);
 
-            /* attach data */
-            MEM_COPY((uint8 *)pui32HdrWords, pui8BuffPtr, ui16BuffLength);
-
             /* set IPv4 descriptor */
             stIPv4PacketDscpt.enProtocol = IPV4_PROT_UDP;
             stIPv4PacketDscpt.bDoNotFragment = B_FALSE; /* ATTENTION: this value can change according to application request */
+            stIPv4PacketDscpt.ui8Ecn = IPV4_UC_ECN_NOT_ECT;
             stIPv4PacketDscpt.ui16DataLength = (ui16BuffLength + UDP_HEADER_BYTE_LENGTH);
             stIPv4PacketDscpt.ui32IPDstAddress = stUDPSocketInfo[unSocketNum].ui32IPDstAddress;
             stIPv4PacketDscpt.ui32IPSrcAddress = stUDPSocketInfo[unSocketNum].ui32IPSrcAddress;
 
-            /* calculate and update checksum field */
+            /* sum pseudo header and UDP header */
+            ui32Sum = IPV4_getPseudoHdrSum(&stIPv4PacketDscpt);
+            ui32Sum = IPV4_copyAndSum(NULL_PTR, pui8BufferPtr, UDP_HEADER_BYTE_LENGTH, ui32Sum);
+            /* attach data summing them while copying */
+            ui32Sum = IPV4_copyAndSum((uint8 *)pui32HdrWords, pui8BuffPtr, ui16BuffLength, ui32Sum);
+
+            /* calculate and update checksum field. A null checksum is sent as all ones */
+            ui16Checksum = IPV4_foldChecksum(ui32Sum);
+            if(US_NULL == ui16Checksum)
+            {
+                ui16Checksum = 0xFFFF;
+            }
+            else
+            {
+                /* checksum is valid */
+            }
             pui32HdrWords = (uint32 *)pui8BufferPtr;
-            ui16Checksum = calculateChecksum(&stIPv4PacketDscpt, (uint16 *)pui32HdrWords);
             pui32HdrWords += 1;
             UPDATE_HDR_CHECKSUM(pui32HdrWords, ui16Checksum);
 /*
@@ -321,8 +372,8 @@ EXPORTED UDP_keOpResult UDP_SendDataBuffer(UDP_keSocketNum unSocketNum, uint8 *p
             stIPv4PacketDscpt.stOptions.unOptionType.stOptionType.optionClass = 2;
             stIPv4PacketDscpt.stOptions.unOptionType.stOptionType.optionNumber = 4;
 */
-            /* send UDP packet through IP */
-            unIPOpResult = IPV4_SendPacket(stIPv4PacketDscpt);
+            /* send UDP packet through IP. IP layer releases the buffer */
+            unIPOpResult = IPV4_SendPbuf(stIPv4PacketDscpt, pstPbuf);
         
             /* check IP operation result */
             if(IPV4_OP_OK == unIPOpResult)
@@ -409,46 +460,6 @@ LOCAL uint8 getSocketIndex(uint32 ui32SourceAdd, uint32 ui32DestAdd, uint16 ui16
 }
 
 
-/* Function to calculate checksum */
-LOCAL uint16 calculateChecksum(IPv4_st_PacketDescriptor *stIPv4Header, uint16 *pui16UDPSegment)
-{
-    uint32 ui32Sum = 0;
-    uint16 ui16Length = stIPv4Header->ui16DataLength;
-
-    ui32Sum += ((SWAP_BYTES_ORDER_32BIT_(stIPv4Header->ui32IPSrcAddress) >> UL_SHIFT_16) & 0xFFFF);
-    ui32Sum += (SWAP_BYTES_ORDER_32BIT_(stIPv4Header->ui32IPSrcAddress) & 0xFFFF);
-
-    ui32Sum += ((SWAP_BYTES_ORDER_32BIT_(stIPv4Header->ui32IPDstAddress) >> UL_SHIFT_16) & 0xFFFF);
-    ui32Sum += (SWAP_BYTES_ORDER_32BIT_(stIPv4Header->ui32IPDstAddress) & 0xFFFF);
-
-    ui32Sum += SWAP_BYTES_ORDER_16BIT_(stIPv4Header->enProtocol);
-
-    ui32Sum += SWAP_BYTES_ORDER_16BIT_(stIPv4Header->ui16DataLength);
-
-    while( ui16Length > 1 )
-    {
-        ui32Sum += *pui16UDPSegment;
-        pui16UDPSegment++;
-        ui16Length -= 2;
-    }
-
-    if( ui16Length > 0 )
-    {
-        ui32Sum += ((*pui16UDPSegment) & SWAP_BYTES_ORDER_16BIT_(0xFF00));
-    }
-
-    /* Fold 32-bit sum to 16 bits: add carrier to result */
-    while( ui32Sum >> 16 )
-    {
-        ui32Sum = (ui32Sum & 0xFFFF) + (ui32Sum >> 16);
-    }
-    ui32Sum = ~ui32Sum;
-
-    /* swap bytes order */
-    ui32Sum = SWAP_BYTES_ORDER_16BIT_(ui32Sum);
-
-    return (uint16)ui32Sum;
-}
 
 
 
@@ -79,7 +79,7 @@ typedef enum
 EXTERN UDP_keOpResult   UDP_OpenUDPSocket       (UDP_keSocketNum, uint32, uint32, uint16, uint16);
 EXTERN UDP_keOpResult   UDP_SendDataBuffer      (UDP_keSocketNum, uint8 *, uint16);
 EXTERN void             UDP_checkReceivedData   (UDP_keSocketNum, uint8 **, uint16 *);
-EXTERN void             UDP_unpackMessage       (uint32, uint32, uint8 *);
+EXTERN void             UDP_unpackMessage       (uint32, uint32, uint8 *, uint16, uint32);
 EXTERN UDP_keOpResult   UDP_CloseUDPSocket      (UDP_keSocketNum);
 
 